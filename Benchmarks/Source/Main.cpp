@@ -0,0 +1,571 @@
+/*
+ ==============================================================================
+ Main.cpp
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+// the plugin's JuceHeader.h, this project's own one would define ProjectInfo a second time
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/PluginEditor.h"
+
+// compare.sh builds these benchmarks against older versions of the plugin, which lack some of this
+#if __has_include ("../../resources/ConvolutionLoader.h")
+ #define AA_HAS_LOADER_METRICS 1
+#endif
+#if __has_include ("../../resources/customComponents/PaintTimings.h")
+ #define AA_HAS_PAINT_TIMINGS 1
+#endif
+#if __has_include ("../../resources/OfflinePatternOptimizer.h")
+ #define AA_HAS_OFFLINE_OPTIMIZER 1
+#endif
+
+/* Benchmarks of the plugin, run without a host or an audio device. The main thread acts as message
+   and audio thread, a command fails with return code 1 if a budget given on the command line is exceeded. */
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 512;
+    constexpr double settleTimeout = 30000.0; // ms
+
+    int getIntOption (const ArgumentList& args, StringRef option, int defaultValue)
+    {
+        return args.containsOption (option) ? args.getValueForOption (option).getIntValue() : defaultValue;
+    }
+
+    // a budget of 0 ms is not checked
+    void checkBudget (const ArgumentList& args, const String& what, double milliseconds)
+    {
+        const double budget = args.containsOption ("--budget") ? args.getValueForOption ("--budget").getDoubleValue() : 0.0;
+        if (budget > 0.0 && milliseconds > budget)
+            ConsoleApplication::fail (what + " took " + String (milliseconds, 3) + " ms, the budget is " + String (budget, 3) + " ms");
+    }
+
+    // the state a host restores when it opens a session with a default instance on it
+    MemoryBlock getSessionState()
+    {
+        PolarDesignerAudioProcessor instance;
+        MemoryBlock state;
+        instance.getStateInformation (state);
+        return state;
+    }
+
+    //==============================================================================
+    /* Overloads for older versions of the plugin, the int overload is taken where the member exists. */
+    template <typename Processor>
+    auto isFilterBankSettled (Processor& processor, int) -> decltype (processor.isFilterBankSettled())
+    {
+        return processor.isFilterBankSettled();
+    }
+
+    // designs the filter bank in setStateInformation and prepareToPlay
+    template <typename Processor>
+    bool isFilterBankSettled (Processor&, long)
+    {
+        return true;
+    }
+
+    // returns the number of scenes stored
+    template <typename Processor>
+    auto storeScenes (Processor& processor, int numScenes, int) -> decltype (processor.storeScene (1), int())
+    {
+        numScenes = jmin (numScenes, static_cast<int> (Processor::N_SCENES));
+        for (int scene = 1; scene <= numScenes; ++scene)
+            processor.storeScene (scene);
+        return numScenes;
+    }
+
+    template <typename Processor>
+    int storeScenes (Processor&, int, long)
+    {
+        return 0;
+    }
+
+    template <typename Editor>
+    auto updateDisplay (Editor& editor, int) -> decltype (editor.updateDisplay(), void())
+    {
+        editor.updateDisplay();
+    }
+
+    // updates from a 30 ms timer, which also runs the overlay animation
+    template <typename Editor>
+    void updateDisplay (Editor&, long)
+    {
+        MessageManager::getInstance()->runDispatchLoopUntil (35);
+    }
+
+    template <typename Overlay>
+    auto advanceAnimation (Overlay& overlay, int) -> decltype (overlay.advanceAnimation(), void())
+    {
+        overlay.advanceAnimation();
+    }
+
+    template <typename Overlay>
+    void advanceAnimation (Overlay&, long)
+    {
+    }
+
+    //==============================================================================
+    struct OpenResult
+    {
+        double elapsed = 0.0; // ms
+       #if AA_HAS_LOADER_METRICS
+        int maxLoaderThreads = 0, maxQueueThreads = 0;
+        ConvolutionLoader::Metrics loads; // wake-ups, notifications and posts while opening
+       #endif
+    };
+
+    /* Constructs, restores and prepares numInstances instances and processes silence until all of them
+       run their restored filter bank. Blocks are processed as fast as possible, so the engine settle
+       and crossfade times count with the time it takes to process them. */
+    OpenResult measureOpenTime (int numInstances, const MemoryBlock& state)
+    {
+        OpenResult result;
+       #if AA_HAS_LOADER_METRICS
+        const ConvolutionLoader::Metrics loadsBefore = ConvolutionLoader::getMetrics();
+        auto sampleThreads = [&result]()
+        {
+            const ConvolutionLoader::Metrics current = ConvolutionLoader::getMetrics();
+            result.maxLoaderThreads = jmax (result.maxLoaderThreads, current.loaderThreads);
+            result.maxQueueThreads = jmax (result.maxQueueThreads, current.queueThreads);
+        };
+       #else
+        auto sampleThreads = []() {};
+       #endif
+
+        const double start = Time::getMillisecondCounterHiRes();
+
+        OwnedArray<PolarDesignerAudioProcessor> instances;
+        for (int i = 0; i < numInstances; ++i)
+        {
+            auto* instance = instances.add (new PolarDesignerAudioProcessor());
+            instance->setStateInformation (state.getData(), static_cast<int> (state.getSize()));
+            instance->prepareToPlay (sampleRate, blockSize);
+        }
+
+        AudioBuffer<float> buffer (2, blockSize);
+        MidiBuffer midi;
+        for (;;)
+        {
+            bool settled = true;
+            for (auto* instance : instances)
+            {
+                buffer.clear();
+                instance->processBlock (buffer, midi);
+                settled = isFilterBankSettled (*instance, 0) && settled;
+            }
+
+            sampleThreads();
+            if (settled)
+                break;
+
+            if (Time::getMillisecondCounterHiRes() - start > settleTimeout)
+                ConsoleApplication::fail (String (numInstances) + " instances did not settle within " + String (settleTimeout / 1000.0) + " s");
+
+            // design jobs and scene recalls finish on the message thread
+            MessageManager::getInstance()->runDispatchLoopUntil (1);
+        }
+
+        result.elapsed = Time::getMillisecondCounterHiRes() - start;
+       #if AA_HAS_LOADER_METRICS
+        const ConvolutionLoader::Metrics loadsAfter = ConvolutionLoader::getMetrics();
+        result.loads.notifications = loadsAfter.notifications - loadsBefore.notifications;
+        result.loads.wakeUps = loadsAfter.wakeUps - loadsBefore.wakeUps;
+        result.loads.loadsPosted = loadsAfter.loadsPosted - loadsBefore.loadsPosted;
+       #endif
+
+        for (auto* instance : instances)
+            instance->releaseResources();
+        return result;
+    }
+
+    // instance counts doubling up to --instances, the shared design pool and kernel cache start cold every time
+    void runOpenBenchmark (const ArgumentList& args)
+    {
+        const int maxInstances = jmax (1, getIntOption (args, "--instances", 32));
+        const MemoryBlock state = getSessionState();
+
+        std::cout << "open time, " << sampleRate << " Hz, " << blockSize << " samples per block" << std::endl;
+        for (int numInstances = 1; numInstances <= maxInstances; numInstances *= 2)
+        {
+            const OpenResult result = measureOpenTime (numInstances, state);
+            std::cout << String (numInstances).paddedLeft (' ', 4) << " instances  "
+                      << String (result.elapsed, 1).paddedLeft (' ', 9) << " ms  "
+                      << String (result.elapsed / numInstances, 2).paddedLeft (' ', 8) << " ms per instance";
+           #if AA_HAS_LOADER_METRICS
+            std::cout << "  loader threads " << result.maxLoaderThreads << " + " << result.maxQueueThreads << " queue  "
+                      << result.loads.loadsPosted << " loads, " << result.loads.notifications << " notifications, "
+                      << result.loads.wakeUps << " wake-ups";
+           #endif
+            std::cout << std::endl;
+            checkBudget (args, "opening " + String (numInstances) + " instances", result.elapsed);
+        }
+    }
+
+    //==============================================================================
+    // median, 95th percentile and maximum in ms, returns the median
+    double printDistribution (const String& name, std::vector<double> values)
+    {
+        std::sort (values.begin(), values.end());
+        const double median = values[values.size() / 2];
+        std::cout << name.paddedRight (' ', 14) << "  med " << String (median, 3)
+                  << "  p95 " << String (values[jmin (values.size() - 1, values.size() * 95 / 100)], 3)
+                  << "  max " << String (values.back(), 3) << " ms" << std::endl;
+        return median;
+    }
+
+    /* Constructor and destructor times. The first instance creates the resources all instances share,
+       the others are constructed while a first instance keeps them alive, like a host adding an
+       instance to a session. The budget applies to the median constructor time of those. */
+    void runInstantiateBenchmark (const ArgumentList& args)
+    {
+        const int iterations = jmax (1, getIntOption (args, "--iterations", 100));
+
+        double start = Time::getMillisecondCounterHiRes();
+        auto first = std::make_unique<PolarDesignerAudioProcessor>();
+        const double firstConstruction = Time::getMillisecondCounterHiRes() - start;
+
+        std::vector<double> constructions, destructions;
+        for (int i = 0; i < iterations; ++i)
+        {
+            start = Time::getMillisecondCounterHiRes();
+            auto instance = std::make_unique<PolarDesignerAudioProcessor>();
+            constructions.push_back (Time::getMillisecondCounterHiRes() - start);
+
+            start = Time::getMillisecondCounterHiRes();
+            instance.reset();
+            destructions.push_back (Time::getMillisecondCounterHiRes() - start);
+        }
+
+        first.reset();
+
+        std::cout << "instantiation, " << iterations << " iterations" << std::endl
+                  << "first construction  " << String (firstConstruction, 3) << " ms" << std::endl;
+        const double medianConstruction = printDistribution ("construction", constructions);
+        printDistribution ("destruction", destructions);
+        checkBudget (args, "constructing an instance", medianConstruction);
+    }
+
+    /* Save and restore times of a prepared instance, as a host saves and reloads a session.
+       --scenes stores that many scenes first, they are part of the state. Versions of the plugin without
+       scenes fail when scenes are requested. */
+    void runStateBenchmark (const ArgumentList& args)
+    {
+        const int iterations = jmax (1, getIntOption (args, "--iterations", 100));
+        const int requestedScenes = jmax (0, getIntOption (args, "--scenes", 0));
+
+        PolarDesignerAudioProcessor instance;
+        instance.prepareToPlay (sampleRate, blockSize);
+        const int numScenes = storeScenes (instance, requestedScenes, 0);
+        if (requestedScenes > 0 && numScenes == 0)
+            ConsoleApplication::fail ("this version of the plugin has no scenes");
+
+        std::vector<double> saves, restores;
+        MemoryBlock state;
+        for (int i = 0; i < iterations; ++i)
+        {
+            state.reset();
+            double start = Time::getMillisecondCounterHiRes();
+            instance.getStateInformation (state);
+            saves.push_back (Time::getMillisecondCounterHiRes() - start);
+
+            start = Time::getMillisecondCounterHiRes();
+            instance.setStateInformation (state.getData(), static_cast<int> (state.getSize()));
+            restores.push_back (Time::getMillisecondCounterHiRes() - start);
+
+            // lets the redesigns of the restored state run between the iterations
+            MessageManager::getInstance()->runDispatchLoopUntil (1);
+        }
+
+        instance.releaseResources();
+
+        std::cout << "state, " << numScenes << " scenes, " << state.getSize() << " bytes, " << iterations << " iterations" << std::endl;
+        const double medianSave = printDistribution ("save", saves);
+        const double medianRestore = printDistribution ("restore", restores);
+        checkBudget (args, "saving and restoring an instance", medianSave + medianRestore);
+    }
+
+    //==============================================================================
+    Component* findComponent (Component& parent, const std::function<bool (Component&)>& predicate)
+    {
+        for (auto* child : parent.getChildren())
+        {
+            if (predicate (*child))
+                return child;
+            if (auto* found = findComponent (*child, predicate))
+                return found;
+        }
+        return nullptr;
+    }
+
+    // clicks the visible button with this text and lets the click's message arrive
+    void clickButton (Component& editor, const String& text)
+    {
+        auto* button = dynamic_cast<Button*> (findComponent (editor, [&text] (Component& c)
+        {
+            auto* b = dynamic_cast<Button*> (&c);
+            return b != nullptr && b->isVisible() && b->getButtonText() == text;
+        }));
+        if (button == nullptr)
+            ConsoleApplication::fail ("the editor has no button \"" + text + "\"");
+
+        button->triggerClick();
+        MessageManager::getInstance()->runDispatchLoopUntil (10);
+    }
+
+    RangedAudioParameter& getParameter (AudioProcessor& processor, const String& parameterID)
+    {
+        for (auto* parameter : processor.getParameters())
+            if (auto* ranged = dynamic_cast<RangedAudioParameter*> (parameter))
+                if (ranged->getParameterID() == parameterID)
+                    return *ranged;
+
+        ConsoleApplication::fail ("no parameter " + parameterID);
+        jassertfalse;
+        return *dynamic_cast<RangedAudioParameter*> (processor.getParameters()[0]);
+    }
+
+    void setParameter (AudioProcessor& processor, const String& parameterID, float value)
+    {
+        auto& parameter = getParameter (processor, parameterID);
+        parameter.setValueNotifyingHost (parameter.convertTo0to1 (value));
+    }
+
+    /* Renders the editor into images while replaying what a user does, no window is opened: frames
+       without changes, crossover drags across their ranges, every band count and the animation of the
+       target tracking overlay, at three editor sizes and the display scales 1 and 2. Every frame first
+       runs the editor's display update, as a display frame would. Prints the frame time distribution
+       of each part and the paint times of the instrumented components. The budget applies to the median
+       frame time without changes at the default size and scale 1. */
+    void runPaintBenchmark (const ArgumentList& args)
+    {
+       #if AA_HAS_PAINT_TIMINGS
+        const int steadyFrames = jlimit (1, PaintTimings::maxSamples, getIntOption (args, "--iterations", 100));
+       #else
+        const int steadyFrames = jmax (1, getIntOption (args, "--iterations", 100));
+       #endif
+
+        PolarDesignerAudioProcessor instance;
+        instance.prepareToPlay (sampleRate, blockSize);
+        std::unique_ptr<AudioProcessorEditor> editorOwner (instance.createEditorIfNeeded());
+        auto& editor = dynamic_cast<PolarDesignerAudioProcessorEditor&> (*editorOwner);
+       #if AA_HAS_PAINT_TIMINGS
+        SharedResourcePointer<PaintTimings> paintTimings;
+       #endif
+
+        const int defaultWidth = editor.getWidth();
+        const int defaultHeight = editor.getHeight();
+        const int nBands = instance.getNBands();
+        double budgetedMedian = -1.0;
+
+        for (float size : { 1.0f, 1.25f, 1.5f })
+        {
+            editor.setSize (roundToInt (defaultWidth * size), roundToInt (defaultHeight * size));
+            for (float scale : { 1.0f, 2.0f })
+            {
+                std::cout << "editor " << editor.getWidth() << " x " << editor.getHeight() << ", scale " << scale << std::endl;
+                std::vector<double> frameTimes;
+                auto renderFrame = [&]()
+                {
+                    updateDisplay (editor, 0);
+                    const double start = Time::getMillisecondCounterHiRes();
+                    editor.createComponentSnapshot (editor.getLocalBounds(), true, scale);
+                    frameTimes.push_back (Time::getMillisecondCounterHiRes() - start);
+                };
+                auto report = [&] (const String& part)
+                {
+                    if (frameTimes.empty()) // one band has no crossovers
+                        return 0.0;
+                    const double median = printDistribution (part, frameTimes);
+                    frameTimes.clear();
+                    return median;
+                };
+
+                renderFrame(); // builds the caches of this size and scale
+                frameTimes.clear();
+               #if AA_HAS_PAINT_TIMINGS
+                paintTimings->clear();
+               #endif
+
+                for (int i = 0; i < steadyFrames; ++i)
+                    renderFrame();
+                const double steadyMedian = report ("no changes");
+                if (budgetedMedian < 0.0)
+                    budgetedMedian = steadyMedian;
+
+                for (int i = 0; i < nBands - 1; ++i)
+                {
+                    const String parameterID = "xOverF" + String (i + 1);
+                    const float original = getParameter (instance, parameterID).getValue();
+                    for (int step = 0; step <= 20; ++step)
+                    {
+                        setParameter (instance, parameterID, jmap (step / 20.0f, instance.getXoverSliderRangeStart (i), instance.getXoverSliderRangeEnd (i)));
+                        renderFrame();
+                    }
+                    getParameter (instance, parameterID).setValueNotifyingHost (original);
+                }
+                report ("crossover drags");
+
+                const float originalBands = getParameter (instance, "nrBands").getValue();
+                for (int bands = 1; bands <= 5; ++bands)
+                {
+                    setParameter (instance, "nrBands", static_cast<float> (bands - 1));
+                    renderFrame();
+                }
+                getParameter (instance, "nrBands").setValueNotifyingHost (originalBands);
+                report ("band counts");
+
+                clickButton (editor, "maximize target");
+                auto* overlay = dynamic_cast<AlertOverlay*> (findComponent (editor, [] (Component& c)
+                {
+                    return dynamic_cast<AlertOverlay*> (&c) != nullptr && c.isVisible();
+                }));
+                if (overlay == nullptr)
+                    ConsoleApplication::fail ("the tracking overlay did not open");
+                for (int i = 0; i < 100; ++i)
+                {
+                    advanceAnimation (*overlay, 0);
+                    renderFrame();
+                }
+                clickButton (editor, "cancel");
+                report ("tracking overlay");
+
+               #if AA_HAS_PAINT_TIMINGS
+                std::cout << paintTimings->getReport() << std::endl;
+               #endif
+            }
+        }
+
+        editorOwner.reset();
+        instance.releaseResources();
+        checkBudget (args, "a frame without changes", budgetedMedian);
+    }
+
+   #if AA_HAS_OFFLINE_OPTIMIZER
+    //==============================================================================
+    /* Computes the terminator patterns from recorded stems and writes them as a preset. Every
+       --signal= and --disturber= adds a stem, a stereo file or a front and a back file separated by
+       a comma. All other settings, including the equalization and proximity compensation the stems
+       are filtered with, are the ones of --preset or the defaults. */
+    void runOptimizeCommand (const ArgumentList& args)
+    {
+        AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        Array<OfflinePatternOptimizer::Stem> stems;
+        double stemSeconds = 0.0;
+        for (auto& argument : args.arguments)
+        {
+            const bool isDisturber = argument.isLongOption ("disturber");
+            if (! isDisturber && ! argument.isLongOption ("signal"))
+                continue;
+
+            const StringArray files = StringArray::fromTokens (argument.getLongOptionValue(), ",", "\"");
+            if (files.isEmpty() || files.size() > 2)
+                ConsoleApplication::fail ("a stem is a stereo file or a front and a back file: " + argument.text);
+
+            OfflinePatternOptimizer::Stem stem;
+            stem.front = File::getCurrentWorkingDirectory().getChildFile (files[0].unquoted());
+            if (files.size() == 2)
+                stem.back = File::getCurrentWorkingDirectory().getChildFile (files[1].unquoted());
+            stem.isDisturber = isDisturber;
+            stems.add (stem);
+
+            if (std::unique_ptr<AudioFormatReader> reader { formatManager.createReaderFor (stem.front) })
+                stemSeconds += reader->lengthInSamples / reader->sampleRate;
+        }
+        if (stems.isEmpty())
+            ConsoleApplication::fail ("no --signal= or --disturber= stems given");
+
+        PolarDesignerAudioProcessor instance;
+        if (args.containsOption ("--preset"))
+        {
+            const Result loaded = instance.loadPreset (args.getExistingFileForOption ("--preset"));
+            if (loaded.failed())
+                ConsoleApplication::fail (loaded.getErrorMessage());
+        }
+
+        var preset;
+        const double start = Time::getMillisecondCounterHiRes();
+        const Result result = instance.optimizeFromStems (stems, preset);
+        const double elapsed = Time::getMillisecondCounterHiRes() - start;
+        if (result.failed())
+            ConsoleApplication::fail (result.getErrorMessage());
+
+        const String json = JSON::toString (preset, false, 2);
+        if (args.containsOption ("--output"))
+        {
+            const File output = args.getFileForOption ("--output");
+            if (! output.replaceWithText (json))
+                ConsoleApplication::fail ("could not write " + output.getFullPathName());
+        }
+        else
+        {
+            std::cout << json << std::endl;
+        }
+
+        // on stderr, so a printed preset can be redirected to a file
+        std::cerr << stems.size() << " stems, " << String (stemSeconds, 1) << " s of audio in "
+                  << String (elapsed / 1000.0, 2) << " s" << std::endl;
+        checkBudget (args, "optimizing the patterns", elapsed);
+    }
+   #endif
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    ConsoleApplication app;
+    app.addHelpCommand ("--help|-h", "PolarDesigner benchmarks", true);
+    app.addCommand ({ "open", "open [--instances=32] [--budget=ms]",
+                      "Time until every instance runs its restored filter bank",
+                      "Opens 1, 2, 4... instances from a session state and processes silence until all of them have crossfaded "
+                      "to their restored filter bank. Prints the most convolution loader threads running meanwhile and "
+                      "their wake-ups. The budget applies to each instance count.",
+                      runOpenBenchmark });
+    app.addCommand ({ "instantiate", "instantiate [--iterations=100] [--budget=ms]",
+                      "Constructor and destructor times of an instance",
+                      "Constructs and destroys instances while a first one keeps the shared resources alive. "
+                      "The budget applies to the median constructor time.",
+                      runInstantiateBenchmark });
+    app.addCommand ({ "state", "state [--iterations=100] [--scenes=0] [--budget=ms]",
+                      "Save and restore times of an instance",
+                      "Saves and restores the state of a prepared instance with the given number of stored scenes. "
+                      "The budget applies to the sum of the median save and restore times.",
+                      runStateBenchmark });
+    app.addCommand ({ "paint", "paint [--iterations=100] [--budget=ms]",
+                      "Frame and paint times of scripted editor interactions, without a window",
+                      "Renders the editor into images at three sizes and two display scales while replaying frames without "
+                      "changes, crossover drags, band count changes and the tracking overlay animation. The budget applies "
+                      "to the median frame time without changes at the default size and scale 1.",
+                      runPaintBenchmark });
+   #if AA_HAS_OFFLINE_OPTIMIZER
+    app.addCommand ({ "optimize", "optimize --signal=file[,back] --disturber=file[,back] [--preset=file] [--output=file] [--budget=ms]",
+                      "Terminator patterns from recorded stems, written as a preset",
+                      "Computes the patterns that maximize the ratio of signal to disturber stems, or with stems of one kind "
+                      "only, the patterns maximize target or terminate spill would find. A stem is a stereo file or a front "
+                      "and a back capsule file, both options can be repeated. All other settings, including the equalization "
+                      "and proximity compensation the stems are filtered with, are taken from --preset. Prints the preset "
+                      "unless --output is given. The budget applies to the time the optimization takes.",
+                      runOptimizeCommand });
+   #endif
+
+    return app.findAndRunCommand (argc, argv);
+}
@@ -0,0 +1,50 @@
+#!/bin/bash
+# Runs a benchmark command against two versions of the plugin, e.g.
+#   PROJUCER=~/JUCE/Projucer Benchmarks/compare.sh fb1b595 HEAD state --iterations=200
+# Both versions are checked out next to this repository, so they find JUCE in ../JUCE like it does,
+# and built from this repository's Benchmarks folder with the Linux Makefile exporter.
+
+set -e
+
+if [ $# -lt 3 ] || [ -z "$PROJUCER" ]; then
+    echo "usage: PROJUCER=<path to Projucer> $0 <before> <after> <command> [options]" >&2
+    exit 1
+fi
+
+before=$1
+after=$2
+shift 2
+
+repo=$(cd "$(dirname "$0")/.." && pwd)
+
+build()
+{
+    local rev=$(git -C "$repo" rev-parse --short "$1")
+    local tree="$repo/../PolarDesigner-$rev"
+
+    if [ -d "$tree" ]; then
+        git -C "$tree" checkout --quiet --force --detach "$rev"
+    else
+        git -C "$repo" worktree add --quiet --detach "$tree" "$rev"
+    fi
+
+    # the benchmarks of this repository, the builds of earlier runs are kept
+    mkdir -p "$tree/Benchmarks"
+    rm -rf "$tree/Benchmarks/Source"
+    cp -R "$repo/Benchmarks/Source" "$repo/Benchmarks/PolarDesignerBenchmarks.jucer" "$tree/Benchmarks/"
+
+    "$PROJUCER" --resave "$tree/PolarDesigner.jucer" >&2
+    "$PROJUCER" --resave "$tree/Benchmarks/PolarDesignerBenchmarks.jucer" >&2
+    make -C "$tree/Benchmarks/Builds/LinuxMakefile" CONFIG=Release -j"$(nproc)" >&2
+
+    echo "$tree/Benchmarks/Builds/LinuxMakefile/build/PolarDesignerBenchmarks"
+}
+
+beforeBinary=$(build "$before")
+afterBinary=$(build "$after")
+
+# both run even if the first exceeds a budget, the return code is the one of the second
+echo "== $before"
+"$beforeBinary" "$@" || true
+echo "== $after"
+"$afterBinary" "$@"
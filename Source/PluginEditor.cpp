@@ -31,7 +31,8 @@ PolarDesignerAudioProcessorEditor::PolarDesignerAudioProcessorEditor (PolarDesig
 : AudioProcessorEditor (&p), loadingFile(false), processor (p), valueTreeState(vts),
 directivityEqualiser (p), alOverlayError(AlertOverlay::Type::errorMessage),
 alOverlayDisturber(AlertOverlay::Type::disturberTracking),
-alOverlaySignal(AlertOverlay::Type::signalTracking)
+alOverlaySignal(AlertOverlay::Type::signalTracking),
+presetBrowser(p.getPresetLibrary())
 {
     //    openGLContext.attachTo (*getTopLevelComponent());
     
@@ -56,6 +57,12 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
     alOverlayError.setColour(AlertWindow::backgroundColourId, globalLaF.AAGrey);
     alOverlayError.setColour(TextButton::buttonColourId, globalLaF.AARed);
     
+    addChildComponent (&presetBrowser);
+    presetBrowser.setColour(AlertWindow::backgroundColourId, globalLaF.AAGrey);
+    presetBrowser.setColour(TextButton::buttonColourId, globalLaF.AARed);
+    
+    addChildComponent (&heatmapDisplay);
+    
     addAndMakeVisible (&alOverlayDisturber);
     alOverlayDisturber.setVisible(false);
     alOverlayDisturber.setColour(AlertWindow::backgroundColourId, globalLaF.AAGrey);
@@ -95,6 +102,14 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
     grpSync.setText ("sync-channel");
     grpSync.setTextLabelPosition (Justification::centredLeft);
     
+    addAndMakeVisible (&grpScene);
+    grpScene.setText ("scenes");
+    grpScene.setTextLabelPosition (Justification::centredLeft);
+    
+    addAndMakeVisible (&grpMorph);
+    grpMorph.setText ("a/b morph");
+    grpMorph.setTextLabelPosition (Justification::centredLeft);
+    
     eqColours[0] = Colour(0xFDBA4949);
     eqColours[1] = Colour(0xFDBA6F49);
     eqColours[2] = Colour(0xFDBAAF49);
@@ -166,6 +181,16 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
     tbSaveFile.setButtonText ("save preset");
     tbSaveFile.addListener (this);
     
+    addAndMakeVisible (&tbBrowsePresets);
+    tbBrowsePresets.setButtonText ("browse presets");
+    tbBrowsePresets.addListener (this);
+    
+    addAndMakeVisible (&tbHeatmap);
+    tbHeatmap.setButtonText ("directivity heatmap");
+    tbHeatmap.setTooltip ("shows the output level over frequency and angle of incidence in place of the equalizer");
+    tbHeatmap.setClickingTogglesState (true);
+    tbHeatmap.addListener (this);
+    
     addAndMakeVisible (&tbRecordDisturber);
     tbRecordDisturber.setButtonText ("terminate spill");
     tbRecordDisturber.addListener (this);
@@ -179,6 +204,13 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
     tbAllowBackwardsPattern.setButtonText ("allow reverse patterns");
     tbAllowBackwardsPattern.addListener (this);
     
+    addAndMakeVisible (&tbAdaptive);
+    tbAdaptive.setButtonText ("adaptive terminator");
+    tbAdaptive.setToggleState (processor.adaptiveModeActive(), dontSendNotification);
+    tbAdaptive.setTooltip ("follows the spill continuously, or the target-to-spill ratio once a target is recorded. "
+                           "Range and speed of the adaptation are host automation parameters");
+    tbAdaptive.addListener (this);
+    
     addAndMakeVisible (&tbEq[0]);
     tbEq[0].addListener (this);
     tbEq[0].setButtonText ("off");
@@ -264,6 +296,18 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
     cbSyncChannel.addListener (this);
 #endif
     
+    addAndMakeVisible (&cbScene);
+    cbScene.addItemList (juce::StringArray ({"off","scene 1","scene 2","scene 3","scene 4",
+        "scene 5","scene 6","scene 7","scene 8"}), 1);
+    cbSceneAtt = std::unique_ptr<ComboBoxAttachment>(new ComboBoxAttachment (valueTreeState, "scene", cbScene));
+    cbScene.setEditableText (false);
+    cbScene.setJustificationType (Justification::centred);
+    
+    addAndMakeVisible (&tbStoreScene);
+    tbStoreScene.setButtonText ("store scene");
+    tbStoreScene.setTooltip ("stores the current settings in the selected scene, its filter bank is prepared so the scene can be recalled without a gap");
+    tbStoreScene.addListener (this);
+    
     // TODO: Replace cbSyncChannel with this:
     for (int i = 0; i < 5; ++i)
     {
@@ -307,6 +351,13 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
     slProximity.setTextBoxStyle (Slider::TextBoxRight, false, 45, 15);
     slProximity.addListener (this);
     
+    addAndMakeVisible (&slMorph);
+    slMorphAtt = std::unique_ptr<SliderAttachment>(new SliderAttachment (valueTreeState, "morph", slMorph));
+    slMorph.setSliderStyle (Slider::LinearHorizontal);
+    slMorph.setColour (Slider::thumbColourId, globalLaF.AARed);
+    slMorph.setTextBoxStyle (Slider::TextBoxRight, false, 45, 15);
+    slMorph.setTooltip ("blends from the active layer towards the other one");
+    
     addAndMakeVisible (&tbZeroDelay);
     tbZeroDelayAtt = std::unique_ptr<ButtonAttachment>(new ButtonAttachment (valueTreeState, "zeroDelayMode", tbZeroDelay));
     tbZeroDelay.addListener (this);
@@ -331,6 +382,10 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
     alOverlaySignal.setOnCancelCallback ([this]() { onAlOverlayCancelRecord(); });
     alOverlaySignal.setOnRatioCallback ([this]() { onAlOverlayMaxSigToDist(); });
     
+    presetBrowser.setOnLoadCallback ([this](const var& preset) { applyLibraryPreset (preset); });
+    presetBrowser.setOnRescanCallback ([this]() { processor.scanPresetLibrary (true); });
+    presetBrowser.setOnCloseCallback ([this]() { presetBrowser.setVisible (false); });
+    
     nActiveBandsChanged();
     
     trimSlider.sliderIncremented = [this] { incrementTrim(nActiveBands); };
@@ -344,10 +399,15 @@ alOverlaySignal(AlertOverlay::Type::signalTracking)
     trimSlider.sliderIncremented = [this] { incrementTrim(this->nActiveBands); };
     trimSlider.sliderDecremented = [this] { decrementTrim(this->nActiveBands); };
 
-    startTimer (30);
-    
     setEqMode();
     
+    processor.getEditorNotifier().addChangeListener (this);
+    startDisplayUpdates();
+    
+#ifdef AA_DO_PAINT_TIMING
+    addAndMakeVisible (&frameTimeOverlay);
+#endif
+    
     
 }
 
@@ -374,6 +434,10 @@ PolarDesignerAudioProcessorEditor::~PolarDesignerAudioProcessorEditor()
     if (alOverlaySignal.isVisible())
         onAlOverlayCancelRecord();
     
+    processor.getEditorNotifier().removeChangeListener (this);
+    displayUpdates.reset();
+    processor.setMeteringEnabled (false);
+    processor.getSpectrumAnalyzer().setEnabled (false);
     setLookAndFeel (nullptr);
     
 }
@@ -381,6 +445,10 @@ PolarDesignerAudioProcessorEditor::~PolarDesignerAudioProcessorEditor()
 //==============================================================================
 void PolarDesignerAudioProcessorEditor::paint (Graphics& g)
 {
+    AA_PAINT_TIMER ("editor");
+#ifdef AA_DO_PAINT_TIMING
+    paintTimings->addFrame();
+#endif
     g.fillAll (globalLaF.ClBackground);
     
 #ifdef AA_DO_DEBUG_PATH
@@ -440,10 +508,12 @@ void PolarDesignerAudioProcessorEditor::resized()
     sideComponent.items.add(juce::FlexItem().withFlex(marginFlex));
     sideComponent.items.add(juce::FlexItem(grpBands).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(cbSetNrBands).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(tbHeatmap).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem().withFlex(marginFlex));
     sideComponent.items.add(juce::FlexItem(grpPreset).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(tbLoadFile).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(tbSaveFile).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(tbBrowsePresets).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem().withFlex(marginFlex));
     sideComponent.items.add(juce::FlexItem(grpEq).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(tbEq[0]).withFlex(sideComponentItemFlex));
@@ -457,10 +527,18 @@ void PolarDesignerAudioProcessorEditor::resized()
     sideComponent.items.add(juce::FlexItem(tbAllowBackwardsPattern).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(tbRecordDisturber).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(tbRecordSignal).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(tbAdaptive).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem().withFlex(marginFlex));
     sideComponent.items.add(juce::FlexItem(grpSync).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem(cbSyncChannel).withFlex(sideComponentItemFlex));
     sideComponent.items.add(juce::FlexItem().withFlex(marginFlex));
+    sideComponent.items.add(juce::FlexItem(grpScene).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(cbScene).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(tbStoreScene).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem().withFlex(marginFlex));
+    sideComponent.items.add(juce::FlexItem(grpMorph).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem(slMorph).withFlex(sideComponentItemFlex));
+    sideComponent.items.add(juce::FlexItem().withFlex(marginFlex));
 
     // Margins are fixed value because DirectivityEQ component has fixed margins
     const float polarVisualizersComponentLeftMargin = 33;
@@ -596,6 +674,13 @@ void PolarDesignerAudioProcessorEditor::resized()
     fb.items.add(juce::FlexItem(footer).withFlex(marginFlex*5));
 
     fb.performLayout(area);
+    
+    presetBrowser.setBounds (directivityEqualiser.getBounds().reduced (60, 10));
+    heatmapDisplay.setBounds (directivityEqualiser.getBounds());
+    
+#ifdef AA_DO_PAINT_TIMING
+    frameTimeOverlay.setBounds (getWidth() - 260, 0, 260, 18);
+#endif
 
     /*
     alOverlayError.setBounds (directivityEqualiser.getX() + 120, directivityEqualiser.getY() + 50, directivityEqualiser.getWidth() - 240, directivityEqualiser.getHeight() - 100);
@@ -663,6 +748,24 @@ void PolarDesignerAudioProcessorEditor::buttonClicked (Button* button)
     {
         saveFile();
     }
+    else if (button == &tbBrowsePresets)
+    {
+        processor.scanPresetLibrary (false);
+        presetBrowser.setVisible (!presetBrowser.isVisible());
+    }
+    else if (button == &tbHeatmap)
+    {
+        heatmapDisplay.setVisible (tbHeatmap.getToggleState());
+        if (heatmapDisplay.isVisible())
+            heatmapDisplay.setSettings (processor.getHeatmapSettings());
+    }
+    else if (button == &tbStoreScene)
+    {
+        // "off" is the first item
+        const int scene = cbScene.getSelectedItemIndex();
+        if (scene > 0)
+            processor.storeScene (scene);
+    }
     else if (button == &tbEq[0])
     {
         processor.setEqState(0);
@@ -695,6 +798,13 @@ void PolarDesignerAudioProcessorEditor::buttonClicked (Button* button)
     {
         return;
     }
+    else if (button == &tbAdaptive)
+    {
+        // the processor minimizes spill until a target is recorded, a later recording is picked up as well
+        const int mode = tbAdaptive.getToggleState() ? 2 : 0;
+        auto* param = valueTreeState.getParameter ("adaptiveMode");
+        param->setValueNotifyingHost (param->convertTo0to1 (mode));
+    }
     else if (button == &tbZeroDelay)
     {
         bool isToggled = button->getToggleState();
@@ -851,6 +961,26 @@ void PolarDesignerAudioProcessorEditor::loadFile()
     }
 }
 
+void PolarDesignerAudioProcessorEditor::applyLibraryPreset (const var& preset)
+{
+    loadingFile = true;
+    Result result = processor.applyPreset (preset);
+    if (!result.wasOk()) {
+        presetBrowser.setVisible(false);
+        errorMessage = result.getErrorMessage();
+        alOverlayError.setTitle("preset load error!");
+        alOverlayError.setMessage(errorMessage);
+        alOverlayError.setVisible(true);
+        disableMainArea();
+        setSideAreaEnabled(false);
+    }
+    else
+    {
+        setEqMode();
+    }
+    loadingFile = false;
+}
+
 void PolarDesignerAudioProcessorEditor::saveFile()
 {
     FileChooser myChooser ("Save Preset File",
@@ -928,28 +1058,109 @@ void PolarDesignerAudioProcessorEditor::nActiveBandsChanged()
     
 }
 
-void PolarDesignerAudioProcessorEditor::timerCallback()
+void PolarDesignerAudioProcessorEditor::changeListenerCallback (ChangeBroadcaster*)
+{
+    startDisplayUpdates();
+}
+
+// detaching from the display is deferred to here, as the attachment must not be deleted from its own callback
+void PolarDesignerAudioProcessorEditor::handleAsyncUpdate()
 {
-    if (processor.repaintDEQ.get())
+    if (displayUpdates != nullptr && Time::getMillisecondCounter() - lastDisplayUpdate >= displayIdleTimeout)
     {
-        processor.repaintDEQ = false;
-        directivityEqualiser.repaint();
+        displayUpdates.reset();
+        // updateDisplay() enables it again, the meters stay on to wake the editor
+        processor.getSpectrumAnalyzer().setEnabled (false);
+        processor.requestLiveDataNotification();
     }
-    if (processor.didNRActiveBandsChange.get())
-    {
-        processor.didNRActiveBandsChange = false;
+}
+
+// shown again after display updates went idle while hidden, later changes arrive as change messages
+void PolarDesignerAudioProcessorEditor::visibilityChanged()
+{
+    if (isShowing())
+        startDisplayUpdates();
+}
+
+void PolarDesignerAudioProcessorEditor::parentHierarchyChanged()
+{
+    if (isShowing())
+        startDisplayUpdates();
+}
+
+void PolarDesignerAudioProcessorEditor::startDisplayUpdates()
+{
+    lastDisplayUpdate = Time::getMillisecondCounter();
+    if (displayUpdates == nullptr)
+        displayUpdates = std::make_unique<VBlankAttachment> (this, [this]() { updateDisplay(); });
+}
+
+void PolarDesignerAudioProcessorEditor::updateDisplay()
+{
+    const int changes = processor.getEditorChanges();
+    bool updated = changes != 0;
+    
+    if (changes & PolarDesignerAudioProcessor::editorRepaintDEQ)
+        directivityEqualiser.repaintPlot();
+    if (changes & PolarDesignerAudioProcessor::editorNrBandsChanged)
         nActiveBandsChanged();
-    }
-    if (processor.zeroDelayModeChanged.get())
-    {
-        processor.zeroDelayModeChanged = false;
+    if (changes & PolarDesignerAudioProcessor::editorZeroDelayModeChanged)
         zeroDelayModeChange();
+    if (changes & PolarDesignerAudioProcessor::editorEqModeChanged)
+        setEqMode();
+    // the renderer skips settings it already has, adaptive patterns change without a parameter
+    if (heatmapDisplay.isVisible() && (changes != 0 || adaptiveDisplayActive))
+        heatmapDisplay.setSettings (processor.getHeatmapSettings());
+    if (processor.adaptiveModeActive() || adaptiveDisplayActive)
+        updateAdaptiveDisplay();
+    if (processor.getDirectivityAnalyzer().hasNewResults())
+    {
+        directivityEqualiser.updateAnalysis();
+        updated = true;
     }
-    if (processor.ffDfEqChanged.get())
+    
+    // meters and spectra cost nothing while the editor is hidden
+    const bool showing = isShowing();
+    processor.setMeteringEnabled (showing);
+    processor.getSpectrumAnalyzer().setEnabled (showing);
+    if (showing && processor.getLevelSnapshots().update())
     {
-        processor.ffDfEqChanged = false;
-        setEqMode();
+        updateMeters();
+        updated = updated || !processor.getLevelSnapshots().getReadBuffer().isSilent();
     }
+    if (showing && processor.getSpectrumAnalyzer().getSpectra().update())
+        directivityEqualiser.repaintPlot();
+    
+    // silence keeps the display attached until the meters have fallen
+    const uint32 now = Time::getMillisecondCounter();
+    if (updated)
+        lastDisplayUpdate = now;
+    else if (now - lastDisplayUpdate >= displayIdleTimeout)
+        triggerAsyncUpdate();
+    
+#ifdef AA_DO_PAINT_TIMING
+    frameTimeOverlay.update();
+#endif
+}
+
+void PolarDesignerAudioProcessorEditor::updateMeters()
+{
+    const LevelSnapshot& levels = processor.getLevelSnapshots().getReadBuffer();
+    for (int i = 0; i < 5; i++)
+        polarPatternVisualizers[i].setLevels (levels.bands[i]);
+    directivityEqualiser.setLevels (levels);
+}
+
+void PolarDesignerAudioProcessorEditor::updateAdaptiveDisplay()
+{
+    adaptiveDisplayActive = processor.adaptiveModeActive();
+    tbAdaptive.setToggleState (adaptiveDisplayActive, NotificationType::dontSendNotification);
+    
+    // show the adapted patterns, fall back to the slider values when switched off
+    for (int i = 0; i < 5; i++)
+        polarPatternVisualizers[i].setDirWeight (adaptiveDisplayActive ? processor.getAdaptiveDirFactor (i) : slDir[i].getValue());
+    
+    directivityEqualiser.repaintPlot();
 }
 
 void PolarDesignerAudioProcessorEditor::zeroDelayModeChange()
@@ -1048,13 +1259,18 @@ void PolarDesignerAudioProcessorEditor::setSideAreaEnabled(bool set)
     //    cbSyncChannel.setEnabled(set);
     tbLoadFile.setEnabled(set);
     tbSaveFile.setEnabled(set);
+    tbBrowsePresets.setEnabled(set);
+    cbScene.setEnabled(set);
+    tbStoreScene.setEnabled(set);
     tbEq[0].setEnabled(set);
     tbEq[1].setEnabled(set);
     tbEq[2].setEnabled(set);
     tbAllowBackwardsPattern.setEnabled(set);
     tbRecordDisturber.setEnabled(set);
     tbRecordSignal.setEnabled(set);
+    tbAdaptive.setEnabled(set);
     slProximity.setEnabled(set);
+    slMorph.setEnabled(set);
 }
 
 void PolarDesignerAudioProcessorEditor::setEqMode()
@@ -24,6 +24,7 @@
 #pragma once
 
 //#define AA_DO_DEBUG_PATH
+//#define AA_DO_PAINT_TIMING // frame time overlay and paint timers, see PaintTimings.h
 
 
 #include "../JuceLibraryCode/JuceHeader.h"
@@ -37,7 +38,10 @@
 #include "../resources/customComponents/PolarPatternVisualizer.h"
 #include "../resources/customComponents/DirectivityEQ.h"
 #include "../resources/customComponents/AlertOverlay.h"
+#include "../resources/customComponents/PresetBrowser.h"
+#include "../resources/customComponents/DirectivityHeatmapDisplay.h"
 #include "../resources/customComponents/EndlessSlider.h"
+#include "../resources/customComponents/PaintTimings.h"
 
 typedef AudioProcessorValueTreeState::SliderAttachment SliderAttachment;
 typedef AudioProcessorValueTreeState::ButtonAttachment ButtonAttachment;
@@ -48,7 +52,8 @@ typedef AudioProcessorValueTreeState::ButtonAttachment ButtonAttachment;
 /**
 */
 class PolarDesignerAudioProcessorEditor  : public AudioProcessorEditor, private Button::Listener,
-                                     private ComboBox::Listener, private Slider::Listener, private Timer
+                                     private ComboBox::Listener, private Slider::Listener,
+                                     private ChangeListener, private AsyncUpdater
 {
 public:
     PolarDesignerAudioProcessorEditor (PolarDesignerAudioProcessor&, AudioProcessorValueTreeState&);
@@ -57,6 +62,11 @@ public:
     //==============================================================================
     void paint (Graphics&) override;
     void resized() override;
+    void visibilityChanged() override;
+    void parentHierarchyChanged() override;
+    // applies the processor's changes and live data, once per display frame while attached, the
+    // paint benchmark calls it for every frame it renders without a display
+    void updateDisplay();
     
     void buttonStateChanged(Button* button) override;
     void buttonClicked (Button* button) override;
@@ -107,9 +117,10 @@ private:
     TooltipWindow tooltipWindow;
 
     // Groups
-    GroupComponent grpEq, grpPreset, grpDstC, grpProxComp, grpBands, grpSync;
+    GroupComponent grpEq, grpPreset, grpDstC, grpProxComp, grpBands, grpSync, grpScene, grpMorph;
     // Sliders
     ReverseSlider slBandGain[5], slCrossoverPosition[4], slProximity;
+    Slider slMorph;
     DirSlider slDir[5];
     
     // a slider to use to 'trim' the EQ's
@@ -118,25 +129,27 @@ private:
     // Solo Buttons
     MuteSoloButton msbSolo[5], msbMute[5];
     // Text Buttons
-    TextButton tbLoadFile, tbSaveFile, tbRecordDisturber, tbRecordSignal, tbZeroDelay, tbAbButton[2];
+    TextButton tbLoadFile, tbSaveFile, tbBrowsePresets, tbHeatmap, tbStoreScene, tbRecordDisturber, tbRecordSignal, tbZeroDelay, tbAbButton[2];
     // ToggleButtons
-    ToggleButton tbEq[3], tbAllowBackwardsPattern;
+    ToggleButton tbEq[3], tbAllowBackwardsPattern, tbAdaptive;
     // Combox Boxes
-    ComboBox cbSetNrBands, cbSyncChannel;
+    ComboBox cbSetNrBands, cbSyncChannel, cbScene;
     TextButton tbSetNrBands[5];
     TextButton tbSyncChannel[5];
             
     // Pointers for value tree state
     std::unique_ptr<ReverseSlider::SliderAttachment> slBandGainAtt[5], slCrossoverAtt[4], slProximityAtt;
-    std::unique_ptr<SliderAttachment> slDirAtt[5];
+    std::unique_ptr<SliderAttachment> slDirAtt[5], slMorphAtt;
     std::unique_ptr<ButtonAttachment> msbSoloAtt[5], msbMuteAtt[5], tbAllowBackwardsPatternAtt, tbZeroDelayAtt;
-    std::unique_ptr<ComboBoxAttachment> cbSetNrBandsAtt, cbSyncChannelAtt;
+    std::unique_ptr<ComboBoxAttachment> cbSetNrBandsAtt, cbSyncChannelAtt, cbSceneAtt;
     
     DirectivityEQ directivityEqualiser;
     PolarPatternVisualizer polarPatternVisualizers[5];
     AlertOverlay alOverlayError;
     AlertOverlay alOverlayDisturber;
     AlertOverlay alOverlaySignal;
+    PresetBrowser presetBrowser;
+    DirectivityHeatmapDisplay heatmapDisplay;
 
     Path sideBorderPath;
     
@@ -148,12 +161,29 @@ private:
     void nActiveBandsChanged();
     void loadFile();
     void saveFile();
-    void timerCallback() override;
+    void applyLibraryPreset (const var& preset);
+    void changeListenerCallback (ChangeBroadcaster* source) override;
+    void handleAsyncUpdate() override;
     bool getSoloActive();
     void disableMainArea();
     void setSideAreaEnabled(bool set);
     void disableOverlay();
     void zeroDelayModeChange();
+    void updateAdaptiveDisplay();
+    void updateMeters();
+    void startDisplayUpdates();
+    
+    bool adaptiveDisplayActive = false;
+    
+    // attached while the processor has something to show, detached after displayIdleTimeout without updates
+    static constexpr uint32 displayIdleTimeout = 2000;
+    std::unique_ptr<VBlankAttachment> displayUpdates;
+    uint32 lastDisplayUpdate = 0;
+    
+#ifdef AA_DO_PAINT_TIMING
+    SharedResourcePointer<PaintTimings> paintTimings;
+    FrameTimeOverlay frameTimeOverlay;
+#endif
     
     OpenGLContext openGLContext;
     
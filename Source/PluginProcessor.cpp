@@ -117,36 +117,51 @@ vtsParams(*this, nullptr, "AAPolarDesigner",
     std::make_unique<AudioParameterBool>  (ParameterID {"zeroDelayMode", 1}, "Zero Latency", false, "",
                                            [](bool value, int maximumStringLength) {return (value) ? "on" : "off";}, nullptr),
     std::make_unique<AudioParameterInt>   (ParameterID {"syncChannel", 1}, "Sync to Channel", 0, 4, 0, "",
-                                           [](int value, int maximumStringLength) {return value == 0 ? "none" : String(value);}, nullptr)
+                                           [](int value, int maximumStringLength) {return value == 0 ? "none" : String(value);}, nullptr),
+    std::make_unique<AudioParameterInt>   (ParameterID {"adaptiveMode", 1}, "Adaptive Terminator", 0, 2, 0, "",
+                                           [](int value, int maximumStringLength) {return value == 0 ? "off" : (value == 1 ? "min spill" : "max target-to-spill");}, nullptr),
+    // range and time of the adaptive terminator have no editor control, they are set by host automation
+    std::make_unique<AudioParameterFloat> (ParameterID {"adaptiveRange", 1}, "Adaptive Range", NormalisableRange<float>(0.0f, 1.5f, 0.01f),
+                                           0.5f, "", AudioProcessorParameter::genericParameter,
+                                           [](float value, int maximumStringLength) { return String(value, 2); }, nullptr),
+    std::make_unique<AudioParameterFloat> (ParameterID {"adaptiveTime", 1}, "Adaptive Time", NormalisableRange<float>(0.05f, 5.0f, 0.01f, 0.5f),
+                                           1.0f, "s", AudioProcessorParameter::genericParameter,
+                                           [](float value, int maximumStringLength) { return String(value, 2); }, nullptr),
+    std::make_unique<AudioParameterInt>   (ParameterID {"filterQuality", 1}, "Filter Bank Quality", 0, FilterBankDesign::nQualities - 1, FilterBankDesign::defaultQuality, "",
+                                           [](int value, int maximumStringLength) {return String(FilterBankDesign::irLengthsAtNativeSampleRate[value]) + " taps";}, nullptr),
+    std::make_unique<AudioParameterInt>   (ParameterID {"scene", 1}, "Scene", 0, N_SCENES, 0, "",
+                                           [](int value, int maximumStringLength) {return value == 0 ? "off" : String(value);}, nullptr),
+    std::make_unique<AudioParameterFloat> (ParameterID {"morph", 1}, "A/B Morph", NormalisableRange<float>(0.0f, 1.0f, 0.001f),
+                                           0.0f, "", AudioProcessorParameter::genericParameter,
+                                           [](float value, int maximumStringLength) { return String(value, 2); }, nullptr)
 }),
-firLen(FILTER_BANK_IR_LENGTH_AT_NATIVE_SAMPLE_RATE),
-dfEqOmniBuffer(1, DF_EQ_LEN), dfEqEightBuffer(1, DF_EQ_LEN),
-ffEqOmniBuffer(1, FF_EQ_LEN), ffEqEightBuffer(1, FF_EQ_LEN), isBypassed(false),
+firLen(FilterBankDesign::getFirLength(FilterBankDesign::nativeSampleRate)),
+dfEqOmniConv(dsp::Convolution::Latency {0}, convolutionLoader->getQueue()), dfEqEightConv(dsp::Convolution::Latency {0}, convolutionLoader->getQueue()),
+ffEqOmniConv(dsp::Convolution::Latency {0}, convolutionLoader->getQueue()), ffEqEightConv(dsp::Convolution::Latency {0}, convolutionLoader->getQueue()),
+morphEqOmniConv(dsp::Convolution::Latency {0}, convolutionLoader->getQueue()), morphEqEightConv(dsp::Convolution::Latency {0}, convolutionLoader->getQueue()),
+isBypassed(false),
 soloActive(false), loadingFile(false), readingSharedParams(false), trackingActive(false),
-trackingDisturber(false), disturberRecorded(false), signalRecorded(false), currentSampleRate(48000)
+trackingDisturber(false), disturberRecorded(false), signalRecorded(false), adaptiveWasActive(false), currentSampleRate(48000)
 {
     
-    vtsParams.addParameterListener("xOverF1", this);
-    vtsParams.addParameterListener("xOverF2", this);
-    vtsParams.addParameterListener("xOverF3", this);
-    vtsParams.addParameterListener("xOverF4", this);
-    xOverFreqs[0] = vtsParams.getRawParameterValue("xOverF1");
-    xOverFreqs[1] = vtsParams.getRawParameterValue("xOverF2");
-    xOverFreqs[2] = vtsParams.getRawParameterValue("xOverF3");
-    xOverFreqs[3] = vtsParams.getRawParameterValue("xOverF4");
+    for (int i = 0; i < 4; ++i)
+    {
+        vtsParams.addParameterListener(XOVER_IDS[i], this);
+        xOverFreqs[i] = vtsParams.getRawParameterValue(XOVER_IDS[i]);
+    }
     for (int i = 0; i < 5; ++i)
     {
-        vtsParams.addParameterListener("alpha"+String(i+1), this);
-        dirFactors[i] = vtsParams.getRawParameterValue("alpha"+String(i+1));
+        vtsParams.addParameterListener(ALPHA_IDS[i], this);
+        dirFactors[i] = vtsParams.getRawParameterValue(ALPHA_IDS[i]);
         
-        vtsParams.addParameterListener("solo"+String(i+1), this);
-        soloBand[i] = vtsParams.getRawParameterValue("solo"+String(i+1));
+        vtsParams.addParameterListener(SOLO_IDS[i], this);
+        soloBand[i] = vtsParams.getRawParameterValue(SOLO_IDS[i]);
         
-        vtsParams.addParameterListener("mute"+String(i+1), this);
-        muteBand[i] = vtsParams.getRawParameterValue("mute"+String(i+1));
+        vtsParams.addParameterListener(MUTE_IDS[i], this);
+        muteBand[i] = vtsParams.getRawParameterValue(MUTE_IDS[i]);
         
-        vtsParams.addParameterListener("gain"+String(i+1), this);
-        bandGains[i] = vtsParams.getRawParameterValue("gain"+String(i+1));
+        vtsParams.addParameterListener(GAIN_IDS[i], this);
+        bandGains[i] = vtsParams.getRawParameterValue(GAIN_IDS[i]);
     }
     vtsParams.addParameterListener("nrBands", this);
     nBandsPtr = vtsParams.getRawParameterValue("nrBands");
@@ -158,32 +173,40 @@ trackingDisturber(false), disturberRecorded(false), signalRecorded(false), curre
     zeroDelayMode = vtsParams.getRawParameterValue("zeroDelayMode");
     vtsParams.addParameterListener("syncChannel", this);
     syncChannelPtr = vtsParams.getRawParameterValue("syncChannel");
-    
-    // properties file: saves user preset folder location
-    PropertiesFile::Options options;
-    options.applicationName     = "PolarDesigner";
-    options.filenameSuffix      = "settings";
-    options.folderName          = "AustrianAudio";
-    options.osxLibrarySubFolder = "Preferences";
-    
-    properties = std::unique_ptr<PropertiesFile>(new PropertiesFile (options));
-    lastDir = File(properties->getValue ("presetFolder"));
-    
-    dfEqOmniBuffer.copyFrom(0, 0, DFEQ_COEFFS_OMNI, DF_EQ_LEN);
-    dfEqEightBuffer.copyFrom(0, 0, DFEQ_COEFFS_EIGHT, DF_EQ_LEN);
-    ffEqOmniBuffer.copyFrom(0, 0, FFEQ_COEFFS_OMNI, FF_EQ_LEN);
-    ffEqEightBuffer.copyFrom(0, 0, FFEQ_COEFFS_EIGHT, FF_EQ_LEN);
+    vtsParams.addParameterListener("adaptiveMode", this);
+    adaptiveMode = vtsParams.getRawParameterValue("adaptiveMode");
+    adaptiveRange = vtsParams.getRawParameterValue("adaptiveRange");
+    adaptiveTime = vtsParams.getRawParameterValue("adaptiveTime");
+    vtsParams.addParameterListener("filterQuality", this);
+    filterQuality = vtsParams.getRawParameterValue("filterQuality");
+    vtsParams.addParameterListener("scene", this);
+    morphAmount = vtsParams.getRawParameterValue("morph");
+    for (int i = 0; i < N_STATE_PARAMS; ++i)
+        stateParams[i] = vtsParams.getRawParameterValue(STATE_PARAM_IDS[i]);
     
     updateLatency();
-    delay.setDelayTime (std::ceilf(static_cast<float>(FILTER_BANK_IR_LENGTH_AT_NATIVE_SAMPLE_RATE) / 2 - 1) / FILTER_BANK_NATIVE_SAMPLE_RATE);
     
     oldProxDistance = proxDistance->load();
     
-    startTimer(50);
+    for (int i = 0; i < N_SCENES; ++i)
+        sceneDesignJobs.add (new EngineDesignJob (*this))->scene = i;
+    morphDesignJob.scene = N_SCENES;
+    
+    directivityAnalyzer.setOnNewResultsCallback ([this]() { notifyEditor (editorLiveData); });
+    
+    // the timer is started once syncing is switched on or engine changes are pending
 }
 
 PolarDesignerAudioProcessor::~PolarDesignerAudioProcessor()
 {
+    designPool->pool.removeJob (&designJob, true, 10000);
+    for (auto* job : sceneDesignJobs)
+        designPool->pool.removeJob (job, true, 10000);
+    designPool->pool.removeJob (&morphDesignJob, true, 10000);
+    cancelPendingUpdate();
+    
+    for (auto* conv : { &dfEqOmniConv, &dfEqEightConv, &ffEqOmniConv, &ffEqEightConv, &morphEqOmniConv, &morphEqEightConv })
+        convolutionLoader->cancelLoads (*conv);
 }
 
 //==============================================================================
@@ -251,59 +274,58 @@ void PolarDesignerAudioProcessor::changeProgramName (int index, const String& ne
 //==============================================================================
 void PolarDesignerAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    if (sampleRate != currentSampleRate)
-    {
-        firLen = std::ceil(static_cast<float>(FILTER_BANK_IR_LENGTH_AT_NATIVE_SAMPLE_RATE) / FILTER_BANK_NATIVE_SAMPLE_RATE * sampleRate);
-        if (firLen % 2 == 0) // make sure firLen is odd
-            firLen++;
-        
-        updateLatency();
-    }
+    firLen = FilterBankDesign::getFirLength(sampleRate, getFilterQuality());
     
     currentBlockSize = samplesPerBlock;
     currentSampleRate = sampleRate;
     
     dsp::ProcessSpec delaySpec {currentSampleRate, static_cast<uint32>(currentBlockSize), 1};
-    delay.prepare (delaySpec);
-    delayBuffer.clear();
-    delayBuffer.setSize(1, currentBlockSize);
+    alignmentDelay.prepare (delaySpec);
     
     // filter bank
     filterBankBuffer.setSize(N_CH_IN * 5, currentBlockSize);
     filterBankBuffer.clear();
-    firFilterBuffer.setSize(5, firLen);
-    firFilterBuffer.clear();
+    spareBankBuffer.setSize(N_CH_IN * 5, currentBlockSize);
+    spareBankBuffer.clear();
+    spareOutputBuffer.setSize(1, currentBlockSize);
+    morphInputBuffer.setSize(2, currentBlockSize);
+    morphEqInputBuffer.setSize(2, currentBlockSize);
+    for (auto& bankBuffer : morphBankBuffers)
+    {
+        bankBuffer.setSize(N_CH_IN * 5, currentBlockSize);
+        bankBuffer.clear();
+    }
+    morphOutputBuffer.setSize(1, currentBlockSize);
+    morphFadeBuffer.setSize(1, currentBlockSize);
     omniEightBuffer.setSize(2, currentBlockSize);
     omniEightBuffer.clear();
     
-    computeAllFilterCoefficients();
-    initAllConvolvers();
-    for (auto &conv : convolvers)
-    {
-        conv.reset();
-    }
+    directivityAnalyzer.prepare (currentSampleRate);
+    spectrumAnalyzer.prepare (currentSampleRate);
+    spectrumInputBuffer.setSize (1, currentBlockSize);
+    
+    initEngines();
     
-    // diffuse field eq
+    // free field / diffuse field eq, the tables are loaded once an eq is selected
     dsp::ProcessSpec eqSpec {currentSampleRate, static_cast<uint32>(currentBlockSize), 1};
     dfEqOmniConv.prepare (eqSpec); // must be called before loading an ir
-    dfEqOmniConv.loadImpulseResponse(std::move(dfEqOmniBuffer), EQ_SAMPLE_RATE, dsp::Convolution::Stereo::no, dsp::Convolution::Trim::no, dsp::Convolution::Normalise::no);
-    
-    dsp::ProcessSpec eqSpec2{ currentSampleRate, static_cast<uint32>(currentBlockSize), 1 };
-    dfEqEightConv.prepare (eqSpec2);
-    dfEqOmniConv.loadImpulseResponse(std::move(dfEqEightBuffer), EQ_SAMPLE_RATE, dsp::Convolution::Stereo::no, dsp::Convolution::Trim::no, dsp::Convolution::Normalise::no);
-    
-    dsp::ProcessSpec eqSpec3{ currentSampleRate, static_cast<uint32>(currentBlockSize), 1 };
-    ffEqOmniConv.prepare (eqSpec3); // must be called before loading an ir
-    dfEqOmniConv.loadImpulseResponse(std::move(ffEqOmniBuffer), EQ_SAMPLE_RATE, dsp::Convolution::Stereo::no, dsp::Convolution::Trim::no, dsp::Convolution::Normalise::no);
-    
-    dsp::ProcessSpec eqSpec4{ currentSampleRate, static_cast<uint32>(currentBlockSize), 1 };
-    ffEqEightConv.prepare (eqSpec4);
-    dfEqOmniConv.loadImpulseResponse(std::move(dfEqEightBuffer), EQ_SAMPLE_RATE, dsp::Convolution::Stereo::no, dsp::Convolution::Trim::no, dsp::Convolution::Normalise::no);
+    dfEqEightConv.prepare (eqSpec);
+    ffEqOmniConv.prepare (eqSpec);
+    ffEqEightConv.prepare (eqSpec);
+    morphEqOmniConv.prepare (eqSpec);
+    morphEqEightConv.prepare (eqSpec);
+    dfEqLoaded = false;
+    ffEqLoaded = false;
+    morphEqLoaded = 0;
+    loadEqualizers();
+    startMorphDesign();
     
     dfEqOmniConv.reset();
     dfEqEightConv.reset();
     ffEqOmniConv.reset();
     ffEqEightConv.reset();
+    morphEqOmniConv.reset();
+    morphEqEightConv.reset();
     
     for (int i = 0; i < 5; ++i)
     {
@@ -351,20 +373,37 @@ void PolarDesignerAudioProcessor::processBlock (AudioBuffer<float>& buffer, Midi
         updateLatency();
     }
     
+    recallScene();
+    const bool morphing = takeMorphEngine();
+    
     int numSamples = buffer.getNumSamples();
     
     // create omni and eight signals
     createOmniAndEightSignals (buffer);
     
+    const bool analyseSpectrum = spectrumAnalyzer.isEnabled();
+    if (analyseSpectrum)
+        spectrumInputBuffer.copyFrom (0, 0, omniEightBuffer, 0, 0, numSamples);
+    
+    // while a new engine is pending, one of both engines might run in zero delay mode
+    const int state = engineState.get();
+    const FilterBankEngine& engine = engines[activeEngine.get()];
+    const bool filterBankActive = !engine.isZeroDelay() || (spareEngineRunning(state) && !engines[spareEngine.get()].isZeroDelay());
+    
+    // zero delay engines use the signals without proximity compensation and equalization
+    processEngines (omniEightBuffer, state, true, numSamples);
+    if (morphing)
+        processMorphEngines (true, numSamples);
+    
     // proximity compensation filter
-    if (zeroDelayMode->load() < 0.5f && proxDistance->load() < -0.05) // reduce proximity effect only on figure-of-eight
+    if (filterBankActive && proxDistance->load() < -0.05) // reduce proximity effect only on figure-of-eight
     {
         float* writePointerEight = omniEightBuffer.getWritePointer (1);
         dsp::AudioBlock<float> eightBlock(&writePointerEight, 1, numSamples);
         dsp::ProcessContextReplacing<float> contextProxEight(eightBlock);
         proxCompIIR.process(contextProxEight);
     }
-    else if (zeroDelayMode->load() < 0.5f && proxDistance->load() > 0.05) // apply proximity to omni
+    else if (filterBankActive && proxDistance->load() > 0.05) // apply proximity to omni
     {
         float* writePointerOmni = omniEightBuffer.getWritePointer (0);
         dsp::AudioBlock<float> omniBlock(&writePointerOmni, 1, numSamples);
@@ -372,7 +411,10 @@ void PolarDesignerAudioProcessor::processBlock (AudioBuffer<float>& buffer, Midi
         proxCompIIR.process(contextProxOmni);
     }
     
-    if (doEq == 1 && zeroDelayMode->load() < 0.5f )
+    if (morphing)
+        prepareMorphInput (numSamples);
+    
+    if (doEq == 1 && filterBankActive)
     {
         // free field equalization
         float* writePointerOmni = omniEightBuffer.getWritePointer (0);
@@ -385,7 +427,7 @@ void PolarDesignerAudioProcessor::processBlock (AudioBuffer<float>& buffer, Midi
         dsp::ProcessContextReplacing<float> ffEqEightCtx (ffEqEightBlk);
         ffEqEightConv.process(ffEqEightCtx);
     }
-    else if (doEq == 2 && zeroDelayMode->load() < 0.5f )
+    else if (doEq == 2 && filterBankActive)
     {
         // diffuse field equalization
         float* writePointerOmni = omniEightBuffer.getWritePointer (0);
@@ -399,50 +441,33 @@ void PolarDesignerAudioProcessor::processBlock (AudioBuffer<float>& buffer, Midi
         dfEqEightConv.process(dfEqEightCtx);
     }
     
-    int nActiveBands = nBands;
+    if (trackingActive)
+        directivityAnalyzer.pushSamples (omniEightBuffer.getReadPointer (0), omniEightBuffer.getReadPointer (1), numSamples);
     
-    // 1-band EQ
-    if (zeroDelayMode->load() > 0.5f )
-        nActiveBands = 1;
+    // filter bank or delayed 1-band
+    processEngines (omniEightBuffer, state, false, numSamples);
+    if (morphing)
+        processMorphEngines (false, numSamples);
     
-    for (int i = 0; i < nActiveBands; ++i)
-    {
-        // copy input buffer for each band
-        filterBankBuffer.copyFrom (2*i, 0, omniEightBuffer, 0, 0, numSamples);
-        filterBankBuffer.copyFrom (2*i+1, 0, omniEightBuffer, 1, 0, numSamples);
-    }
+    const int nActiveBands = engine.getNumBands();
     
-    // 5-band EQ
-    if (zeroDelayMode->load() < 0.5f && nActiveBands > 1)
-    {
-        if (!convolversReady)
-        {
-            return;
-        }
-        
-        // CODEREVIEW TODO: evaluate convolver use of FFT in JUCE::dsp to determine latency effects - Can we Replace with our own convolver code?
-        
-        for (int i = 0; i < nActiveBands; ++i)
-        {
-            // omni
-            float* writePointerOmni = filterBankBuffer.getWritePointer (2 * i);
-            dsp::AudioBlock<float> subBlk (&writePointerOmni, 1, numSamples);
-            dsp::ProcessContextReplacing<float> filterCtx (subBlk);
-            convolvers[2 * i].process (filterCtx); // mono processing
-            
-            // eight
-            float* writePointerEight = filterBankBuffer.getWritePointer (2 * i + 1);
-            dsp::AudioBlock<float> subBlk2 (&writePointerEight, 1, numSamples);
-            dsp::ProcessContextReplacing<float> filterCtx2 (subBlk2);
-            convolvers[2 * i + 1].process (filterCtx2); // mono processing
-        }
-        convolversReady = true;
-    }
+    const bool metering = meteringEnabled.get();
+    
+    if (trackingActive || adaptiveModeActive() || metering)
+        computeBandCovariances (nActiveBands, numSamples);
     
     if (trackingActive)
-        trackSignalEnergy();
+        trackSignalEnergy (nActiveBands);
+    
+    updateAdaptivePatterns (nActiveBands, numSamples);
     
-    createPolarPatterns (buffer);
+    createPolarPatterns (buffer, state, morphing);
+    
+    if (metering)
+        measureLevels (buffer, nActiveBands, numSamples);
+    
+    if (analyseSpectrum)
+        spectrumAnalyzer.pushSamples (spectrumInputBuffer.getReadPointer (0), buffer.getReadPointer (0), numSamples);
 }
 
 void PolarDesignerAudioProcessor::processBlockBypassed (AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
@@ -473,62 +498,77 @@ AudioProcessorEditor* PolarDesignerAudioProcessor::createEditor()
 
 void PolarDesignerAudioProcessor::getStateInformation (MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
-    vtsParams.state.setProperty("ffDfEq", var(doEq), nullptr);
-    vtsParams.state.setProperty("oldProxDistance", var(oldProxDistance), nullptr);
-    
+    // the active layer is written from the parameters, the other one from its stored state
+    PluginStateFormat::Layer stateA, stateB;
     if (abLayerState == 1)
     {
-        layerA = vtsParams.copyState();
         doEqA = doEq;
         if (proxDistance->load() != 0) { oldProxDistanceA = proxDistance->load(); }
+        readCurrentLayerState (stateA);
+        readLayerState (layerB, stateB);
     }
-    if (abLayerState == 0)
+    else
     {
-        layerB = vtsParams.copyState();
         doEqB = doEq;
         if (proxDistance->load() != 0) { oldProxDistanceB = proxDistance->load(); }
+        readLayerState (layerA, stateA);
+        readCurrentLayerState (stateB);
     }
     
-    layerA.setProperty("ffDfEq", var(doEqA), nullptr);
-    layerA.setProperty("oldProxDistance", var(oldProxDistanceA), nullptr);
-    layerB.setProperty("ffDfEq", var(doEqB), nullptr);
-    layerB.setProperty("oldProxDistance", var(oldProxDistanceB), nullptr);
+    stateA.ffDfEq = doEqA;
+    stateA.oldProxDistance = oldProxDistanceA;
+    stateB.ffDfEq = doEqB;
+    stateB.oldProxDistance = oldProxDistanceB;
     
-    ValueTree vtsState = vtsParams.copyState();
-    ValueTree AState = layerA.createCopy();
-    ValueTree BState = layerB.createCopy();
+    PluginStateFormat::Layer sceneStates[N_SCENES];
+    for (int i = 0; i < N_SCENES; ++i)
+        sceneStates[i] = scenes[i].params;
     
-    saveStates.removeAllChildren(nullptr);
-    saveStates.addChild(vtsState, 0, nullptr);
-    saveStates.addChild(AState, 1, nullptr);
-    saveStates.addChild(BState, 2, nullptr);
-    
-    std::unique_ptr<XmlElement> xml (saveStates.createXml());
-    copyXmlToBinary (*xml, destData);
+    PluginStateFormat::write (destData, stateA, stateB, sceneStates, N_SCENES);
 }
 
 void PolarDesignerAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
+    const ParameterTransaction transaction (*this);
+    
     // You should use this method to restore your parameters from this memory block,
     // whose contents will have been created by the getStateInformation() call.
-    std::unique_ptr<XmlElement> xmlState (getXmlFromBinary (data, sizeInBytes));
-    if (xmlState != nullptr)
+    // the restored parameters are kept, a restored scene isn't recalled until it is switched
+    loadingFile = true;
+    PluginStateFormat::Layer stateA, stateB, sceneStates[N_SCENES];
+    if (PluginStateFormat::read (data, sizeInBytes, stateA, stateB, sceneStates, N_SCENES))
     {
-        if (xmlState->hasTagName (saveStates.getType()))
-        {
-            saveStates = ValueTree::fromXml (*xmlState);
-            vtsParams.replaceState(saveStates.getChild(1));
-        }
-        else if (xmlState->hasTagName (vtsParams.state.getType()))
+        if (stateA.numValues > 0)
+            vtsParams.replaceState(createLayerTree (stateA, vtsParams.state.getType()));
+        layerB = createLayerTree (stateB, nodeB);
+    }
+    else
+    {
+        // sessions saved before the binary state
+        std::unique_ptr<XmlElement> xmlState (getXmlFromBinary (data, sizeInBytes));
+        if (xmlState != nullptr)
         {
-            vtsParams.state = ValueTree::fromXml (*xmlState);
+            if (xmlState->hasTagName (saveStates.getType()))
+            {
+                saveStates = ValueTree::fromXml (*xmlState);
+                vtsParams.replaceState(saveStates.getChild(1));
+            }
+            else if (xmlState->hasTagName (vtsParams.state.getType()))
+            {
+                vtsParams.state = ValueTree::fromXml (*xmlState);
+            }
         }
+        
+        layerB = saveStates.getChild(2).createCopy();
     }
+    loadingFile = false;
+    keepCurrentScene();
     
-    layerB = saveStates.getChild(2).createCopy();
+    for (int i = 0; i < N_SCENES; ++i)
+    {
+        sanitizeLayerState (sceneStates[i]);
+        setScene (i, sceneStates[i]);
+    }
     
     if (vtsParams.state.hasProperty("ffDfEq"))
     {
@@ -564,22 +604,21 @@ void PolarDesignerAudioProcessor::setStateInformation (const void* data, int siz
         }
     }
     nBands = static_cast<int>(nBandsPtr->load()) + 1;
-    didNRActiveBandsChange = true;
-    zeroDelayModeChanged = true;
-    ffDfEqChanged = true;
-    computeAllFilterCoefficients();
-    initAllConvolvers();
-    repaintDEQ = true;
+    loadEqualizers();
+    updateEngine(); // designed once prepared
+    startMorphDesign();
+    notifyEditor (editorAllChanges);
 }
 
 void PolarDesignerAudioProcessor::parameterChanged (const String &parameterID, float newValue)
 {
     if (parameterID.startsWith("xOverF") && !loadingFile)
     {
+        // collected and loaded in timerCallback(), so dragging a crossover doesn't flood the loader queue
         int idx = parameterID.getTrailingIntValue() - 1;
-        computeFilterCoefficients(idx);
-        initConvolver(idx);
-        repaintDEQ = true;
+        pendingCrossovers.fetch_or(1 << idx);
+        startTimerIfNeeded();
+        notifyEditor (editorRepaintDEQ);
     }
     else if (parameterID.startsWith("solo"))
     {
@@ -588,27 +627,49 @@ void PolarDesignerAudioProcessor::parameterChanged (const String &parameterID, f
             if (soloBand[i]->load() >= 0.5)
                 soloActive = true;
         }
+        notifyEditor (editorResponseChanged);
     }
-    else if (parameterID.startsWith("alpha"))
+    else if (parameterID.startsWith("gain") || parameterID.startsWith("mute"))
     {
-        repaintDEQ = true;
+        notifyEditor (editorResponseChanged);
+    }
+    else if (parameterID.startsWith("alpha") || parameterID == "adaptiveMode")
+    {
+        notifyEditor (editorRepaintDEQ);
     }
     else if (parameterID == "nrBands")
     {
         nBands = static_cast<int> (nBandsPtr->load()) + 1;
-        resetXoverFreqs();
-        didNRActiveBandsChange = true;
-        computeAllFilterCoefficients();
-        initAllConvolvers();
+        // a transaction brings its own crossover frequencies
+        if (parameterTransactionDepth.get() == 0)
+            resetXoverFreqs();
+        notifyEditor (editorNrBandsChanged);
+        updateEngine();
+    }
+    else if (parameterID == "filterQuality")
+    {
+        const int newFirLen = FilterBankDesign::getFirLength(currentSampleRate, getFilterQuality());
+        if (newFirLen != firLen)
+        {
+            firLen = newFirLen;
+            updateEngine();
+            startMorphDesign();
+            notifyEditor (editorResponseChanged);
+        }
+    }
+    else if (parameterID == "scene")
+    {
+        // recalled on the audio thread, restored states and layers keep their parameters
+        if (!loadingFile && !abLayerChanged.get())
+            requestedScene = roundToInt (newValue);
     }
     else if (parameterID == "proximity")
     {
         setProxCompCoefficients(proxDistance->load());
+        notifyEditor (editorResponseChanged);
     }
     else if (parameterID == "zeroDelayMode")
     {
-        updateLatency();
-        
         if (newValue == 0)
         {
             if (abLayerState == 0)
@@ -619,9 +680,7 @@ void PolarDesignerAudioProcessor::parameterChanged (const String &parameterID, f
             {
                 vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(oldProxDistanceA));
             }
-            zeroDelayModeChanged = true;
-            computeAllFilterCoefficients();
-            initAllConvolvers();
+            notifyEditor (editorZeroDelayModeChanged);
         }
         else
         {
@@ -634,11 +693,17 @@ void PolarDesignerAudioProcessor::parameterChanged (const String &parameterID, f
                 oldProxDistanceA = proxDistance->load();
             }
             vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(0));
-            zeroDelayModeChanged = true;
+            notifyEditor (editorZeroDelayModeChanged);
         }
+        
+        // latency is updated once the new engine has been faded in
+        updateEngine();
+        startMorphDesign();
     }
     else if (parameterID == "syncChannel" && syncChannelPtr->load() >= 0.5f)
     {
+        startTimerIfNeeded();
+        
         int ch = (int) syncChannelPtr->load() - 1;
         ParamsToSync& paramsToSync = sharedParams.get().syncParams.getReference(ch);
         
@@ -722,6 +787,8 @@ void PolarDesignerAudioProcessor::parameterChanged (const String &parameterID, f
 void PolarDesignerAudioProcessor::setEqState(int idx)
 {
     doEq = idx;
+    loadEqualizers();
+    notifyEditor (editorResponseChanged);
     
     if (syncChannelPtr->load() >= 0.5f && !readingSharedParams)
     {
@@ -746,28 +813,28 @@ void PolarDesignerAudioProcessor::resetXoverFreqs()
         case 2:
             for (int i = 0; i < nBands - 1; ++i)
             {
-                vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_2B[i]));
+                vtsParams.getParameter (XOVER_IDS[i])->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_2B[i]));
             }
             break;
             
         case 3:
             for (int i = 0; i < nBands - 1; ++i)
             {
-                vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_3B[i]));
+                vtsParams.getParameter (XOVER_IDS[i])->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_3B[i]));
             }
             break;
             
         case 4:
             for (int i = 0; i < nBands - 1; ++i)
             {
-                vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_4B[i]));
+                vtsParams.getParameter (XOVER_IDS[i])->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_4B[i]));
             }
             break;
             
         case 5:
             for (int i = 0; i < nBands - 1; ++i)
             {
-                vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_5B[i]));
+                vtsParams.getParameter (XOVER_IDS[i])->setValueNotifyingHost (hzToZeroToOne(i, INIT_XOVER_FREQS_5B[i]));
             }
             break;
             
@@ -777,257 +844,1058 @@ void PolarDesignerAudioProcessor::resetXoverFreqs()
     }
 }
 
-// compute filter bank filter coeffs and store in firFilterBuffer
-void PolarDesignerAudioProcessor::computeAllFilterCoefficients()
-{
-    for (int i = 0; i < 4; ++i)
-    {
-        computeFilterCoefficients(i);
-    }
-}
-
-void PolarDesignerAudioProcessor::computeFilterCoefficients(int crossoverNr)
+// compute filter coeffs of the bands next to a crossover, identical kernels are shared with other instances
+void PolarDesignerAudioProcessor::computeFilterCoefficients(int bandMask)
 {
     // only one band: no filtering
     if (nBands == 1)
         return;
     
-    // lowest band is simple lowpass
-    if (crossoverNr == 0)
-    {
-        dsp::FilterDesign<float>::FIRCoefficientsPtr lowpass = dsp::FilterDesign<float>::designFIRLowpassWindowMethod(hzFromZeroToOne(0, xOverFreqs[0]->load()), currentSampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
-        float* lpCoeffs = lowpass->getRawCoefficients();
-        firFilterBuffer.copyFrom(0, 0, lpCoeffs, firLen);
-    }
+    float xOverHz[4];
+    for (int i = 0; i < nBands - 1; ++i)
+        xOverHz[i] = hzFromZeroToOne(i, xOverFreqs[i]->load());
     
-    // all the other bands are bandpass filters
-    for (int i = std::max(1, crossoverNr); i < std::min(crossoverNr + 2, nBands - 1); ++i)
+    for (int i = 0; i < nBands; ++i)
+        if (bandMask & (1 << i))
+            bandKernels[i] = kernelCache->getBandKernel(i, nBands, xOverHz, currentSampleRate, firLen);
+}
+
+// prepares all engines, the first one starts as a delayed passthrough until the filter bank is designed
+void PolarDesignerAudioProcessor::initEngines()
+{
+    designPool->pool.removeJob (&designJob, true, 10000);
+    for (auto* job : sceneDesignJobs)
+        designPool->pool.removeJob (job, true, 10000);
+    designPool->pool.removeJob (&morphDesignJob, true, 10000);
+    
+    dsp::ProcessSpec engineSpec {currentSampleRate, static_cast<uint32>(currentBlockSize), 1};
+    for (auto& engine : engines)
+        engine.prepare (engineSpec);
+    
+    EngineConfig config = getCurrentEngineConfig();
+    config.nBands = 1;
+    configureEngine (0, config);
+    activeEngine = 0;
+    spareEngine = 1;
+    engineState = engineIdle;
+    enginesPrepared = true;
+    updateLatency();
+    
+    // the scene engines are designed again for the new sample rate
+    for (int i = 0; i < N_SCENES; ++i)
     {
-        float halfBandwidth = (hzFromZeroToOne(i, xOverFreqs[i]->load()) - hzFromZeroToOne(i-1, xOverFreqs[i-1]->load())) / 2;
-        dsp::FilterDesign<float>::FIRCoefficientsPtr lp2bp = dsp::FilterDesign<float>::designFIRLowpassWindowMethod(halfBandwidth, currentSampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
-        float* lp2bpCoeffs = lp2bp->getRawCoefficients();
-        auto* filterBufferPointer = firFilterBuffer.getWritePointer(i);
-        for (int j=0; j<firLen; j++) // bandpass transform
-        {
-            float fCenter = halfBandwidth + hzFromZeroToOne(i-1, xOverFreqs[i-1]->load());
-            // write bandpass transformed fir coeffs to buffer
-            *(filterBufferPointer+j) = 2 * *(lp2bpCoeffs+j) * std::cosf(MathConstants<float>::twoPi * fCenter / currentSampleRate * (j - (firLen - 1) / 2));
-        }
+        scenes[i].engineUse = engineEmpty;
+        startSceneDesign (i);
     }
     
-    if (crossoverNr == nBands - 2)
+    // designed once the eq convolvers are prepared
+    for (int i = 0; i < N_MORPH_ENGINES; ++i)
     {
-        // highest band is highpass (via frequency transform)
-        float hpBandwidth = currentSampleRate / 2 - hzFromZeroToOne(nBands - 2, xOverFreqs[nBands-2]->load());
-        auto* filterBufferPointer = firFilterBuffer.getWritePointer(nBands-1);
-        dsp::FilterDesign<float>::FIRCoefficientsPtr lp2hp = dsp::FilterDesign<float>::designFIRLowpassWindowMethod(hpBandwidth, currentSampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
-        float* lp2hpCoeffs = lp2hp->getRawCoefficients();
-        for (int i=0; i<firLen; ++i) // highpass transform
-        {
-            *(filterBufferPointer+i) = *(lp2hpCoeffs+i) * std::cosf(MathConstants<float>::pi * (i - (firLen - 1) / 2));
-        }
+        morphLayers[i].engineUse = engineEmpty;
+        engineConfigs[MORPH_ENGINE + i] = EngineConfig();
     }
+    newestMorphLayer = -1;
+    morphLayer = -1;
+    fadingMorphLayer = -1;
+    oldMorphWeight = 0.0f;
+    
+    engineUpdatePending = nBands > 1 && !config.zeroDelay;
+    if (engineUpdatePending)
+        startEngineUpdate();
+    startTimerIfNeeded();
+}
+
+void PolarDesignerAudioProcessor::updateEngine()
+{
+    engineUpdatePending = true;
+    if (parameterTransactionDepth.get() > 0) // started by endParameterTransaction()
+        return;
     
+    startEngineUpdate();
+    startTimerIfNeeded();
+}
+
+void PolarDesignerAudioProcessor::beginParameterTransaction()
+{
+    ++parameterTransactionDepth;
 }
 
-void PolarDesignerAudioProcessor::initAllConvolvers()
+void PolarDesignerAudioProcessor::endParameterTransaction()
 {
-    convolversReady = false;
+    if (--parameterTransactionDepth > 0)
+        return;
     
-    // build filters and fill firFilterBuffer
-    dsp::AudioBlock<float> convBlk (firFilterBuffer);
-    dsp::ProcessSpec convSpec {currentSampleRate, static_cast<uint32>(currentBlockSize), 1};
-    for (int i = 0; i < nBands; ++i) // prepare nBands mono convolvers
+    // a recalled scene brings its engine along
+    if ((engineUpdatePending || pendingCrossovers.load() != 0) && engineInUseMatches (getCurrentEngineConfig()))
     {
-        AudioBuffer<float> convSingleBuffOmni(1, firLen);
-        convSingleBuffOmni.copyFrom(0, 0, firFilterBuffer, i, 0, firLen);
-        
-        AudioBuffer<float> convSingleBuffEight(1, firLen);
-        convSingleBuffEight.copyFrom(0, 0, firFilterBuffer, i, 0, firLen);
-        
-        // omni convolver
-        convolvers[2 * i].prepare (convSpec); // must be called before loading IR
-        convolvers[2 * i].loadImpulseResponse(std::move(convSingleBuffOmni), currentSampleRate, Convolution::Stereo::no, Convolution::Trim::no, Convolution::Normalise::no);
-        
-        // eight convolver
-        convolvers[2 * i + 1].prepare (convSpec); // must be called before loading IR
-        convolvers[2 * i + 1].loadImpulseResponse(std::move(convSingleBuffEight), currentSampleRate, Convolution::Stereo::no, Convolution::Trim::no, Convolution::Normalise::no);
+        engineUpdatePending = false;
+        pendingCrossovers = 0;
+    }
+    // a new engine is designed with the current crossover frequencies anyway
+    else if (engineUpdatePending)
+    {
+        pendingCrossovers = 0;
+        startEngineUpdate();
+    }
+    else
+    {
+        flushPendingCrossovers();
     }
-    convolversReady = true;
+    startTimerIfNeeded();
 }
 
-void PolarDesignerAudioProcessor::initConvolver(int convNr)
+// hands the current configuration to the design pool, the audio thread crossfades to it once it is ready
+void PolarDesignerAudioProcessor::startEngineUpdate()
 {
-    convolversReady = false;
+    // not prepared yet or still switching, prepareToPlay() or timerCallback() try again,
+    // the audio thread might take the idle engines for a scene recall at any time
+    if (!enginesPrepared || !engineState.compareAndSetBool (engineDesigning, engineIdle))
+        return;
     
-    // build filters and fill firFilterBuffer
-    dsp::AudioBlock<float> convBlk (firFilterBuffer);
-    dsp::ProcessSpec convSpec {currentSampleRate, static_cast<uint32>(currentBlockSize), 1};
+    engineUpdatePending = false;
     
-    // update two convolvers: if one crossover frequency changes, two neighbouring bands need new filters
-    for (int i = convNr; i < convNr + 2; ++i)
-    {
-        AudioBuffer<float> convSingleBuffOmni(1, firLen);
-        convSingleBuffOmni.copyFrom(0, 0, firFilterBuffer, i, 0, firLen);
-        
-        AudioBuffer<float> convSingleBuffEight(1, firLen);
-        convSingleBuffEight.copyFrom(0, 0, firFilterBuffer, i, 0, firLen);
-        
-        // omni convolver
-        convolvers[2 * i].prepare (convSpec); // must be called before loading IR
-        convolvers[2 * i].loadImpulseResponse(std::move(convSingleBuffOmni), currentSampleRate, Convolution::Stereo::no, Convolution::Trim::no, Convolution::Normalise::no);
-        
-        // eight convolver
-        convolvers[2 * i + 1].prepare (convSpec); // must be called before loading IR
-        convolvers[2 * i + 1].loadImpulseResponse(std::move(convSingleBuffEight), currentSampleRate, Convolution::Stereo::no, Convolution::Trim::no, Convolution::Normalise::no);
-    }
-    convolversReady = true;
+    // the working engines take turns, a scene engine is left alone
+    spareEngine = activeEngine.get() == 0 ? 1 : 0;
+    designJob.config = getCurrentEngineConfig();
+    designPool->pool.addJob (&designJob, false);
 }
 
-void PolarDesignerAudioProcessor::createOmniAndEightSignals (AudioBuffer<float>& buffer)
+// runs on the design pool, neither the audio nor the message thread touch the spare engine meanwhile
+void PolarDesignerAudioProcessor::designSpareEngine (const EngineConfig& config)
 {
-    int numSamples = buffer.getNumSamples();
-    // calculate omni part
-    const float* readPointerFront = buffer.getReadPointer (0);
-    const float* readPointerBack = buffer.getReadPointer (1);
-    float* writePointerOmni = omniEightBuffer.getWritePointer (0);
-    FloatVectorOperations::copy (writePointerOmni, readPointerFront, numSamples);
-    FloatVectorOperations::add (writePointerOmni, readPointerBack, numSamples);
+    const int spare = spareEngine.get();
+    configureEngine (spare, config);
+    startSpareEngine (engines[spare].usesConvolution() ? roundToInt (ENGINE_SETTLE_TIME * config.sampleRate) : 0);
+}
+
+void PolarDesignerAudioProcessor::configureEngine (int engineIdx, const EngineConfig& config)
+{
+    KernelCache::Kernel kernels[5];
+    if (config.nBands > 1 && !config.zeroDelay)
+        for (int i = 0; i < config.nBands; ++i)
+            kernels[i] = kernelCache->getBandKernel(i, config.nBands, config.xOverHz, config.sampleRate, config.firLen);
     
-    // calculate fig-of-eight part
-    float* writePointerEight = omniEightBuffer.getWritePointer (1);
-    FloatVectorOperations::copy (writePointerEight, readPointerFront, numSamples);
-    FloatVectorOperations::subtract (writePointerEight, readPointerBack, numSamples);
+    engines[engineIdx].configure (config.nBands, config.zeroDelay, kernels, config.firLen, config.latency);
+    engineConfigs[engineIdx] = config;
 }
 
-void PolarDesignerAudioProcessor::createPolarPatterns(AudioBuffer<float>& buffer)
+// design pool or audio thread: aligns the configured spare engine to the active one and lets it settle before the crossfade
+void PolarDesignerAudioProcessor::startSpareEngine (int settleSamples)
 {
-    int numSamples = buffer.getNumSamples();
-    buffer.clear();
+    const FilterBankEngine& spare = engines[spareEngine.get()];
+    const int latencyDifference = engines[activeEngine.get()].getLatency() - spare.getLatency();
+    alignSpareEngine = latencyDifference > 0;
+    alignmentDelay.setDelayTime (std::abs (latencyDifference) / static_cast<float>(currentSampleRate));
+    
+    // the alignment delay has to be filled as well, a 1-band engine fills its own delay line while loading
+    engineSettleSamples = jmax (settleSamples, std::abs (latencyDifference));
+    engineFadeLength = jmax (1, roundToInt (ENGINE_CROSSFADE_TIME * currentSampleRate));
+    engineFadePosition = 0;
+    engineLoadingSamples = 0;
+    engineState = engineLoading;
+}
+
+PolarDesignerAudioProcessor::EngineConfig PolarDesignerAudioProcessor::getCurrentEngineConfig()
+{
+    EngineConfig config;
+    config.nBands = nBands;
+    config.zeroDelay = zeroDelayModeActive();
+    config.firLen = firLen;
+    config.latency = getFilterBankLatency();
+    config.sampleRate = currentSampleRate;
+    for (int i = 0; i < nBands - 1; ++i)
+        config.xOverHz[i] = hzFromZeroToOne(i, xOverFreqs[i]->load());
+    return config;
+}
+
+DirectivityHeatmap::Settings PolarDesignerAudioProcessor::getHeatmapSettings()
+{
+    const EngineConfig config = getCurrentEngineConfig();
+    DirectivityHeatmap::Settings settings;
+    settings.sampleRate = config.sampleRate;
+    settings.firLen = config.firLen;
     
-    int nActiveBands = nBands;
-    if (zeroDelayMode->load() > 0.5f)
-        nActiveBands = 1;
+    // zero delay engines run a single band without equalization and proximity compensation
+    settings.nBands = config.zeroDelay ? 1 : config.nBands;
+    for (int i = 0; i < settings.nBands - 1; ++i)
+        settings.xOverHz[i] = config.xOverHz[i];
     
-    for (int i = 0; i < nActiveBands; ++i)
+    for (int i = 0; i < settings.nBands; ++i)
     {
-        if ((muteBand[i]->load() > 0.5 && soloBand[i]->load() < 0.5) || (soloActive && soloBand[i]->load() < 0.5))
-            continue;
-        
-        // calculate patterns and add to output buffer
-        const float* readPointerOmni = filterBankBuffer.getReadPointer (2 * i);
-        const float* readPointerEight = filterBankBuffer.getReadPointer (2 * i + 1);
-        
-        float oldGain = Decibels::decibelsToGain(oldBandGains[i], -59.91f);
-        float gain = Decibels::decibelsToGain(bandGains[i]->load(), -59.91f);
-        
-        // add with ramp to prevent crackling noises
-        buffer.addFromWithRamp(0, 0, readPointerOmni, numSamples,
-                               (1 - std::abs (oldDirFactors[i])) * oldGain,
-                               (1 - std::abs (dirFactors[i]->load())) * gain);
-        buffer.addFromWithRamp(0, 0, readPointerEight, numSamples,
-                               oldDirFactors[i] * oldGain,
-                               dirFactors[i]->load() * gain);
-        
-        oldDirFactors[i] = dirFactors[i]->load();
-        oldBandGains[i] = bandGains[i]->load();
+        settings.alphas[i] = getPublishedDirFactor (i);
+        settings.gains[i] = isBandAudible (i) ? Decibels::decibelsToGain (bandGains[i]->load(), -59.91f) : 0.0f;
     }
     
-    // delay needs to be running constantly to prevent clicks
-    delayBuffer.copyFrom(0, 0, buffer, 0, 0, numSamples);
-    dsp::AudioBlock<float> delayBlock(delayBuffer);
-    dsp::ProcessContextReplacing<float> delayContext(delayBlock);
-    delay.process(delayContext);
+    if (config.zeroDelay)
+        return settings;
     
-    if (nActiveBands == 1 && zeroDelayMode->load() < 0.5f) {
-        buffer.copyFrom(0, 0, delayBuffer, 0, 0, numSamples);
+    settings.eqSampleRate = EQ_SAMPLE_RATE;
+    if (doEq == 1 && ffEqLoaded)
+    {
+        settings.eqOmni = ffEqOmniKernel;
+        settings.eqEight = ffEqEightKernel;
+    }
+    else if (doEq == 2 && dfEqLoaded)
+    {
+        settings.eqOmni = dfEqOmniKernel;
+        settings.eqEight = dfEqEightKernel;
     }
     
-    // copy to second output channel -> this generates loud glitches in pro tools if mono output configuration is used
-    // -> check getMainBusNumOutputChannels()
-    if (buffer.getNumChannels() == 2 && getMainBusNumOutputChannels() == 2)
-        buffer.copyFrom(1, 0, buffer, 0, 0, numSamples);
+    const float distance = proxDistance->load();
+    if (std::abs (distance) > 0.05)
+    {
+        // computed again, the audio thread's coefficients may be replaced meanwhile
+        settings.proxCoefficients = getProxCompCoefficients (distance, config.sampleRate).coefficients;
+        settings.proxOnEight = distance < 0;
+    }
+    return settings;
 }
 
-void PolarDesignerAudioProcessor::setLastDir(File newLastDir)
+PolarDesignerAudioProcessor::EngineConfig PolarDesignerAudioProcessor::getLayerEngineConfig (const PluginStateFormat::Layer& params)
 {
-    lastDir = newLastDir;
-    const var v (lastDir.getFullPathName());
-    properties->setValue ("presetFolder", v);
+    EngineConfig config;
+    config.nBands = jlimit (1, 5, roundToInt (params.values[stateNrBands]) + 1);
+    config.zeroDelay = params.values[stateZeroDelayMode] > 0.5f;
+    config.firLen = FilterBankDesign::getFirLength(currentSampleRate, roundToInt (params.values[stateFilterQuality]));
+    config.latency = getFilterBankLatency(config.firLen);
+    config.sampleRate = currentSampleRate;
+    for (int i = 0; i < config.nBands - 1; ++i)
+        config.xOverHz[i] = hzFromZeroToOne(i, params.values[stateXOverF1 + i], config.nBands);
+    return config;
 }
 
-Result PolarDesignerAudioProcessor::loadPreset(const File& presetFile)
+// true if both configurations result in the same filter bank
+bool PolarDesignerAudioProcessor::engineConfigsMatch (const EngineConfig& a, const EngineConfig& b)
 {
-    var parsedJson;
-    if (!presetFile.exists())
-        return Result::fail ("File does not exist!");
+    if (a.zeroDelay != b.zeroDelay || a.sampleRate != b.sampleRate)
+        return false;
+    if (a.zeroDelay)
+        return true;
+    if (a.nBands != b.nBands || a.firLen != b.firLen)
+        return false;
     
-    String jsonString = presetFile.loadFileAsString();
-    Result result = JSON::parse (jsonString, parsedJson);
-    if (!result.wasOk())
-        return Result::fail ("File could not be parsed: Please provide valid JSON!");
+    for (int i = 0; i < a.nBands - 1; ++i)
+        if (std::abs (a.xOverHz[i] - b.xOverHz[i]) > 0.01f)
+            return false;
+    return true;
+}
+
+// compares with the engine which is heard once the current switch is done
+bool PolarDesignerAudioProcessor::engineInUseMatches (const EngineConfig& config)
+{
+    const int state = engineState.get();
+    if (state == engineDesigning)
+        return false;
     
-    for (auto &it : presetProperties)
+    return engineConfigsMatch (engineConfigs[spareEngineRunning(state) ? spareEngine.get() : activeEngine.get()], config);
+}
+
+bool PolarDesignerAudioProcessor::isFilterBankSettled()
+{
+    return enginesPrepared && !engineUpdatePending && pendingCrossovers.load() == 0
+           && engineState.get() == engineIdle && engineInUseMatches (getCurrentEngineConfig());
+}
+
+// stores the current parameters in a scene slot and designs its engine in the background
+void PolarDesignerAudioProcessor::storeScene (int scene)
+{
+    jassert (scene >= 1 && scene <= N_SCENES);
+    
+    PluginStateFormat::Layer params;
+    readCurrentLayerState (params);
+    params.ffDfEq = doEq;
+    params.oldProxDistance = proxDistance->load();
+    setScene (scene - 1, params);
+}
+
+void PolarDesignerAudioProcessor::setScene (int sceneIdx, const PluginStateFormat::Layer& params)
+{
+    if (params.numValues == 0 && !isSceneStored (sceneIdx + 1))
+        return;
+    
+    Scene& scene = scenes[sceneIdx];
+    scene.params = params;
+    
+    ScenePatterns& patterns = scene.patterns.getWriteBuffer();
+    patterns.stored = params.numValues > 0;
+    for (int i = 0; i < 5 && patterns.stored; ++i)
     {
-        if (!parsedJson.hasProperty (it))
-            return Result::fail ("Corrupt preset file: No '" + it + "' property found.");
+        patterns.dirFactors[i] = params.values[stateAlpha1 + i];
+        patterns.gains[i] = params.values[stateGain1 + i];
     }
+    scene.patterns.publish();
     
-    loadingFile = true;
+    startSceneDesign (sceneIdx);
+    startTimerIfNeeded();
+}
+
+// designs the engine of a stored scene on the pool, an engine in use is designed again once it has been released
+void PolarDesignerAudioProcessor::startSceneDesign (int sceneIdx)
+{
+    sceneDesignsPending &= ~(1 << sceneIdx);
     
-    float x = parsedJson.getProperty ("nrActiveBands", parsedJson);
-    vtsParams.getParameter ("nrBands")->setValueNotifyingHost (vtsParams.getParameter ("nrBands")->convertTo0to1(x - 1));
+    // not prepared yet, initEngines() starts the designs
+    if (!enginesPrepared)
+        return;
     
-    for (int i = 0; i < 4; ++i)
+    Scene& scene = scenes[sceneIdx];
+    EngineDesignJob* job = sceneDesignJobs[sceneIdx];
+    designPool->pool.removeJob (job, true, 10000);
+    
+    // the audio thread only takes ready engines
+    if (!scene.engineUse.compareAndSetBool (engineEmpty, engineReady) && scene.engineUse.get() == engineInUse)
     {
-        x = parsedJson.getProperty ("xOverF" + String(i+1), parsedJson);
-        vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (hzToZeroToOne(i, x));
+        if (scene.params.numValues > 0 && !engineConfigsMatch (engineConfigs[SCENE_ENGINE_OFFSET + sceneIdx], getLayerEngineConfig (scene.params)))
+            sceneDesignsPending |= 1 << sceneIdx;
+        return;
     }
     
-    NormalisableRange<float> dfRange = vtsParams.getParameter("alpha1")->getNormalisableRange();
+    if (scene.params.numValues == 0)
+        return;
     
-    for (int i = 0; i < 5; ++i)
+    job->config = getLayerEngineConfig (scene.params);
+    designPool->pool.addJob (job, false);
+}
+
+// runs on the design pool, the audio thread doesn't take the engine before it is ready
+void PolarDesignerAudioProcessor::designSceneEngine (int sceneIdx, const EngineConfig& config)
+{
+    configureEngine (SCENE_ENGINE_OFFSET + sceneIdx, config);
+    scenes[sceneIdx].engineUse = engineReady;
+}
+
+// audio thread: crossfades to the engine of a requested scene, handleAsyncUpdate() applies its parameters
+void PolarDesignerAudioProcessor::recallScene()
+{
+    // the scenes as last published by setScene(), kept for the whole block
+    for (auto& stored : scenes)
+        stored.patterns.update();
+    
+    const int scene = requestedScene.get();
+    if (scene == currentScene.get())
+        return;
+    
+    // switching scenes off keeps the current parameters
+    if (scene == 0)
     {
-        x = parsedJson.getProperty ("dirFactor" + String(i+1), parsedJson);
-        if (x < dfRange.start || x > dfRange.end)
-            return Result::fail ("DirFactor" + String(i+1) + " needs to be between " + String(dfRange.start) + " and " + String(dfRange.end) + ".");
-        vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (dfRange.convertTo0to1(x));
-        
-        x = parsedJson.getProperty ("gain" + String(i+1), parsedJson);
-        vtsParams.getParameter ("gain" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("gain1")->convertTo0to1(x));
-        
-        x = parsedJson.getProperty ("solo" + String(i+1), parsedJson);
-        vtsParams.getParameter ("solo" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("solo1")->convertTo0to1(x));
+        currentScene = 0;
+        return;
+    }
+    
+    // not designed yet or the engines are still switching, the next block tries again
+    Scene& recalled = scenes[scene - 1];
+    if (!recalled.patterns.getReadBuffer().stored)
+        return;
+    
+    const int engineIdx = SCENE_ENGINE_OFFSET + scene - 1;
+    if (activeEngine.get() != engineIdx)
+    {
+        if (!recalled.engineUse.compareAndSetBool (engineInUse, engineReady))
+            return;
+        if (!engineState.compareAndSetBool (engineLoading, engineIdle))
+        {
+            recalled.engineUse = engineReady;
+            return;
+        }
         
-        x = parsedJson.getProperty ("mute" + String(i+1), parsedJson);
-        vtsParams.getParameter ("mute" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("solo1")->convertTo0to1(x));
+        // the engine has been parked with the history of its last use
+        spareEngine = engineIdx;
+        const FilterBankEngine& engine = engines[engineIdx];
+        startSpareEngine (engine.usesConvolution() ? engine.getFirLength() : engine.getLatency());
     }
     
-    doEq = parsedJson.getProperty ("ffDfEq", parsedJson);
+    currentScene = scene;
+    scenePending = scene;
+    triggerAsyncUpdate(); // handleAsyncUpdate() applies the parameters
+}
+
+// sets the parameters of a recalled scene, its engine is already in use or fading in
+void PolarDesignerAudioProcessor::applyScene (int scene)
+{
+    const ParameterTransaction transaction (*this);
+    const PluginStateFormat::Layer& params = scenes[scene - 1].params;
     
-    x = parsedJson.getProperty ("proximity", parsedJson);
-    vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(x));
+    for (int i = 0; i < jmin (params.numValues, N_STATE_PARAMS); ++i)
+    {
+        if (i == stateScene || i == stateSyncChannel || stateParams[i]->load() == params.values[i])
+            continue;
+        
+        RangedAudioParameter* param = vtsParams.getParameter (STATE_PARAM_IDS[i]);
+        param->setValueNotifyingHost (param->convertTo0to1 (params.values[i]));
+    }
     
-    loadingFile = false;
+    // leaving zero latency mode restores the proximity of the layer
+    if (proxDistance->load() != params.values[stateProximity])
+        vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameterRange ("proximity").convertTo0to1 (params.values[stateProximity]));
     
-    // set parameters
-    nBands = static_cast<int>(nBandsPtr->load()) + 1;
-    didNRActiveBandsChange = true;
-    computeAllFilterCoefficients();
-    initAllConvolvers();
-    repaintDEQ = true;
+    if (params.ffDfEq != doEq)
+    {
+        setEqState(params.ffDfEq);
+        notifyEditor (editorEqModeChanged);
+    }
     
-    return Result::ok();
+    scenePending.compareAndSetBool (0, scene);
 }
 
-Result PolarDesignerAudioProcessor::savePreset (File destination)
+// filter quality and latency mode follow the active layer, so the outputs of both layers line up
+PolarDesignerAudioProcessor::EngineConfig PolarDesignerAudioProcessor::getMorphEngineConfig (const PluginStateFormat::Layer& params)
 {
-    DynamicObject* jsonObj = new DynamicObject();
-    char versionString[10];
-    strcpy(versionString, "v");
-    strcat(versionString, JucePlugin_VersionString);
-    jsonObj->setProperty("Description", var("This preset file was created with the Austrian Audio PolarDesigner plugin "
-                                            + String(versionString) + ", for more information see www.austrian.audio ."));
+    EngineConfig config = getLayerEngineConfig (params);
+    config.zeroDelay = zeroDelayModeActive();
+    config.firLen = firLen;
+    config.latency = getFilterBankLatency();
+    return config;
+}
+
+// designs the engine of the inactive layer next to the one heard, it is designed again by timerCallback() if both are in use
+void PolarDesignerAudioProcessor::startMorphDesign()
+{
+    morphDesignPending = false;
+    
+    // not prepared yet, prepareToPlay() starts the design
+    if (!enginesPrepared)
+        return;
+    
+    designPool->pool.removeJob (&morphDesignJob, true, 10000);
+    
+    // an unused layer has nothing to morph to, the audio thread fades the old one out
+    PluginStateFormat::Layer params;
+    readLayerState (abLayerState == 1 ? layerB : layerA, params);
+    if (params.numValues == 0)
+    {
+        newestMorphLayer = -1;
+        return;
+    }
+    
+    // the engine next to the newest one, or the newest one if the audio thread hasn't taken it yet
+    const int newest = newestMorphLayer.get();
+    int layerIdx = -1;
+    for (int candidate : { newest < 0 ? 0 : 1 - newest, newest < 0 ? 1 : newest })
+    {
+        if (morphLayers[candidate].engineUse.compareAndSetBool (engineEmpty, engineReady) || morphLayers[candidate].engineUse.get() == engineEmpty)
+        {
+            layerIdx = candidate;
+            break;
+        }
+    }
+    
+    // both are in use while the audio thread crossfades them
+    if (layerIdx < 0)
+    {
+        morphDesignPending = true;
+        startTimerIfNeeded();
+        return;
+    }
+    
+    MorphLayer& layer = morphLayers[layerIdx];
+    for (int i = 0; i < 5; ++i)
+    {
+        layer.dirFactors[i] = params.values[stateAlpha1 + i];
+        layer.gains[i] = params.values[stateGain1 + i];
+    }
+    
+    // both engines share the eq convolvers, which crossfade to a new eq by themselves
+    layer.eq = abLayerState == 1 ? doEqB : doEqA;
+    if (layer.eq > 0 && layer.eq != morphEqLoaded)
+    {
+        loadEqualizer (layer.eq, morphEqOmniConv, morphEqEightConv);
+        morphEqLoaded = layer.eq;
+    }
+    
+    // the filter bank is kept if only the patterns or the eq changed
+    const EngineConfig config = getMorphEngineConfig (params);
+    if (engineConfigsMatch (engineConfigs[MORPH_ENGINE + layerIdx], config))
+    {
+        layer.engineUse = engineReady;
+        newestMorphLayer = layerIdx;
+        return;
+    }
+    
+    morphDesignJob.scene = N_SCENES + layerIdx;
+    morphDesignJob.config = config;
+    designPool->pool.addJob (&morphDesignJob, false);
+}
+
+// runs on the design pool, the audio thread doesn't take the engine before it is ready
+void PolarDesignerAudioProcessor::designMorphEngine (int layerIdx, const EngineConfig& config)
+{
+    configureEngine (MORPH_ENGINE + layerIdx, config);
+    morphLayers[layerIdx].engineUse = engineReady;
+    newestMorphLayer = layerIdx;
+}
+
+// a scene selected by the restored state or layer is taken as recalled
+void PolarDesignerAudioProcessor::keepCurrentScene()
+{
+    const int scene = roundToInt (stateParams[stateScene]->load());
+    requestedScene = scene;
+    currentScene = scene;
+}
+
+// loads the kernels of the changed bands into the engines using them
+void PolarDesignerAudioProcessor::loadFilterBands (int bandMask)
+{
+    // a scene engine keeps its crossovers, a working engine takes over
+    if (activeEngine.get() >= SCENE_ENGINE_OFFSET)
+    {
+        engineUpdatePending = true;
+        startTimerIfNeeded();
+        return;
+    }
+    
+    for (int e = 0; e < SCENE_ENGINE_OFFSET; ++e)
+    {
+        FilterBankEngine& engine = engines[e];
+        
+        // the spare engine is being designed with the old crossovers, design it again afterwards
+        if (e != activeEngine.get() && engineState.get() == engineDesigning)
+        {
+            engineUpdatePending = true;
+            startTimerIfNeeded();
+            continue;
+        }
+        
+        if (engine.isZeroDelay() || engine.getNumBands() != nBands || engine.getFirLength() != firLen)
+            continue;
+        
+        for (int i = 0; i < nBands; ++i)
+            if (bandMask & (1 << i))
+                engine.loadBand (i, bandKernels[i]);
+        
+        for (int i = 0; i < nBands - 1; ++i)
+            engineConfigs[e].xOverHz[i] = hzFromZeroToOne(i, xOverFreqs[i]->load());
+    }
+}
+
+// designs and loads the bands next to the changed crossover frequencies, each band only once
+void PolarDesignerAudioProcessor::flushPendingCrossovers()
+{
+    const int crossovers = pendingCrossovers.exchange(0);
+    int bandMask = 0;
+    for (int i = 0; i < 4; ++i)
+        if (crossovers & (1 << i))
+            bandMask |= 3 << i; // a crossover frequency affects its two neighbouring bands
+    
+    if (bandMask == 0)
+        return;
+    
+    computeFilterCoefficients(bandMask);
+    loadFilterBands(bandMask);
+}
+
+// fetches and loads the selected eq tables on first use, the audio thread uses the unloaded convolvers as pass through
+void PolarDesignerAudioProcessor::loadEqualizers()
+{
+    // not prepared yet, prepareToPlay() loads the selected eq
+    if (!enginesPrepared)
+        return;
+    
+    if (doEq == 1 && !ffEqLoaded)
+    {
+        loadEqualizer (1, ffEqOmniConv, ffEqEightConv);
+        ffEqLoaded = true;
+    }
+    else if (doEq == 2 && !dfEqLoaded)
+    {
+        loadEqualizer (2, dfEqOmniConv, dfEqEightConv);
+        dfEqLoaded = true;
+    }
+}
+
+// 1: free field, 2: diffuse field eq
+void PolarDesignerAudioProcessor::loadEqualizer (int eq, dsp::Convolution& omniConv, dsp::Convolution& eightConv)
+{
+    if (eq == 1)
+    {
+        if (ffEqOmniKernel == nullptr)
+        {
+            ffEqOmniKernel = kernelCache->getImpulseResponse("ffEqOmni", FFEQ_COEFFS_OMNI, FF_EQ_LEN);
+            ffEqEightKernel = kernelCache->getImpulseResponse("ffEqEight", FFEQ_COEFFS_EIGHT, FF_EQ_LEN);
+        }
+        convolutionLoader->loadImpulseResponse(omniConv, AudioBuffer<float>(*ffEqOmniKernel), EQ_SAMPLE_RATE);
+        convolutionLoader->loadImpulseResponse(eightConv, AudioBuffer<float>(*ffEqEightKernel), EQ_SAMPLE_RATE);
+    }
+    else if (eq == 2)
+    {
+        if (dfEqOmniKernel == nullptr)
+        {
+            dfEqOmniKernel = kernelCache->getImpulseResponse("dfEqOmni", DFEQ_COEFFS_OMNI, DF_EQ_LEN);
+            dfEqEightKernel = kernelCache->getImpulseResponse("dfEqEight", DFEQ_COEFFS_EIGHT, DF_EQ_LEN);
+        }
+        convolutionLoader->loadImpulseResponse(omniConv, AudioBuffer<float>(*dfEqOmniKernel), EQ_SAMPLE_RATE);
+        convolutionLoader->loadImpulseResponse(eightConv, AudioBuffer<float>(*dfEqEightKernel), EQ_SAMPLE_RATE);
+    }
+}
+
+// woken by the audio thread
+void PolarDesignerAudioProcessor::handleAsyncUpdate()
+{
+    const int scene = scenePending.get();
+    if (scene > 0)
+        applyScene (scene);
+    
+    // only the message thread starts designs, so the loading engine isn't configured meanwhile
+    if (engineReloadRequested.compareAndSetBool (false, true) && engineState.get() == engineLoading)
+        engines[spareEngine.get()].reloadBands();
+}
+
+// any thread, the change message is only posted if the last one has been delivered
+void PolarDesignerAudioProcessor::notifyEditor (int changes)
+{
+    editorChanges.fetch_or (changes);
+    editorNotifier.sendChangeMessage();
+}
+
+void PolarDesignerAudioProcessor::startTimerIfNeeded()
+{
+    if (!isTimerRunning() && isTimerNeeded())
+        startTimer(50);
+}
+
+// the timer only runs while syncing or while crossover, engine and scene or morph designs are pending,
+// recalled scenes are applied by handleAsyncUpdate()
+bool PolarDesignerAudioProcessor::isTimerNeeded()
+{
+    return syncChannelPtr->load() >= 0.5f || engineUpdatePending || pendingCrossovers.load() != 0 || sceneDesignsPending != 0 || morphDesignPending;
+}
+
+// the spare engine runs next to the active one while it is loading and fading in
+void PolarDesignerAudioProcessor::processEngines (const AudioBuffer<float>& omniEight, int state, bool zeroDelayEngines, int numSamples)
+{
+    FilterBankEngine& active = engines[activeEngine.get()];
+    if (active.isZeroDelay() == zeroDelayEngines)
+        active.process (omniEight, filterBankBuffer, numSamples);
+    
+    if (!spareEngineRunning(state))
+        return;
+    
+    FilterBankEngine& spare = engines[spareEngine.get()];
+    if (spare.isZeroDelay() == zeroDelayEngines)
+        spare.process (omniEight, spareBankBuffer, numSamples);
+}
+
+// buffer holds the output of the active engine, spareOutputBuffer the one of the spare engine
+void PolarDesignerAudioProcessor::mixEngines (AudioBuffer<float>& buffer, int state, int numSamples)
+{
+    // the alignment delay runs as long as the spare engine does, so it is filled once the crossfade starts
+    if (alignmentDelay.getDelayInSamples() > 0)
+    {
+        float* writePointer = alignSpareEngine ? spareOutputBuffer.getWritePointer (0) : buffer.getWritePointer (0);
+        dsp::AudioBlock<float> alignBlock (&writePointer, 1, numSamples);
+        
+        // the active engine is heard undelayed until the crossfade starts
+        if (alignSpareEngine || state == engineFading)
+        {
+            dsp::ProcessContextReplacing<float> alignContext (alignBlock);
+            alignmentDelay.process (alignContext);
+        }
+        else
+        {
+            alignmentDelay.write (alignBlock);
+        }
+    }
+    
+    if (state == engineLoading)
+    {
+        if (!engines[spareEngine.get()].isReady())
+        {
+            engineLoadingSamples += numSamples;
+            if (engineLoadingSamples >= roundToInt (ENGINE_LOAD_TIMEOUT * currentSampleRate))
+            {
+                engineLoadingSamples = 0;
+                engineReloadRequested = true;
+                triggerAsyncUpdate();
+            }
+            return;
+        }
+        
+        // the reported latency covers both engines from now on
+        if (engineSettleSamples <= 0)
+        {
+            engineState = engineFading;
+            updateLatency();
+        }
+        engineSettleSamples -= numSamples;
+        return;
+    }
+    
+    const float startGain = static_cast<float>(engineFadePosition) / engineFadeLength;
+    engineFadePosition = jmin (engineFadePosition + numSamples, engineFadeLength);
+    const float endGain = static_cast<float>(engineFadePosition) / engineFadeLength;
+    
+    buffer.applyGainRamp (0, 0, numSamples, 1.0f - startGain, 1.0f - endGain);
+    buffer.addFromWithRamp (0, 0, spareOutputBuffer.getReadPointer (0), numSamples, startGain, endGain);
+    
+    // switch over, the old engine stays untouched until the next configuration change or scene recall
+    if (engineFadePosition == engineFadeLength)
+    {
+        const int oldEngine = activeEngine.get();
+        activeEngine = spareEngine.get();
+        if (oldEngine >= SCENE_ENGINE_OFFSET)
+            scenes[oldEngine - SCENE_ENGINE_OFFSET].engineUse = engineReady;
+        engineState = engineIdle;
+        updateLatency();
+    }
+}
+
+// audio thread: holds the engine of the inactive layer while the morph is up or fading out, a newer design is taken over
+// once the previous one has been faded out
+bool PolarDesignerAudioProcessor::takeMorphEngine()
+{
+    const int newest = newestMorphLayer.get();
+    if ((morphAmount->load() <= 0.0f || newest < 0) && oldMorphWeight <= 0.0f)
+    {
+        releaseMorphEngine (fadingMorphLayer);
+        releaseMorphEngine (morphLayer);
+        return false;
+    }
+    
+    if (newest >= 0 && newest != morphLayer && fadingMorphLayer < 0 && morphLayers[newest].engineUse.compareAndSetBool (engineInUse, engineReady))
+    {
+        // an engine which isn't heard yet is dropped, a heard one keeps running until the new one has settled
+        if (morphLayer >= 0 && isMorphLayerSettled (morphLayer))
+            fadingMorphLayer = morphLayer;
+        else
+            releaseMorphEngine (morphLayer);
+        
+        // the engine and its eq still hold the history of their last use or are new
+        MorphLayer& layer = morphLayers[newest];
+        const FilterBankEngine& engine = engines[MORPH_ENGINE + newest];
+        layer.settleSamples = engine.usesConvolution() ? engine.getFirLength() : engine.getLatency();
+        if (layer.eq > 0)
+            layer.settleSamples += roundToInt (jmax (DF_EQ_LEN, FF_EQ_LEN) * currentSampleRate / EQ_SAMPLE_RATE);
+        morphLayer = newest;
+        morphLayerFadePosition = 0;
+    }
+    
+    return morphLayer >= 0;
+}
+
+void PolarDesignerAudioProcessor::releaseMorphEngine (int& layerIdx)
+{
+    if (layerIdx < 0)
+        return;
+    
+    morphLayers[layerIdx].engineUse = engineReady;
+    layerIdx = -1;
+}
+
+bool PolarDesignerAudioProcessor::isMorphLayerSettled (int layerIdx)
+{
+    return engines[MORPH_ENGINE + layerIdx].isReady() && morphLayers[layerIdx].settleSamples <= 0;
+}
+
+// the inactive layer shares the proximity compensation of the active one, its eq is applied separately
+void PolarDesignerAudioProcessor::prepareMorphInput (int numSamples)
+{
+    morphInputBuffer.copyFrom (0, 0, omniEightBuffer, 0, 0, numSamples);
+    morphInputBuffer.copyFrom (1, 0, omniEightBuffer, 1, 0, numSamples);
+    
+    bool eqNeeded = false;
+    for (int layerIdx : { morphLayer, fadingMorphLayer })
+        if (layerIdx >= 0 && morphLayers[layerIdx].eq > 0 && !engines[MORPH_ENGINE + layerIdx].isZeroDelay())
+            eqNeeded = true;
+    if (!eqNeeded)
+        return;
+    
+    morphEqInputBuffer.copyFrom (0, 0, morphInputBuffer, 0, 0, numSamples);
+    morphEqInputBuffer.copyFrom (1, 0, morphInputBuffer, 1, 0, numSamples);
+    
+    float* writePointerOmni = morphEqInputBuffer.getWritePointer (0);
+    dsp::AudioBlock<float> morphEqOmniBlk(&writePointerOmni, 1, numSamples);
+    dsp::ProcessContextReplacing<float> morphEqOmniCtx (morphEqOmniBlk);
+    morphEqOmniConv.process(morphEqOmniCtx);
+    
+    float* writePointerEight = morphEqInputBuffer.getWritePointer (1);
+    dsp::AudioBlock<float> morphEqEightBlk(&writePointerEight, 1, numSamples);
+    dsp::ProcessContextReplacing<float> morphEqEightCtx (morphEqEightBlk);
+    morphEqEightConv.process(morphEqEightCtx);
+}
+
+// zero delay engines take the signals without proximity compensation and equalization
+void PolarDesignerAudioProcessor::processMorphEngines (bool zeroDelayEngines, int numSamples)
+{
+    for (int layerIdx : { morphLayer, fadingMorphLayer })
+    {
+        if (layerIdx < 0)
+            continue;
+        
+        FilterBankEngine& engine = engines[MORPH_ENGINE + layerIdx];
+        if (engine.isZeroDelay() != zeroDelayEngines)
+            continue;
+        
+        const AudioBuffer<float>& input = zeroDelayEngines ? omniEightBuffer : (morphLayers[layerIdx].eq > 0 ? morphEqInputBuffer : morphInputBuffer);
+        engine.process (input, morphBankBuffers[layerIdx], numSamples);
+    }
+}
+
+void PolarDesignerAudioProcessor::addMorphPatterns (int layerIdx, AudioBuffer<float>& dest, int numSamples)
+{
+    const MorphLayer& layer = morphLayers[layerIdx];
+    addPolarPatterns (morphBankBuffers[layerIdx], engines[MORPH_ENGINE + layerIdx].getNumBands(), layer.dirFactors, layer.dirFactors,
+                      layer.gains, layer.gains, false, dest, numSamples);
+}
+
+// blends the output of the inactive layer into buffer, as long as both line up. The weight follows the morph amount
+// within ENGINE_CROSSFADE_TIME, so a redesign or a misaligned engine never switches the blend abruptly
+void PolarDesignerAudioProcessor::mixMorphLayer (AudioBuffer<float>& buffer, int state, int numSamples)
+{
+    MorphLayer& layer = morphLayers[morphLayer];
+    if (engines[MORPH_ENGINE + morphLayer].isReady() && layer.settleSamples > 0)
+        layer.settleSamples -= numSamples;
+    const bool settled = isMorphLayerSettled (morphLayer);
+    
+    // while the engines are crossfaded, the active output might be delayed
+    auto isAligned = [&] (int layerIdx) { return state != engineFading && engines[MORPH_ENGINE + layerIdx].getLatency() == engines[activeEngine.get()].getLatency(); };
+    
+    // the previous engine is heard until the new one has settled, then both are crossfaded
+    const bool fading = fadingMorphLayer >= 0 && settled;
+    bool audible;
+    if (fadingMorphLayer >= 0)
+        audible = isAligned (fadingMorphLayer) && (!settled || isAligned (morphLayer));
+    else
+        audible = settled && isAligned (morphLayer);
+    
+    const float target = (audible && newestMorphLayer.get() >= 0) ? jlimit (0.0f, 1.0f, morphAmount->load()) : 0.0f;
+    const float maxStep = numSamples / (ENGINE_CROSSFADE_TIME * static_cast<float> (currentSampleRate));
+    const float weight = jlimit (oldMorphWeight - maxStep, oldMorphWeight + maxStep, target);
+    
+    const bool silent = weight == 0.0f && oldMorphWeight == 0.0f;
+    morphOutputBuffer.clear();
+    if (fading)
+    {
+        const int fadeLength = jmax (1, roundToInt (ENGINE_CROSSFADE_TIME * currentSampleRate));
+        const float startGain = static_cast<float> (morphLayerFadePosition) / fadeLength;
+        morphLayerFadePosition = jmin (morphLayerFadePosition + numSamples, fadeLength);
+        const float endGain = static_cast<float> (morphLayerFadePosition) / fadeLength;
+        
+        if (!silent)
+        {
+            addMorphPatterns (morphLayer, morphOutputBuffer, numSamples);
+            morphOutputBuffer.applyGainRamp (0, 0, numSamples, startGain, endGain);
+            morphFadeBuffer.clear();
+            addMorphPatterns (fadingMorphLayer, morphFadeBuffer, numSamples);
+            morphOutputBuffer.addFromWithRamp (0, 0, morphFadeBuffer.getReadPointer (0), numSamples, 1.0f - startGain, 1.0f - endGain);
+        }
+        
+        if (morphLayerFadePosition == fadeLength)
+            releaseMorphEngine (fadingMorphLayer);
+    }
+    else if (!silent)
+    {
+        addMorphPatterns (fadingMorphLayer >= 0 ? fadingMorphLayer : morphLayer, morphOutputBuffer, numSamples);
+    }
+    
+    if (silent)
+        return;
+    
+    buffer.applyGainRamp (0, 0, numSamples, 1.0f - oldMorphWeight, 1.0f - weight);
+    buffer.addFromWithRamp (0, 0, morphOutputBuffer.getReadPointer (0), numSamples, oldMorphWeight, weight);
+    oldMorphWeight = weight;
+}
+
+void PolarDesignerAudioProcessor::createOmniAndEightSignals (AudioBuffer<float>& buffer)
+{
+    int numSamples = buffer.getNumSamples();
+    // calculate omni part
+    const float* readPointerFront = buffer.getReadPointer (0);
+    const float* readPointerBack = buffer.getReadPointer (1);
+    float* writePointerOmni = omniEightBuffer.getWritePointer (0);
+    FloatVectorOperations::copy (writePointerOmni, readPointerFront, numSamples);
+    FloatVectorOperations::add (writePointerOmni, readPointerBack, numSamples);
+    
+    // calculate fig-of-eight part
+    float* writePointerEight = omniEightBuffer.getWritePointer (1);
+    FloatVectorOperations::copy (writePointerEight, readPointerFront, numSamples);
+    FloatVectorOperations::subtract (writePointerEight, readPointerBack, numSamples);
+}
+
+void PolarDesignerAudioProcessor::createPolarPatterns(AudioBuffer<float>& buffer, int state, bool morphing)
+{
+    int numSamples = buffer.getNumSamples();
+    buffer.clear();
+    
+    // the patterns of a recalled scene are used before handleAsyncUpdate() has set its parameters
+    const int scene = scenePending.get();
+    const ScenePatterns& scenePatterns = scenes[jmax (0, scene - 1)].patterns.getReadBuffer();
+    
+    float newDirFactors[5], newGains[5];
+    for (int i = 0; i < 5; ++i)
+    {
+        newDirFactors[i] = (scene > 0 && !adaptiveWasActive) ? scenePatterns.dirFactors[i] : getEffectiveDirFactor(i);
+        newGains[i] = scene > 0 ? scenePatterns.gains[i] : bandGains[i]->load();
+    }
+    
+    addPolarPatterns (filterBankBuffer, engines[activeEngine.get()].getNumBands(), oldDirFactors, newDirFactors, oldBandGains, newGains, true, buffer, numSamples);
+    
+    if (spareEngineRunning(state))
+    {
+        spareOutputBuffer.clear();
+        addPolarPatterns (spareBankBuffer, engines[spareEngine.get()].getNumBands(), oldDirFactors, newDirFactors, oldBandGains, newGains, true, spareOutputBuffer, numSamples);
+        mixEngines (buffer, state, numSamples);
+    }
+    
+    if (morphing)
+        mixMorphLayer (buffer, state, numSamples);
+    
+    for (int i = 0; i < 5; ++i)
+    {
+        oldDirFactors[i] = newDirFactors[i];
+        oldBandGains[i] = newGains[i];
+    }
+    
+    // copy to second output channel -> this generates loud glitches in pro tools if mono output configuration is used
+    // -> check getMainBusNumOutputChannels()
+    if (buffer.getNumChannels() == 2 && getMainBusNumOutputChannels() == 2)
+        buffer.copyFrom(1, 0, buffer, 0, 0, numSamples);
+}
+
+void PolarDesignerAudioProcessor::addPolarPatterns (const AudioBuffer<float>& bands, int nActiveBands, const float* oldDirs, const float* newDirFactors, const float* oldGains, const float* newGains,
+                                                    bool muteAndSolo, AudioBuffer<float>& dest, int numSamples)
+{
+    for (int i = 0; i < nActiveBands; ++i)
+    {
+        if (muteAndSolo && !isBandAudible (i))
+            continue;
+        
+        // calculate patterns and add to output buffer
+        const float* readPointerOmni = bands.getReadPointer (2 * i);
+        const float* readPointerEight = bands.getReadPointer (2 * i + 1);
+        
+        float oldGain = Decibels::decibelsToGain(oldGains[i], -59.91f);
+        float gain = Decibels::decibelsToGain(newGains[i], -59.91f);
+        
+        // add with ramp to prevent crackling noises
+        dest.addFromWithRamp(0, 0, readPointerOmni, numSamples,
+                             (1 - std::abs (oldDirs[i])) * oldGain,
+                             (1 - std::abs (newDirFactors[i])) * gain);
+        dest.addFromWithRamp(0, 0, readPointerEight, numSamples,
+                             oldDirs[i] * oldGain,
+                             newDirFactors[i] * gain);
+    }
+}
+
+// properties file: saves user preset folder location
+PropertiesFile& PolarDesignerAudioProcessor::getProperties()
+{
+    if (properties == nullptr)
+    {
+        PropertiesFile::Options options;
+        options.applicationName     = "PolarDesigner";
+        options.filenameSuffix      = "settings";
+        options.folderName          = "AustrianAudio";
+        options.osxLibrarySubFolder = "Preferences";
+        
+        properties = std::unique_ptr<PropertiesFile>(new PropertiesFile (options));
+    }
+    return *properties;
+}
+
+File PolarDesignerAudioProcessor::getLastDir()
+{
+    if (!lastDirRead)
+    {
+        lastDir = File(getProperties().getValue ("presetFolder"));
+        lastDirRead = true;
+    }
+    return lastDir;
+}
+
+void PolarDesignerAudioProcessor::setLastDir(File newLastDir)
+{
+    lastDir = newLastDir;
+    lastDirRead = true;
+    const var v (lastDir.getFullPathName());
+    getProperties().setValue ("presetFolder", v);
+}
+
+// indexes the preset folder in the background, the index is kept next to the settings file
+void PolarDesignerAudioProcessor::scanPresetLibrary (bool rescan)
+{
+    const File folder = getLastDir();
+    if (!rescan && presetLibrary->getFolder() == folder)
+        return;
+    
+    presetLibrary->scan (folder, getProperties().getFile().getSiblingFile ("PolarDesignerPresets.index"));
+}
+
+Result PolarDesignerAudioProcessor::loadPreset(const File& presetFile)
+{
+    var parsedJson;
+    if (!presetFile.exists())
+        return Result::fail ("File does not exist!");
+    
+    String jsonString = presetFile.loadFileAsString();
+    Result result = JSON::parse (jsonString, parsedJson);
+    if (!result.wasOk())
+        return Result::fail ("File could not be parsed: Please provide valid JSON!");
+    
+    return applyPreset (parsedJson);
+}
+
+// applies an already parsed preset, e.g. one from the preset library
+Result PolarDesignerAudioProcessor::applyPreset (const var& parsedJson)
+{
+    for (auto &it : presetProperties)
+    {
+        if (!parsedJson.hasProperty (it))
+            return Result::fail ("Corrupt preset file: No '" + it + "' property found.");
+    }
+    
+    const ParameterTransaction transaction (*this);
+    loadingFile = true;
+    
+    float x = parsedJson.getProperty ("nrActiveBands", parsedJson);
+    vtsParams.getParameter ("nrBands")->setValueNotifyingHost (vtsParams.getParameter ("nrBands")->convertTo0to1(x - 1));
+    
+    for (int i = 0; i < 4; ++i)
+    {
+        x = parsedJson.getProperty ("xOverF" + String(i+1), parsedJson);
+        vtsParams.getParameter (XOVER_IDS[i])->setValueNotifyingHost (hzToZeroToOne(i, x));
+    }
+    
+    NormalisableRange<float> dfRange = vtsParams.getParameter("alpha1")->getNormalisableRange();
+    
+    for (int i = 0; i < 5; ++i)
+    {
+        x = parsedJson.getProperty ("dirFactor" + String(i+1), parsedJson);
+        if (x < dfRange.start || x > dfRange.end)
+        {
+            loadingFile = false;
+            return Result::fail ("DirFactor" + String(i+1) + " needs to be between " + String(dfRange.start) + " and " + String(dfRange.end) + ".");
+        }
+        vtsParams.getParameter (ALPHA_IDS[i])->setValueNotifyingHost (dfRange.convertTo0to1(x));
+        
+        x = parsedJson.getProperty ("gain" + String(i+1), parsedJson);
+        vtsParams.getParameter (GAIN_IDS[i])->setValueNotifyingHost (vtsParams.getParameter("gain1")->convertTo0to1(x));
+        
+        x = parsedJson.getProperty ("solo" + String(i+1), parsedJson);
+        vtsParams.getParameter (SOLO_IDS[i])->setValueNotifyingHost (vtsParams.getParameter("solo1")->convertTo0to1(x));
+        
+        x = parsedJson.getProperty ("mute" + String(i+1), parsedJson);
+        vtsParams.getParameter (MUTE_IDS[i])->setValueNotifyingHost (vtsParams.getParameter("solo1")->convertTo0to1(x));
+    }
+    
+    doEq = parsedJson.getProperty ("ffDfEq", parsedJson);
+    loadEqualizers();
+    
+    x = parsedJson.getProperty ("proximity", parsedJson);
+    vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(x));
+    
+    loadingFile = false;
+    
+    // set parameters
+    nBands = static_cast<int>(nBandsPtr->load()) + 1;
+    updateEngine();
+    notifyEditor (editorNrBandsChanged | editorRepaintDEQ);
+    
+    return Result::ok();
+}
+
+Result PolarDesignerAudioProcessor::savePreset (File destination)
+{
+    DynamicObject* jsonObj = new DynamicObject();
+    jsonObj->setProperty("Description", var(getPresetDescription()));
     jsonObj->setProperty ("nrActiveBands", nBands);
     jsonObj->setProperty ("xOverF1", static_cast<int>(hzFromZeroToOne(0, xOverFreqs[0]->load())));
     jsonObj->setProperty ("xOverF2", static_cast<int>(hzFromZeroToOne(1, xOverFreqs[1]->load())));
@@ -1063,6 +1931,60 @@ Result PolarDesignerAudioProcessor::savePreset (File destination)
         return Result::fail ("Could not write preset file. Check file access permissions.");
 }
 
+Result PolarDesignerAudioProcessor::optimizeFromStems (const Array<OfflinePatternOptimizer::Stem>& stems, var& preset)
+{
+    OfflinePatternOptimizer::Settings settings;
+    settings.nBands = nBands;
+    for (int i = 0; i < nBands - 1; ++i)
+        settings.xOverFreqs[i] = hzFromZeroToOne(i, xOverFreqs[i]->load());
+    settings.alphaMin = getAlphaStart();
+    settings.filterQuality = getFilterQuality();
+    for (int i = 0; i < 5; ++i)
+    {
+        settings.dirFactors[i] = dirFactors[i]->load();
+        settings.bandGains[i] = bandGains[i]->load();
+        settings.solo[i] = soloBand[i]->load();
+        settings.mute[i] = muteBand[i]->load();
+    }
+    settings.ffDfEq = doEq;
+    settings.proximity = proxDistance->load();
+    settings.description = getPresetDescription();
+    
+    // the filters processBlock applies before the band split
+    if (! getCurrentEngineConfig().zeroDelay)
+    {
+        settings.eqSampleRate = EQ_SAMPLE_RATE;
+        if (doEq == 1)
+        {
+            settings.eqOmni = kernelCache->getImpulseResponse("ffEqOmni", FFEQ_COEFFS_OMNI, FF_EQ_LEN);
+            settings.eqEight = kernelCache->getImpulseResponse("ffEqEight", FFEQ_COEFFS_EIGHT, FF_EQ_LEN);
+        }
+        else if (doEq == 2)
+        {
+            settings.eqOmni = kernelCache->getImpulseResponse("dfEqOmni", DFEQ_COEFFS_OMNI, DF_EQ_LEN);
+            settings.eqEight = kernelCache->getImpulseResponse("dfEqEight", DFEQ_COEFFS_EIGHT, DF_EQ_LEN);
+        }
+        
+        const float distance = proxDistance->load();
+        if (std::abs (distance) > 0.05)
+        {
+            settings.proximityFilter = [distance] (double sampleRate) { return getProxCompCoefficients (distance, sampleRate); };
+            settings.proxOnEight = distance < 0;
+        }
+    }
+    
+    return OfflinePatternOptimizer::process (stems, settings, preset);
+}
+
+String PolarDesignerAudioProcessor::getPresetDescription()
+{
+    char versionString[10];
+    strcpy(versionString, "v");
+    strcat(versionString, JucePlugin_VersionString);
+    return "This preset file was created with the Austrian Audio PolarDesigner plugin "
+           + String(versionString) + ", for more information see www.austrian.audio .";
+}
+
 float PolarDesignerAudioProcessor::hzToZeroToOne(int idx, float hz)
 {
     switch (nBands) {
@@ -1095,7 +2017,12 @@ float PolarDesignerAudioProcessor::hzToZeroToOne(int idx, float hz)
 
 float PolarDesignerAudioProcessor::hzFromZeroToOne(int idx, float val)
 {
-    switch (nBands) {
+    return hzFromZeroToOne(idx, val, nBands);
+}
+
+float PolarDesignerAudioProcessor::hzFromZeroToOne(int idx, float val, int numBands)
+{
+    switch (numBands) {
         case 1:
             return 0;
             break;
@@ -1177,25 +2104,19 @@ float PolarDesignerAudioProcessor::getXoverSliderRangeEnd (int sliderNum)
 
 void PolarDesignerAudioProcessor::startTracking(bool trackDisturber)
 {
-    if (trackDisturber)
-    {
-        trackingDisturber = true;
-        for (int i = 0; i < 5; ++i)
-        {
-            omniSqSumDist[i] = 0.0f;
-            eightSqSumDist[i] = 0.0f;
-            omniEightSumDist[i] = 0.0f;
-        }
-    }
-    else
+    trackingDisturber = trackDisturber;
+    
+    Array<Range<float>> xOverRanges;
+    for (int i = 0; i < nBands - 1; ++i)
+        xOverRanges.add ({getXoverSliderRangeStart (i), getXoverSliderRangeEnd (i)});
+    directivityAnalyzer.startTracking (trackDisturber, nBands, xOverRanges, getAlphaStart());
+    
+    for (int i = 0; i < 5; ++i)
     {
-        trackingDisturber = false;
-        for (int i = 0; i < 5; ++i)
-        {
-            omniSqSumSig[i] = 0.0f;
-            eightSqSumSig[i] = 0.0f;
-            omniEightSumSig[i] = 0.0f;
-        }
+        if (trackDisturber)
+            disturberCov[i].clear();
+        else
+            signalCov[i].clear();
     }
     
     nrBlocksRecorded = 0;
@@ -1205,122 +2126,217 @@ void PolarDesignerAudioProcessor::startTracking(bool trackDisturber)
 void PolarDesignerAudioProcessor::stopTracking(int applyOptimalPattern)
 {
     trackingActive = false;
+    directivityAnalyzer.stopTracking (applyOptimalPattern != 0, applyOptimalPattern == 2);
+    if (applyOptimalPattern == 0)
+        return;
+    
+    // average over all recorded blocks
+    if (nrBlocksRecorded != 0)
+    {
+        for (int i = 0; i < 5; ++i)
+        {
+            if (trackingDisturber)
+                disturberCov[i].scale (1.0f / nrBlocksRecorded);
+            else
+                signalCov[i].scale (1.0f / nrBlocksRecorded);
+        }
+    }
+    
     if (applyOptimalPattern == 1)
     {
         if (trackingDisturber)
-        {
-            if (nrBlocksRecorded != 0)
-            {
-                for (int i = 0; i < 5; ++i)
-                {
-                    omniSqSumDist[i] = omniSqSumDist[i]/nrBlocksRecorded;
-                    eightSqSumDist[i] = eightSqSumDist[i]/nrBlocksRecorded;
-                    omniEightSumDist[i] = omniEightSumDist[i]/nrBlocksRecorded;
-                }
-            }
             setMinimumDisturbancePattern();
-        }
         else
-        {
-            if (nrBlocksRecorded != 0)
-            {
-                for (int i = 0; i < 5; ++i)
-                {
-                    omniSqSumSig[i] = omniSqSumSig[i]/nrBlocksRecorded;
-                    eightSqSumSig[i] = eightSqSumSig[i]/nrBlocksRecorded;
-                    omniEightSumSig[i] = omniEightSumSig[i]/nrBlocksRecorded;
-                }
-            }
             setMaximumSignalPattern();
-        }
     }
     else if (applyOptimalPattern == 2) // max sig-to-dist
     {
         if (trackingDisturber)
-        {
-            if (nrBlocksRecorded != 0)
-            {
-                for (int i = 0; i < 5; ++i)
-                {
-                    omniSqSumDist[i] = omniSqSumDist[i]/nrBlocksRecorded;
-                    eightSqSumDist[i] = eightSqSumDist[i]/nrBlocksRecorded;
-                    omniEightSumDist[i] = omniEightSumDist[i]/nrBlocksRecorded;
-                }
-            }
             disturberRecorded = true;
-        }
         else
-        {
-            if (nrBlocksRecorded != 0)
-            {
-                for (int i = 0; i < 5; ++i)
-                {
-                    omniSqSumSig[i] = omniSqSumSig[i]/nrBlocksRecorded;
-                    eightSqSumSig[i] = eightSqSumSig[i]/nrBlocksRecorded;
-                    omniEightSumSig[i] = omniEightSumSig[i]/nrBlocksRecorded;
-                }
-            }
             signalRecorded = true;
-        }
+        
         maximizeSigToDistRatio();
     }
 }
 
-void PolarDesignerAudioProcessor::trackSignalEnergy()
+void PolarDesignerAudioProcessor::computeBandCovariances (int nActiveBands, int numSamples)
 {
-    int numSamples = filterBankBuffer.getNumSamples();
-    for (int i = 0; i < nBands; ++i)
+    for (int i = 0; i < nActiveBands; ++i)
+        blockCov[i].setFromBlock (filterBankBuffer.getReadPointer (2*i), filterBankBuffer.getReadPointer (2*i+1), numSamples);
+}
+
+void PolarDesignerAudioProcessor::trackSignalEnergy (int nActiveBands)
+{
+    for (int i = 0; i < nActiveBands; ++i)
     {
-        const float* readPointerOmni = filterBankBuffer.getReadPointer (2*i);
-        const float* readPointerEight = filterBankBuffer.getReadPointer (2*i+1);
         if (trackingDisturber)
+            disturberCov[i].add (blockCov[i]);
+        else
+            signalCov[i].add (blockCov[i]);
+    }
+    ++nrBlocksRecorded;
+}
+
+void PolarDesignerAudioProcessor::updateAdaptivePatterns (int nActiveBands, int numSamples)
+{
+    if (!adaptiveModeActive())
+    {
+        adaptiveWasActive = false;
+        adaptivePatternsPublished = false;
+        return;
+    }
+    
+    if (!adaptiveWasActive) // start from the current patterns
+    {
+        for (int i = 0; i < 5; ++i)
         {
-            for (int j = 0; j < numSamples; ++j)
-            {
-                float omniSample = readPointerOmni[j];
-                omniSqSumDist[i] += omniSample * omniSample / numSamples;
-                float eightSample = readPointerEight[j];
-                eightSqSumDist[i] += eightSample * eightSample / numSamples;
-                omniEightSumDist[i] += omniSample * eightSample / numSamples;
-            }
+            adaptiveCov[i].clear();
+            adaptiveDirFactors[i] = dirFactors[i]->load();
+        }
+        adaptiveWasActive = true;
+        adaptivePatternsPublished = true;
+    }
+    
+    const float blockDuration = numSamples / static_cast<float> (currentSampleRate);
+    const float smoothingCoeff = std::exp (-blockDuration / adaptiveTime->load());
+    const float maxStep = ADAPTIVE_MAX_ALPHA_RATE * blockDuration;
+    const bool maximizeRatio = adaptiveMode->load() > 1.5f && signalRecorded; // minimizes spill until a target is recorded
+    const float alphaStart = getAlphaStart();
+    const float range = adaptiveRange->load();
+    
+    for (int i = 0; i < 5; ++i)
+    {
+        const float userAlpha = dirFactors[i]->load();
+        if (i >= nActiveBands)
+        {
+            adaptiveDirFactors[i] = userAlpha;
+            continue;
+        }
+        
+        // stay within the user defined range around the band's directivity factor
+        const float alphaMin = jmax (jmin (alphaStart, userAlpha), userAlpha - range);
+        const float alphaMax = jmin (1.0f, userAlpha + range);
+        const float currentAlpha = jlimit (alphaMin, alphaMax, adaptiveDirFactors[i].get());
+        
+        adaptiveCov[i].smooth (blockCov[i], smoothingCoeff);
+        
+        // hold the current pattern if there is no signal
+        if (adaptiveCov[i].omniSq + adaptiveCov[i].eightSq < 1.0e-10f)
+        {
+            adaptiveDirFactors[i] = currentAlpha;
+            continue;
+        }
+        
+        /* The live covariance holds target and spill, the recorded spill would not adapt. With a target of the
+           recorded direction, its pattern power P_s scales with the recording by some g and the live power is
+           g P_s + P_d, so P_s / (g P_s + P_d) = 1 / (g + P_d / P_s) has its maximum where the target-to-spill
+           ratio P_s / P_d has it, whatever the target's level. */
+        const float targetAlpha = maximizeRatio ? PatternOptimizer::findMaximumRatioAlpha (signalCov[i], adaptiveCov[i], alphaMin, alphaMax)
+                                                : PatternOptimizer::findMinimumPowerAlpha (adaptiveCov[i], alphaMin, alphaMax);
+        
+        // rate limited update
+        adaptiveDirFactors[i] = currentAlpha + jlimit (-maxStep, maxStep, targetAlpha - currentAlpha);
+    }
+}
+
+void PolarDesignerAudioProcessor::measureLevels (const AudioBuffer<float>& buffer, int nActiveBands, int numSamples)
+{
+    for (int i = 0; i < nActiveBands; ++i)
+    {
+        BandLevels& band = meterSums.bands[i];
+        const float gain = Decibels::decibelsToGain (bandGains[i]->load(), -59.91f);
+        
+        band.omniRms += blockCov[i].omniSq * numSamples;
+        band.eightRms += blockCov[i].eightSq * numSamples;
+        band.outputRms += gain * gain * blockCov[i].getPatternPower (getEffectiveDirFactor (i)) * numSamples;
+        band.omniPeak = jmax (band.omniPeak, LevelMeasurement::getPeak (filterBankBuffer.getReadPointer (2*i), numSamples));
+        band.eightPeak = jmax (band.eightPeak, LevelMeasurement::getPeak (filterBankBuffer.getReadPointer (2*i+1), numSamples));
+    }
+    /* direction of arrival: for a plane wave from theta, eight = cos(theta) * omni, so the
+       normalized cross-correlation gives cos(theta) and the coherence gives its reliability */
+    const float arrivalCoeff = std::exp (-numSamples / (ARRIVAL_TIME_CONSTANT * static_cast<float> (currentSampleRate)));
+    for (int i = 0; i < nActiveBands; ++i)
+        arrivalCov[i].smooth (blockCov[i], arrivalCoeff);
+    
+    meterSums.outputRms += LevelMeasurement::getSumOfSquares (buffer.getReadPointer (0), numSamples);
+    meterSums.outputPeak = jmax (meterSums.outputPeak, LevelMeasurement::getPeak (buffer.getReadPointer (0), numSamples));
+    meterSamples += numSamples;
+    
+    if (meterSamples < currentSampleRate / METER_UPDATE_RATE)
+        return;
+    
+    // publish and start over
+    LevelSnapshot& snapshot = levelSnapshots.getWriteBuffer();
+    for (int i = 0; i < 5; ++i)
+    {
+        const BandLevels& sums = meterSums.bands[i];
+        BandLevels& levels = snapshot.bands[i];
+        levels.omniRms = std::sqrt (sums.omniRms / meterSamples);
+        levels.eightRms = std::sqrt (sums.eightRms / meterSamples);
+        levels.outputRms = std::sqrt (sums.outputRms / meterSamples);
+        levels.omniPeak = sums.omniPeak;
+        levels.eightPeak = sums.eightPeak;
+        
+        const BandCovariance& cov = arrivalCov[i];
+        if (i < nActiveBands && cov.omniSq > 1.0e-10f && cov.eightSq > 1.0e-10f)
+        {
+            levels.arrivalCos = jlimit (-1.0f, 1.0f, cov.omniEight / cov.omniSq);
+            levels.arrivalConfidence = jlimit (0.0f, 1.0f, cov.omniEight * cov.omniEight / (cov.omniSq * cov.eightSq));
         }
         else
         {
-            for (int j = 0; j < numSamples; ++j)
-            {
-                float omniSample = readPointerOmni[j];
-                omniSqSumSig[i] += omniSample * omniSample / numSamples;
-                float eightSample = readPointerEight[j];
-                eightSqSumSig[i] += eightSample * eightSample / numSamples;
-                omniEightSumSig[i] += omniSample * eightSample / numSamples;
-            }
+            levels.arrivalCos = 1.0f;
+            levels.arrivalConfidence = 0.0f;
         }
     }
-    ++nrBlocksRecorded;
+    snapshot.outputRms = std::sqrt (meterSums.outputRms / meterSamples);
+    snapshot.outputPeak = meterSums.outputPeak;
+    snapshot.nActiveBands = nActiveBands;
+    const bool wakeEditor = !snapshot.isSilent() && liveDataRequested.compareAndSetBool (false, true);
+    levelSnapshots.publish();
+    
+    // posts a message, but only once after the editor went idle
+    if (wakeEditor)
+        notifyEditor (editorLiveData);
+    
+    meterSums = LevelSnapshot();
+    meterSamples = 0;
+}
+
+float PolarDesignerAudioProcessor::getAlphaStart()
+{
+    return allowBackwardsPattern->load() == 1.0f ? -0.5f : 0.0f;
+}
+
+float PolarDesignerAudioProcessor::getEffectiveDirFactor (int band)
+{
+    return adaptiveWasActive ? adaptiveDirFactors[band].get() : dirFactors[band]->load();
+}
+
+// the adaptive patterns once the audio thread has started them from the parameters
+float PolarDesignerAudioProcessor::getPublishedDirFactor (int band)
+{
+    return adaptivePatternsPublished.get() ? adaptiveDirFactors[band].get() : dirFactors[band]->load();
+}
+
+// false for muted bands and for the bands that aren't soloed while another one is
+bool PolarDesignerAudioProcessor::isBandAudible (int band)
+{
+    return !((muteBand[band]->load() > 0.5 && soloBand[band]->load() < 0.5) || (soloActive && soloBand[band]->load() < 0.5));
 }
 
 void PolarDesignerAudioProcessor::setMinimumDisturbancePattern()
 {
-    float disturberPower;
-    float minPowerAlpha;
-    float alphaStart = 0.0f;
-    if (allowBackwardsPattern->load() == 1.0f)
-        alphaStart = -0.5f;
+    const float alphaStart = getAlphaStart();
     
     for (int i = 0; i<nBands; ++i)
     {
-        for (float alpha = alphaStart; alpha <= 1.0f; alpha += 0.01f)
-        {
-            float currentPower = std::pow((1-std::abs(alpha)), 2) * omniSqSumDist[i] + std::pow(alpha, 2) * eightSqSumDist[i] + 2 * (1-std::abs(alpha)) * alpha * omniEightSumDist[i];
-            if (alpha == alphaStart || currentPower < disturberPower)
-            {
-                disturberPower = currentPower;
-                minPowerAlpha = alpha;
-            }
-        }
+        float disturberPower;
+        float minPowerAlpha = PatternOptimizer::findMinimumPowerAlpha (disturberCov[i], alphaStart, 1.0f, &disturberPower);
         if (disturberPower != 0.0f) // do not apply changes, if playback is not active
         {
-            vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("alpha1")->convertTo0to1 (minPowerAlpha));
+            vtsParams.getParameter (ALPHA_IDS[i])->setValueNotifyingHost (vtsParams.getParameter("alpha1")->convertTo0to1 (minPowerAlpha));
             disturberRecorded = true;
         }
     }
@@ -1328,26 +2344,15 @@ void PolarDesignerAudioProcessor::setMinimumDisturbancePattern()
 
 void PolarDesignerAudioProcessor::setMaximumSignalPattern()
 {
-    float signalPower;
-    float maxPowerAlpha;
-    float alphaStart = 0.0f;
-    if (allowBackwardsPattern->load() == 1.0f)
-        alphaStart = -0.5f;
+    const float alphaStart = getAlphaStart();
     
     for (int i = 0; i < nBands; ++i)
     {
-        for (float alpha = alphaStart; alpha <= 1.0f; alpha += 0.01f)
-        {
-            float currentPower = std::pow((1-std::abs(alpha)), 2) * omniSqSumSig[i] + std::pow(alpha, 2) * eightSqSumSig[i] + 2 * (1-std::abs(alpha)) * alpha * omniEightSumSig[i];
-            if (alpha == alphaStart || currentPower > signalPower)
-            {
-                signalPower = currentPower;
-                maxPowerAlpha = alpha;
-            }
-        }
+        float signalPower;
+        float maxPowerAlpha = PatternOptimizer::findMaximumPowerAlpha (signalCov[i], alphaStart, 1.0f, &signalPower);
         if (signalPower != 0.0f)
         {
-            vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("alpha1")->convertTo0to1 (maxPowerAlpha));
+            vtsParams.getParameter (ALPHA_IDS[i])->setValueNotifyingHost (vtsParams.getParameter("alpha1")->convertTo0to1 (maxPowerAlpha));
             signalRecorded = true;
         }
     }
@@ -1355,39 +2360,26 @@ void PolarDesignerAudioProcessor::setMaximumSignalPattern()
 
 void PolarDesignerAudioProcessor::maximizeSigToDistRatio()
 {
-    float distToSigRatio;
-    float maxDistToSigAlpha;
-    float alphaStart = 0.0f;
-    if (allowBackwardsPattern->load() == 1.0f)
-        alphaStart = -0.5f;
+    const float alphaStart = getAlphaStart();
     
     for (int i = 0; i<nBands; ++i)
     {
-        for (float alpha = alphaStart; alpha <= 1.0f; alpha += 0.01f)
-        {
-            float currentSigPower = std::pow((1-std::abs(alpha)), 2) * omniSqSumSig[i] + std::pow(alpha, 2) * eightSqSumSig[i] + 2 * (1-std::abs(alpha)) * alpha * omniEightSumSig[i];
-            float currentDistPower = std::pow((1-std::abs(alpha)), 2) * omniSqSumDist[i] + std::pow(alpha, 2) * eightSqSumDist[i] + 2 * (1-std::abs(alpha)) * alpha * omniEightSumDist[i];
-            float currentRatio;
-            if (currentDistPower == 0.0f)
-                currentRatio = 0.0f;
-            else
-                currentRatio = currentSigPower/currentDistPower;
-            
-            if (alpha == alphaStart || currentRatio > distToSigRatio)
-            {
-                distToSigRatio = currentRatio;
-                maxDistToSigAlpha = alpha;
-            }
-        }
-        if (distToSigRatio != 0.0f)
-            vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (vtsParams.getParameter("alpha1")->convertTo0to1 (maxDistToSigAlpha));
+        float sigToDistRatio;
+        float maxSigToDistAlpha = PatternOptimizer::findMaximumRatioAlpha (signalCov[i], disturberCov[i], alphaStart, 1.0f, &sigToDistRatio);
+        if (sigToDistRatio != 0.0f)
+            vtsParams.getParameter (ALPHA_IDS[i])->setValueNotifyingHost (vtsParams.getParameter("alpha1")->convertTo0to1 (maxSigToDistAlpha));
     }
 }
 
 void PolarDesignerAudioProcessor::setProxCompCoefficients(float distance)
+{
+    *proxCompIIR.coefficients = getProxCompCoefficients (distance, getSampleRate());
+}
+
+// first order shelf of the proximity compensation, also evaluated by the heatmap on the message thread
+dsp::IIR::Coefficients<float> PolarDesignerAudioProcessor::getProxCompCoefficients (float distance, double fs)
 {
     int c = 343;
-    double fs = getSampleRate();
     
     //    float b0 = -c / (fs * 4 * distance) + 1;
     //    float b1 = -exp(-c / (fs * 2 * distance)) * (1 + c / (fs * 4 * distance));
@@ -1424,13 +2416,28 @@ void PolarDesignerAudioProcessor::setProxCompCoefficients(float distance)
         a1 = -exp(-c / fs);
     }
     
-    *proxCompIIR.coefficients = dsp::IIR::Coefficients<float>(b0,b1,a0,a1);
+    return dsp::IIR::Coefficients<float>(b0,b1,a0,a1);
 }
 
 void PolarDesignerAudioProcessor::timerCallback()
 {
+    flushPendingCrossovers();
+    
+    // a configuration change arrived while the engines were busy
+    if (engineUpdatePending)
+        startEngineUpdate();
+    
+    // scenes stored while their engine was in use
+    for (int i = 0; i < N_SCENES; ++i)
+        if (sceneDesignsPending & (1 << i))
+            startSceneDesign (i);
+    
+    if (morphDesignPending)
+        startMorphDesign();
+    
     if (syncChannelPtr->load() > 0.5f)
     {
+        const ParameterTransaction transaction (*this);
         readingSharedParams = true;
         
         int ch = (int) syncChannelPtr->load() - 1;
@@ -1442,19 +2449,19 @@ void PolarDesignerAudioProcessor::timerCallback()
         for (int i = 0; i < 5; ++i)
         {
             if (dirFactors[i]->load() != paramsToSync.dirFactors[i])
-                vtsParams.getParameter ("alpha" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("alpha" + String(i+1)).convertTo0to1 (paramsToSync.dirFactors[i]));
+                vtsParams.getParameter (ALPHA_IDS[i])->setValueNotifyingHost (vtsParams.getParameterRange (ALPHA_IDS[i]).convertTo0to1 (paramsToSync.dirFactors[i]));
             
             if (soloBand[i]->load() != paramsToSync.solo[i])
-                vtsParams.getParameter ("solo" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("solo" + String(i+1)).convertTo0to1 (paramsToSync.solo[i]));
+                vtsParams.getParameter (SOLO_IDS[i])->setValueNotifyingHost (vtsParams.getParameterRange (SOLO_IDS[i]).convertTo0to1 (paramsToSync.solo[i]));
             
             if (muteBand[i]->load() != paramsToSync.mute[i])
-                vtsParams.getParameter ("mute" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("mute" + String(i+1)).convertTo0to1 (paramsToSync.mute[i]));
+                vtsParams.getParameter (MUTE_IDS[i])->setValueNotifyingHost (vtsParams.getParameterRange (MUTE_IDS[i]).convertTo0to1 (paramsToSync.mute[i]));
             
             if (bandGains[i]->load() != paramsToSync.gains[i])
-                vtsParams.getParameter ("gain" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("gain" + String(i+1)).convertTo0to1 (paramsToSync.gains[i]));
+                vtsParams.getParameter (GAIN_IDS[i])->setValueNotifyingHost (vtsParams.getParameterRange (GAIN_IDS[i]).convertTo0to1 (paramsToSync.gains[i]));
             
             if (i < 4 && xOverFreqs[i]->load() != paramsToSync.xOverFreqs[i])
-                vtsParams.getParameter ("xOverF" + String(i+1))->setValueNotifyingHost (vtsParams.getParameterRange ("xOverF" + String(i+1)).convertTo0to1 (paramsToSync.xOverFreqs[i]));
+                vtsParams.getParameter (XOVER_IDS[i])->setValueNotifyingHost (vtsParams.getParameterRange (XOVER_IDS[i]).convertTo0to1 (paramsToSync.xOverFreqs[i]));
             
             
         }
@@ -1471,11 +2478,97 @@ void PolarDesignerAudioProcessor::timerCallback()
         if (paramsToSync.ffDfEq != doEq)
         {
             setEqState(paramsToSync.ffDfEq);
-            ffDfEqChanged = true;
+            notifyEditor (editorEqModeChanged);
         }
         
         readingSharedParams = false;
     }
+    else if (!isTimerNeeded())
+    {
+        stopTimer();
+    }
+}
+
+void PolarDesignerAudioProcessor::readCurrentLayerState (PluginStateFormat::Layer& state)
+{
+    state.numValues = N_STATE_PARAMS;
+    for (int i = 0; i < N_STATE_PARAMS; ++i)
+        state.values[i] = stateParams[i]->load();
+}
+
+// a layer read from a host blob is padded with the current values and limited to the parameter ranges,
+// so a short or corrupt scene can't be used with undefined values
+void PolarDesignerAudioProcessor::sanitizeLayerState (PluginStateFormat::Layer& state)
+{
+    if (state.numValues == 0)
+        return;
+    
+    for (int i = 0; i < N_STATE_PARAMS; ++i)
+    {
+        RangedAudioParameter* param = vtsParams.getParameter (STATE_PARAM_IDS[i]);
+        if (i >= state.numValues)
+            state.values[i] = stateParams[i]->load();
+        else if (!std::isfinite (state.values[i]))
+            state.values[i] = param->convertFrom0to1 (param->getDefaultValue());
+        else
+            state.values[i] = param->getNormalisableRange().snapToLegalValue (state.values[i]);
+    }
+    state.numValues = N_STATE_PARAMS;
+    state.ffDfEq = jlimit (0, 2, state.ffDfEq);
+    if (!std::isfinite (state.oldProxDistance))
+        state.oldProxDistance = 0.0f;
+}
+
+// reads the parameter values of a stored layer without copying it, unused layers have no values
+void PolarDesignerAudioProcessor::readLayerState (const ValueTree& layer, PluginStateFormat::Layer& state)
+{
+    static const Identifier idId ("id");
+    static const Identifier valueId ("value");
+    
+    state.numValues = 0;
+    if (layer.getNumChildren() == 0)
+        return;
+    
+    for (int i = 0; i < N_STATE_PARAMS; ++i)
+        state.values[i] = stateParams[i]->load();
+    
+    for (const auto& param : layer)
+    {
+        const var& id = param.getProperty (idId);
+        for (int i = 0; i < N_STATE_PARAMS; ++i)
+        {
+            if (id.toString() == STATE_PARAM_IDS[i])
+            {
+                state.values[i] = param.getProperty (valueId);
+                break;
+            }
+        }
+    }
+    state.numValues = N_STATE_PARAMS;
+}
+
+ValueTree PolarDesignerAudioProcessor::createLayerTree (const PluginStateFormat::Layer& state, const Identifier& type)
+{
+    ValueTree tree (type);
+    if (state.numValues > 0)
+    {
+        // values of a newer version beyond the known parameters are left out
+        tree.copyPropertiesAndChildrenFrom (vtsParams.copyState(), nullptr);
+        for (auto param : tree)
+        {
+            for (int i = 0; i < jmin (state.numValues, N_STATE_PARAMS); ++i)
+            {
+                if (param.getProperty ("id").toString() == STATE_PARAM_IDS[i])
+                {
+                    param.setProperty ("value", state.values[i], nullptr);
+                    break;
+                }
+            }
+        }
+    }
+    tree.setProperty ("ffDfEq", var (state.ffDfEq), nullptr);
+    tree.setProperty ("oldProxDistance", var (state.oldProxDistance), nullptr);
+    return tree;
 }
 
 void PolarDesignerAudioProcessor::updateLatency() {
@@ -1485,18 +2578,36 @@ void PolarDesignerAudioProcessor::updateLatency() {
     }
     else
     {
-        // set delay compensation to FIR_LEN/2-1 if FIR_LEN even and FIR_LEN/2 if odd
-        if (zeroDelayMode->load() < 0.5f)
-            setLatencySamples(std::ceilf(static_cast<float>(firLen) / 2 - 1));
-        else
-            setLatencySamples(0);
+        setLatencySamples(getEngineLatency());
     }
 }
 
+// set delay compensation to FIR_LEN/2-1 if FIR_LEN even and FIR_LEN/2 if odd
+int PolarDesignerAudioProcessor::getFilterBankLatency()
+{
+    return getFilterBankLatency(firLen);
+}
+
+int PolarDesignerAudioProcessor::getFilterBankLatency (int filterLength)
+{
+    return static_cast<int>(std::ceilf(static_cast<float>(filterLength) / 2 - 1));
+}
+
+// while the engines are crossfaded, the one with lower latency is delayed to match the other
+int PolarDesignerAudioProcessor::getEngineLatency()
+{
+    const int active = activeEngine.get();
+    if (engineState.get() == engineFading)
+        return jmax(engines[active].getLatency(), engines[spareEngine.get()].getLatency());
+    
+    return engines[active].getLatency();
+}
+
 void PolarDesignerAudioProcessor::changeAbLayerState()
 {
+    const ParameterTransaction transaction (*this);
     abLayerChanged = true;
-    ffDfEqChanged = true;
+    notifyEditor (editorEqModeChanged);
     if (abLayerState == 0)
     {
         layerA = vtsParams.copyState();
@@ -1522,8 +2633,13 @@ void PolarDesignerAudioProcessor::changeAbLayerState()
         zeroDelayModeActive() ? oldProxDistance = 0 : oldProxDistance = oldProxDistanceA;
     }
     vtsParams.state.setProperty("ffDfEq", var(doEq), nullptr);
+    loadEqualizers();
     vtsParams.getParameter ("proximity")->setValueNotifyingHost (vtsParams.getParameter("proximity")->convertTo0to1(oldProxDistance));
+    keepCurrentScene();
     abLayerChanged = false;
+    
+    // the morph blends towards the layer which has just become inactive
+    startMorphDesign();
 }
 
 //==============================================================================
@@ -28,6 +28,18 @@
 #include <memory> // for unique_ptr
 #include <math.h>
 #include "../resources/Delay.h"
+#include "../resources/PatternOptimization.h"
+#include "../resources/DirectivityAnalyzer.h"
+#include "../resources/FilterBankDesign.h"
+#include "../resources/FilterBankEngine.h"
+#include "../resources/KernelCache.h"
+#include "../resources/ConvolutionLoader.h"
+#include "../resources/PluginStateFormat.h"
+#include "../resources/PresetLibrary.h"
+#include "../resources/OfflinePatternOptimizer.h"
+#include "../resources/SnapshotBuffer.h"
+#include "../resources/SpectrumAnalyzer.h"
+#include "../resources/DirectivityHeatmap.h"
 
 // these params can be synced between plugin instances
 struct ParamsToSync {
@@ -51,7 +63,7 @@ struct SharedParams {
 //==============================================================================
 /**
 */
-class PolarDesignerAudioProcessor  : public AudioProcessor, public AudioProcessorValueTreeState::Listener, private Timer
+class PolarDesignerAudioProcessor  : public AudioProcessor, public AudioProcessorValueTreeState::Listener, private Timer, private AsyncUpdater
 {
 public:
     //==============================================================================
@@ -91,14 +103,36 @@ public:
     void getStateInformation (MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
     
+    //==============================================================================
+    // batches parameter changes (preset recall, A/B switch, sync): the filter bank is redesigned once,
+    // when the outermost transaction ends, instead of after every single parameter
+    class ParameterTransaction
+    {
+    public:
+        explicit ParameterTransaction (PolarDesignerAudioProcessor& p) : processor (p) { processor.beginParameterTransaction(); }
+        ~ParameterTransaction() { processor.endParameterTransaction(); }
+        
+    private:
+        PolarDesignerAudioProcessor& processor;
+        JUCE_DECLARE_NON_COPYABLE (ParameterTransaction)
+    };
+    
+    void beginParameterTransaction();
+    void endParameterTransaction();
+    
     //==============================================================================
     void parameterChanged (const String &parameterID, float newValue) override;
     
     //==============================================================================
     Result loadPreset (const File& presetFile);
+    Result applyPreset (const var& preset);
     Result savePreset (File destination);
-    File getLastDir() {return lastDir;}
+    // computes the terminator patterns from recorded stems with the current settings, blocking
+    Result optimizeFromStems (const Array<OfflinePatternOptimizer::Stem>& stems, var& preset);
+    File getLastDir();
     void setLastDir(File newLastDir);
+    PresetLibrary& getPresetLibrary() { return *presetLibrary; }
+    void scanPresetLibrary (bool rescan);
     
     void startTracking(bool trackDisturber);
     void stopTracking(int applyOptimalPattern);
@@ -107,12 +141,37 @@ public:
     int getSyncChannelIdx() {return static_cast<int>(*syncChannelPtr) + 1;}
     float getXoverSliderRangeStart (int sliderNum);
     float getXoverSliderRangeEnd (int sliderNum);
-    Atomic<bool> repaintDEQ = true;
-    Atomic<bool> didNRActiveBandsChange = true;
-    Atomic<bool> zeroDelayModeChanged = true;
-    Atomic<bool> ffDfEqChanged = true;
+    
+    // changes the editor has to follow, coalesced into one change message and read on its next display frame
+    enum EditorChange
+    {
+        editorRepaintDEQ = 1,
+        editorNrBandsChanged = 2,
+        editorZeroDelayModeChanged = 4,
+        editorEqModeChanged = 8,
+        editorLiveData = 16, // meters or analysis results after the editor went idle
+        editorResponseChanged = 32, // gains, mute and solo, proximity, eq or filter quality
+        editorAllChanges = 63
+    };
+    ChangeBroadcaster& getEditorNotifier() { return editorNotifier; }
+    int getEditorChanges() { return editorChanges.exchange (0); }
+    // the audio thread wakes the idle editor once it has something to show again
+    void requestLiveDataNotification() { liveDataRequested = true; }
     bool getDisturberRecorded() {return disturberRecorded;}
     bool getSignalRecorded() {return signalRecorded;}
+    bool adaptiveModeActive() { return adaptiveMode->load() > 0.5f; }
+    float getAdaptiveDirFactor (int band) { return adaptiveDirFactors[band].get(); }
+    DirectivityAnalyzer& getDirectivityAnalyzer() { return directivityAnalyzer; }
+    
+    // meters are only computed while an editor is showing
+    void setMeteringEnabled (bool enabled) { meteringEnabled = enabled; }
+    SnapshotBuffer<LevelSnapshot>& getLevelSnapshots() { return levelSnapshots; }
+    SpectrumAnalyzer& getSpectrumAnalyzer() { return spectrumAnalyzer; }
+    
+    // scenes hold parameter snapshots, their filter banks are designed in advance so recalling one is a crossfade
+    static constexpr int N_SCENES = 8;
+    void storeScene (int scene); // 1...N_SCENES
+    bool isSceneStored (int scene) { return scenes[scene - 1].params.numValues > 0; }
     
     void changeAbLayerState();
     bool abLayerState = 1; // 1 = A is active, 0 = B is active
@@ -131,8 +190,6 @@ public:
     float oldProxDistanceB = 0;
     Atomic<bool> abLayerChanged = false;
     
-    bool convolversReady;
-    
     // initial xover frequencies for several numbers of bands
     const float INIT_XOVER_FREQS_2B[1] = {1000.0f};
     const float INIT_XOVER_FREQS_3B[2] = {250.0f,3000.0f};
@@ -154,9 +211,15 @@ public:
     void setAbLayer(bool state);
     float hzToZeroToOne(int idx, float hz);
     float hzFromZeroToOne(int idx, float val);
+    float hzFromZeroToOne(int idx, float val, int numBands);
     bool zeroDelayModeActive() { return zeroDelayMode->load() > 0.5f; }
+    // the filter bank of the current parameters is designed, loaded and faded in, message thread
+    bool isFilterBankSettled();
+    // filter bank, equalization, proximity compensation and patterns as processed, message thread
+    DirectivityHeatmap::Settings getHeatmapSettings();
     
     void timerCallback() override;
+    void handleAsyncUpdate() override;
     
 private:
     //==============================================================================
@@ -172,23 +235,137 @@ private:
     // use odd FIR_LEN for even filter order (FIR_LEN = N+1)
     // (lowpass and highpass need even filter order to put a zero at f=0 and f=pi)
     int firLen;
+    
+    SharedResourcePointer<ConvolutionLoader> convolutionLoader; // one loader thread for all convolvers
         
     // free field / diffuse field eq
     dsp::Convolution dfEqOmniConv;
     dsp::Convolution dfEqEightConv;
-    AudioBuffer<float> dfEqOmniBuffer;
-    AudioBuffer<float> dfEqEightBuffer;
+    KernelCache::Kernel dfEqOmniKernel;
+    KernelCache::Kernel dfEqEightKernel;
     dsp::Convolution ffEqOmniConv;
     dsp::Convolution ffEqEightConv;
-    AudioBuffer<float> ffEqOmniBuffer;
-    AudioBuffer<float> ffEqEightBuffer;
+    KernelCache::Kernel ffEqOmniKernel;
+    KernelCache::Kernel ffEqEightKernel;
+    bool dfEqLoaded = false; // the eq tables are only loaded once they are selected
+    bool ffEqLoaded = false;
+    
+    // eq of the inactive layer while morphing
+    dsp::Convolution morphEqOmniConv;
+    dsp::Convolution morphEqEightConv;
+    int morphEqLoaded = 0;
     
     // proximity compensation filter
     dsp::IIR::Filter<float> proxCompIIR;
     
-    // delay (in case of 1 active band)
-    Delay delay;
-    AudioBuffer<float> delayBuffer;
+    // configuration of an engine, captured on the message thread
+    struct EngineConfig
+    {
+        int nBands = 1;
+        bool zeroDelay = false;
+        int firLen = 0;
+        int latency = 0;
+        double sampleRate = 48000.0;
+        float xOverHz[4] = {};
+    };
+    
+    // filter bank engines: a new configuration is built in the spare engine and crossfaded in,
+    // engines 0 and 1 take turns for parameter changes, the ones behind them belong to the scenes
+    // and the last two to the inactive layer for morphing
+    enum EngineState { engineIdle, engineDesigning, engineLoading, engineFading };
+    static bool spareEngineRunning (int state) { return state == engineLoading || state == engineFading; }
+    static constexpr int SCENE_ENGINE_OFFSET = 2;
+    static constexpr int MORPH_ENGINE = SCENE_ENGINE_OFFSET + N_SCENES;
+    static constexpr int N_MORPH_ENGINES = 2;
+    static constexpr int N_ENGINES = MORPH_ENGINE + N_MORPH_ENGINES;
+    FilterBankEngine engines[N_ENGINES];
+    EngineConfig engineConfigs[N_ENGINES]; // what each engine is configured with
+    Atomic<int> activeEngine = 0;
+    Atomic<int> spareEngine = 1;
+    Atomic<int> engineState = engineIdle;
+    bool engineUpdatePending = false;
+    bool enginesPrepared = false; // nothing is designed before the sample rate is known
+    std::atomic<int> pendingCrossovers {0}; // bit mask of changed crossover frequencies
+    Atomic<int> parameterTransactionDepth = 0;
+    /* startSpareEngine() sets these and the alignment below before it publishes engineLoading. It runs on the
+       design pool after engineDesigning, or on the audio thread which recalls a scene after engineIdle, and the
+       audio thread only reads them once it has observed engineLoading. */
+    int engineSettleSamples = 0;
+    int engineFadePosition = 0;
+    int engineFadeLength = 1;
+    int engineLoadingSamples = 0; // since the spare engine started loading its kernels
+    Atomic<bool> engineReloadRequested = false; // the kernels are posted again by handleAsyncUpdate()
+    
+    class EngineDesignJob : public ThreadPoolJob
+    {
+    public:
+        EngineDesignJob (PolarDesignerAudioProcessor& p) : ThreadPoolJob ("EngineDesignJob"), processor (p) {}
+        
+        JobStatus runJob() override
+        {
+            if (scene < 0)
+                processor.designSpareEngine (config);
+            else if (scene < N_SCENES)
+                processor.designSceneEngine (scene, config);
+            else
+                processor.designMorphEngine (scene - N_SCENES, config);
+            return jobHasFinished;
+        }
+        
+        EngineConfig config;
+        int scene = -1; // the spare engine is designed if negative, a morph engine from N_SCENES on
+        
+    private:
+        PolarDesignerAudioProcessor& processor;
+    };
+    
+    SharedResourcePointer<EngineDesignPool> designPool;
+    EngineDesignJob designJob {*this};
+    
+    // parked scene and morph engines: the audio thread takes ready ones, the message thread only designs engines which are not in use
+    enum EngineUse { engineEmpty, engineReady, engineInUse };
+    // the part of a scene the audio thread uses before its parameters are applied
+    struct ScenePatterns
+    {
+        bool stored = false;
+        float dirFactors[5] = {};
+        float gains[5] = {};
+    };
+    struct Scene
+    {
+        PluginStateFormat::Layer params; // message thread, no values if the scene is empty
+        SnapshotBuffer<ScenePatterns> patterns; // published by setScene(), read by the audio thread
+        Atomic<int> engineUse = engineEmpty;
+    };
+    Scene scenes[N_SCENES];
+    OwnedArray<EngineDesignJob> sceneDesignJobs;
+    int sceneDesignsPending = 0; // bit mask of scenes whose engine was in use when they were stored
+    Atomic<int> requestedScene = 0; // 0: off
+    Atomic<int> currentScene = 0;
+    Atomic<int> scenePending = 0; // recalled on the audio thread, parameters not yet applied
+    
+    // the inactive layer runs in one of two engines while morphing, its output is blended in. A new design goes
+    // to the engine which isn't heard, the old one keeps running until the new one has settled and is crossfaded out
+    struct MorphLayer
+    {
+        Atomic<int> engineUse = engineEmpty; // held by the audio thread while heard or faded out
+        float dirFactors[5] = {}; // of the inactive layer, set while the engine is not in use
+        float gains[5] = {};
+        int eq = 0;
+        int settleSamples = 0; // audio thread
+    };
+    MorphLayer morphLayers[N_MORPH_ENGINES];
+    EngineDesignJob morphDesignJob {*this};
+    Atomic<int> newestMorphLayer = -1; // designed last, taken over by the audio thread, -1 without inactive layer
+    bool morphDesignPending = false; // both engines were in use, timerCallback() tries again
+    int morphLayer = -1; // audio thread: engine of the inactive layer, -1 if none is held
+    int fadingMorphLayer = -1; // audio thread: previous engine, faded out once morphLayer has settled
+    int morphLayerFadePosition = 0;
+    float oldMorphWeight = 0.0f;
+    
+    // delays the output of the engine with lower latency while both engines run, set with engineSettleSamples
+    Delay alignmentDelay;
+    bool alignSpareEngine = false;
     
     std::atomic<float>* nBandsPtr;
     std::atomic<float>* syncChannelPtr;
@@ -206,6 +383,16 @@ private:
     std::atomic<float>* soloBand[5];
     std::atomic<float>* muteBand[5];
     
+    // adaptive terminator: 0 = off, 1 = minimize spill, 2 = maximize target-to-spill
+    std::atomic<float>* adaptiveMode;
+    std::atomic<float>* adaptiveRange;
+    std::atomic<float>* adaptiveTime;
+    
+    std::atomic<float>* filterQuality;
+    std::atomic<float>* morphAmount;
+    
+    std::atomic<float>* stateParams[N_STATE_PARAMS]; // in the order of STATE_PARAM_IDS
+    
     bool isBypassed;
     bool soloActive;
     bool loadingFile;
@@ -216,43 +403,151 @@ private:
     bool signalRecorded;
     int nrBlocksRecorded;
     
-    float omniSqSumDist[5], eightSqSumDist[5], omniEightSumDist[5],
-          omniSqSumSig[5], eightSqSumSig[5], omniEightSumSig[5];
+    BandCovariance disturberCov[5], signalCov[5];
+    BandCovariance blockCov[5]; // energies of the current block
+    
+    BandCovariance adaptiveCov[5];
+    Atomic<float> adaptiveDirFactors[5];
+    bool adaptiveWasActive; // audio thread only
+    Atomic<bool> adaptivePatternsPublished = false; // adaptiveWasActive for the message thread, set after adaptiveDirFactors
+    
+    ChangeBroadcaster editorNotifier; // declared before the analyzers, whose threads notify the editor
+    std::atomic<int> editorChanges { editorAllChanges };
+    Atomic<bool> liveDataRequested = false;
+    void notifyEditor (int changes);
+    
+    DirectivityAnalyzer directivityAnalyzer; // per frequency analysis of the recorded signals
+    
+    Atomic<bool> meteringEnabled = false;
+    SnapshotBuffer<LevelSnapshot> levelSnapshots;
+    LevelSnapshot meterSums; // sums of squares and peaks since the last published snapshot
+    BandCovariance arrivalCov[5]; // smoothed statistics for the direction of arrival
+    int meterSamples = 0;
+    
+    SpectrumAnalyzer spectrumAnalyzer;
+    AudioBuffer<float> spectrumInputBuffer; // omni signal before equalization
     
     AudioBuffer<float> filterBankBuffer; // holds filtered data, size: N_CH_IN*5
-    AudioBuffer<float> firFilterBuffer; // holds filter coefficients, size: 5
+    SharedResourcePointer<KernelCache> kernelCache; // filter kernels shared by all instances
+    KernelCache::Kernel bandKernels[5]; // kernels of the bands next to a changed crossover
     AudioBuffer<float> omniEightBuffer; // holds omni and fig-of-eight signals, size: 2
-    dsp::Convolution convolvers[10]; // holds 2*nBands mono convolvers
+    AudioBuffer<float> spareBankBuffer; // filtered data of the spare engine, size: N_CH_IN*5
+    AudioBuffer<float> spareOutputBuffer; // output of the spare engine, size: 1
+    AudioBuffer<float> morphInputBuffer; // omni and eight signals of the inactive layer, size: 2
+    AudioBuffer<float> morphEqInputBuffer; // equalized morphInputBuffer, size: 2
+    AudioBuffer<float> morphBankBuffers[N_MORPH_ENGINES]; // filtered data of the morph engines, size: N_CH_IN*5
+    AudioBuffer<float> morphOutputBuffer; // output of the inactive layer, size: 1
+    AudioBuffer<float> morphFadeBuffer; // output of the faded out morph engine, size: 1
     
     double currentSampleRate;
     int currentBlockSize;
     
     //==============================================================================
     void resetXoverFreqs();
-    void computeAllFilterCoefficients();
-    void computeFilterCoefficients (int crossoverNr);
+    void computeFilterCoefficients (int bandMask);
     void setProxCompCoefficients(float distance);
-    void initAllConvolvers();
-    void initConvolver(int convNr);
+    static dsp::IIR::Coefficients<float> getProxCompCoefficients (float distance, double fs);
+    void initEngines();
+    void updateEngine();
+    void startEngineUpdate();
+    void designSpareEngine (const EngineConfig& config);
+    void configureEngine (int engineIdx, const EngineConfig& config);
+    void startSpareEngine (int settleSamples);
+    EngineConfig getCurrentEngineConfig();
+    EngineConfig getLayerEngineConfig (const PluginStateFormat::Layer& params);
+    EngineConfig getMorphEngineConfig (const PluginStateFormat::Layer& params);
+    static bool engineConfigsMatch (const EngineConfig& a, const EngineConfig& b);
+    bool engineInUseMatches (const EngineConfig& config);
+    void setScene (int sceneIdx, const PluginStateFormat::Layer& params);
+    void startSceneDesign (int sceneIdx);
+    void designSceneEngine (int sceneIdx, const EngineConfig& config);
+    void recallScene();
+    void applyScene (int scene);
+    void keepCurrentScene();
+    void startMorphDesign();
+    void designMorphEngine (int layerIdx, const EngineConfig& config);
+    bool takeMorphEngine();
+    void releaseMorphEngine (int& layerIdx);
+    bool isMorphLayerSettled (int layerIdx);
+    void prepareMorphInput (int numSamples);
+    void processMorphEngines (bool zeroDelayEngines, int numSamples);
+    void addMorphPatterns (int layerIdx, AudioBuffer<float>& dest, int numSamples);
+    void mixMorphLayer (AudioBuffer<float>& buffer, int state, int numSamples);
+    bool isTimerNeeded();
+    void loadFilterBands (int bandMask);
+    void flushPendingCrossovers();
+    void loadEqualizers();
+    void loadEqualizer (int eq, dsp::Convolution& omniConv, dsp::Convolution& eightConv);
+    void startTimerIfNeeded();
+    void processEngines (const AudioBuffer<float>& omniEight, int state, bool zeroDelayEngines, int numSamples);
+    void mixEngines (AudioBuffer<float>& buffer, int state, int numSamples);
     void createOmniAndEightSignals (AudioBuffer<float>& buffer);
-    void createPolarPatterns (AudioBuffer<float>& buffer);
-    void trackSignalEnergy();
+    void createPolarPatterns (AudioBuffer<float>& buffer, int state, bool morphing);
+    void addPolarPatterns (const AudioBuffer<float>& bands, int nActiveBands, const float* oldDirs, const float* newDirFactors, const float* oldGains, const float* newGains,
+                           bool muteAndSolo, AudioBuffer<float>& dest, int numSamples);
+    void computeBandCovariances (int nActiveBands, int numSamples);
+    void trackSignalEnergy (int nActiveBands);
+    void updateAdaptivePatterns (int nActiveBands, int numSamples);
+    void measureLevels (const AudioBuffer<float>& buffer, int nActiveBands, int numSamples);
+    float getAlphaStart();
+    float getEffectiveDirFactor (int band); // audio thread
+    float getPublishedDirFactor (int band); // message thread
+    bool isBandAudible (int band);
+    int getFilterQuality() { return static_cast<int>(filterQuality->load()); }
+    int getFilterBankLatency();
+    static int getFilterBankLatency (int filterLength);
+    int getEngineLatency();
+    String getPresetDescription();
     void setMinimumDisturbancePattern();
     void setMaximumSignalPattern();
     void maximizeSigToDistRatio();
     void updateLatency();
+    void readCurrentLayerState (PluginStateFormat::Layer& state);
+    void readLayerState (const ValueTree& layer, PluginStateFormat::Layer& state);
+    void sanitizeLayerState (PluginStateFormat::Layer& state);
+    ValueTree createLayerTree (const PluginStateFormat::Layer& state, const Identifier& type);
     
-    // file handling
+    // file handling, the properties file is only read when it is needed first
+    PropertiesFile& getProperties();
     File lastDir;
+    bool lastDirRead = false;
     std::unique_ptr<PropertiesFile> properties;
+    SharedResourcePointer<PresetLibrary> presetLibrary;
     const String presetProperties[27] = {"nrActiveBands", "xOverF1", "xOverF2", "xOverF3", "xOverF4", "dirFactor1", "dirFactor2", "dirFactor3", "dirFactor4", "dirFactor5", "gain1", "gain2", "gain3", "gain4", "gain5", "solo1", "solo2", "solo3", "solo4", "solo5", "mute1", "mute2", "mute3", "mute4", "mute5","ffDfEq","proximity"};
     
-    static const int FILTER_BANK_NATIVE_SAMPLE_RATE = 48000;
-    static const int FILTER_BANK_IR_LENGTH_AT_NATIVE_SAMPLE_RATE = 401;
-    
     static const int DF_EQ_LEN = 512;
     static const int FF_EQ_LEN = 512;
     static const int EQ_SAMPLE_RATE = 48000;
+    
+    // band parameter ids, so they don't have to be assembled at runtime
+    static constexpr const char* ALPHA_IDS[5] = {"alpha1", "alpha2", "alpha3", "alpha4", "alpha5"};
+    static constexpr const char* SOLO_IDS[5] = {"solo1", "solo2", "solo3", "solo4", "solo5"};
+    static constexpr const char* MUTE_IDS[5] = {"mute1", "mute2", "mute3", "mute4", "mute5"};
+    static constexpr const char* GAIN_IDS[5] = {"gain1", "gain2", "gain3", "gain4", "gain5"};
+    static constexpr const char* XOVER_IDS[4] = {"xOverF1", "xOverF2", "xOverF3", "xOverF4"};
+    
+    // parameter order of the binary state, new parameters may only be appended
+    static constexpr int N_STATE_PARAMS = 35;
+    static constexpr const char* STATE_PARAM_IDS[N_STATE_PARAMS] = {
+        "xOverF1", "xOverF2", "xOverF3", "xOverF4",
+        "alpha1", "alpha2", "alpha3", "alpha4", "alpha5",
+        "solo1", "solo2", "solo3", "solo4", "solo5",
+        "mute1", "mute2", "mute3", "mute4", "mute5",
+        "gain1", "gain2", "gain3", "gain4", "gain5",
+        "nrBands", "allowBackwardsPattern", "proximity", "zeroDelayMode", "syncChannel",
+        "adaptiveMode", "adaptiveRange", "adaptiveTime", "filterQuality", "scene", "morph"};
+    enum StateParamIndex { stateXOverF1 = 0, stateAlpha1 = 4, stateGain1 = 19, stateNrBands = 24, stateProximity = 26, stateZeroDelayMode = 27,
+                           stateSyncChannel = 28, stateFilterQuality = 32, stateScene = 33 };
+    
+    // maximum change of the adaptive directivity factor per second
+    static constexpr float ADAPTIVE_MAX_ALPHA_RATE = 1.5f;
+    static constexpr float METER_UPDATE_RATE = 30.0f;
+    static constexpr float ARRIVAL_TIME_CONSTANT = 0.3f; // seconds
+    
+    // the convolution crossfades internally to freshly loaded kernels, wait for that before switching engines
+    static constexpr float ENGINE_SETTLE_TIME = 0.06f; // seconds
+    static constexpr float ENGINE_CROSSFADE_TIME = 0.05f; // seconds
+    static constexpr float ENGINE_LOAD_TIMEOUT = 1.0f; // seconds until the kernels of a loading engine are posted again
 };
 
 // DF = Diffuse Field
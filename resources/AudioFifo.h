@@ -0,0 +1,89 @@
+/*
+ ==============================================================================
+ AudioFifo.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// single producer / single consumer multichannel sample fifo, lock- and allocation-free after setSize()
+class AudioFifo
+{
+public:
+    AudioFifo() : fifo (1) {}
+    
+    // not thread safe, call only while neither side is running
+    void setSize (int numChannels, int capacity)
+    {
+        buffer.setSize (numChannels, capacity + 1);
+        buffer.clear();
+        fifo.setTotalSize (capacity + 1);
+    }
+    
+    // producer side, returns false (and drops the block) if there is not enough space
+    bool push (const float* const* data, int numChannels, int numSamples)
+    {
+        jassert (numChannels <= buffer.getNumChannels());
+        if (fifo.getFreeSpace() < numSamples)
+            return false;
+        
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite (numSamples, start1, size1, start2, size2);
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            if (size1 > 0)
+                buffer.copyFrom (ch, start1, data[ch], size1);
+            if (size2 > 0)
+                buffer.copyFrom (ch, start2, data[ch] + size1, size2);
+        }
+        fifo.finishedWrite (size1 + size2);
+        return true;
+    }
+    
+    // consumer side, returns the number of samples read
+    int pull (float* const* dest, int numChannels, int numSamples)
+    {
+        jassert (numChannels <= buffer.getNumChannels());
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (numSamples, start1, size1, start2, size2);
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            if (size1 > 0)
+                FloatVectorOperations::copy (dest[ch], buffer.getReadPointer (ch, start1), size1);
+            if (size2 > 0)
+                FloatVectorOperations::copy (dest[ch] + size1, buffer.getReadPointer (ch, start2), size2);
+        }
+        fifo.finishedRead (size1 + size2);
+        return size1 + size2;
+    }
+    
+    // consumer side, skips all samples that are currently available
+    void discard()
+    {
+        fifo.finishedRead (fifo.getNumReady());
+    }
+    
+    int getNumReady() const { return fifo.getNumReady(); }
+    int getNumChannels() const { return buffer.getNumChannels(); }
+    
+private:
+    AbstractFifo fifo;
+    AudioBuffer<float> buffer;
+};
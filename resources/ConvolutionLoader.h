@@ -0,0 +1,151 @@
+/*
+ ==============================================================================
+ ConvolutionLoader.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+
+/* Hands the kernels of all convolvers in the process to one shared dsp::ConvolutionMessageQueue, shared
+   through a SharedResourcePointer. Without it, every dsp::Convolution runs its own loader thread.
+   The queue only takes commands from one thread at a time and drops them once it is full, so loads
+   from any thread are collected here and posted by a single thread: a newer kernel replaces a pending
+   one of the same convolver, and at most maxLoadsPerPass are posted before the queue had time to drain.
+   Process-wide counters of the running threads and their wake-ups are read with getMetrics(). */
+class ConvolutionLoader : private Thread
+{
+public:
+    static constexpr int queueSize = 1024;
+    static constexpr int maxLoadsPerPass = 64;
+    static constexpr int drainTime = 20; // ms, the queue's thread empties it at least every 10 ms
+    
+    struct Metrics
+    {
+        int loaderThreads = 0;  // running loader threads, each of them posts to the thread of its queue
+        int queueThreads = 0;   // running dsp::ConvolutionMessageQueue threads
+        int64 notifications = 0; // notify() calls of the loader threads
+        int64 wakeUps = 0;       // returns from wait() of the loader threads
+        int64 loadsPosted = 0;
+    };
+    
+    // any thread, summed over all loaders since the start of the process
+    static Metrics getMetrics()
+    {
+        const Counters& counters = getCounters();
+        Metrics metrics;
+        metrics.loaderThreads = counters.loaderThreads.load();
+        metrics.queueThreads = counters.queueThreads.load();
+        metrics.notifications = counters.notifications.load();
+        metrics.wakeUps = counters.wakeUps.load();
+        metrics.loadsPosted = counters.loadsPosted.load();
+        return metrics;
+    }
+    
+    ConvolutionLoader() : Thread ("ConvolutionLoader"), queue (queueSize)
+    {
+        ++getCounters().queueThreads; // the queue starts its thread when it is constructed
+        startThread();
+    }
+    
+    ~ConvolutionLoader() override
+    {
+        stopThread (2000);
+        --getCounters().queueThreads;
+    }
+    
+    // zero latency convolver which loads its kernels on the shared thread
+    std::unique_ptr<dsp::Convolution> createConvolution()
+    {
+        return std::make_unique<dsp::Convolution> (dsp::Convolution::Latency { 0 }, queue);
+    }
+    
+    dsp::ConvolutionMessageQueue& getQueue() { return queue; }
+    
+    // any thread: mono kernel without trimming or normalisation, posted to the convolver by the loader thread
+    void loadImpulseResponse (dsp::Convolution& convolution, AudioBuffer<float>&& ir, double sampleRate)
+    {
+        {
+            const ScopedLock sl (lock);
+            PendingLoad& load = pendingLoads[&convolution];
+            load.ir = std::move (ir);
+            load.sampleRate = sampleRate;
+        }
+        ++getCounters().notifications;
+        notify();
+    }
+    
+    // must be called before a convolver which might have loads pending is deleted
+    void cancelLoads (dsp::Convolution& convolution)
+    {
+        const ScopedLock sl (lock);
+        pendingLoads.erase (&convolution);
+    }
+    
+private:
+    struct PendingLoad
+    {
+        AudioBuffer<float> ir;
+        double sampleRate = 48000.0;
+    };
+    
+    struct Counters
+    {
+        std::atomic<int> loaderThreads {0}, queueThreads {0};
+        std::atomic<int64> notifications {0}, wakeUps {0}, loadsPosted {0};
+    };
+    
+    static Counters& getCounters()
+    {
+        static Counters counters;
+        return counters;
+    }
+    
+    void run() override
+    {
+        Counters& counters = getCounters();
+        ++counters.loaderThreads;
+        
+        while (!threadShouldExit())
+        {
+            bool morePending;
+            {
+                // held while posting, so cancelLoads() returns only after the convolver has been left alone
+                const ScopedLock sl (lock);
+                for (int i = 0; i < maxLoadsPerPass && !pendingLoads.empty(); ++i)
+                {
+                    auto next = pendingLoads.begin();
+                    next->first->loadImpulseResponse (std::move (next->second.ir), next->second.sampleRate, dsp::Convolution::Stereo::no,
+                                                      dsp::Convolution::Trim::no, dsp::Convolution::Normalise::no);
+                    pendingLoads.erase (next);
+                    ++counters.loadsPosted;
+                }
+                morePending = !pendingLoads.empty();
+            }
+            wait (morePending ? drainTime : -1);
+            ++counters.wakeUps;
+        }
+        
+        --counters.loaderThreads;
+    }
+    
+    dsp::ConvolutionMessageQueue queue;
+    CriticalSection lock;
+    std::map<dsp::Convolution*, PendingLoad> pendingLoads;
+};
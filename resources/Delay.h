@@ -25,9 +25,15 @@
 #include "../JuceLibraryCode/JuceHeader.h"
 
 using namespace dsp;
+
+/* Delay line on a power-of-two ring buffer. The buffer is allocated in prepare() for the longest
+   delay at the highest sample rate, setDelayTime() never allocates. With fractional delay enabled,
+   delays between two samples are linearly interpolated. */
 class Delay : private ProcessorBase
 {
 public:
+    static constexpr float maxDelayTimeInSeconds = 0.05f;
+    static constexpr double maxSampleRate = 192000.0;
 
     Delay()
     {
@@ -36,18 +42,14 @@ public:
 
     void setDelayTime (float delayTimeInSeconds)
     {
-        if (delayTimeInSeconds <= 0.0f)
-        {
-            delay = 0.0f;
-            bypassed = true;
-        }
-        else
-        {
-            delay = delayTimeInSeconds;
-            bypassed = false;
-        }
+        delay = jlimit (0.0f, maxDelayTimeInSeconds, delayTimeInSeconds);
+        updateDelayInSamples();
+    }
 
-        prepare(spec);
+    void setFractionalDelayEnabled (bool shouldBeEnabled)
+    {
+        fractionalDelay = shouldBeEnabled;
+        updateDelayInSamples();
     }
 
     const int getDelayInSamples()
@@ -59,94 +61,119 @@ public:
     {
         spec = specs;
 
-        delayInSamples = roundToInt(delay * specs.sampleRate);
+        const double sampleRate = jmax (maxSampleRate, spec.sampleRate);
+        const int requiredSize = nextPowerOfTwo (static_cast<int> (std::ceil (maxDelayTimeInSeconds * sampleRate)) + static_cast<int> (spec.maximumBlockSize) + 2);
+        if (requiredSize > buffer.getNumSamples() || static_cast<int> (spec.numChannels) > buffer.getNumChannels())
+            buffer.setSize (jmax (static_cast<int> (spec.numChannels), buffer.getNumChannels()), jmax (requiredSize, buffer.getNumSamples()));
+        mask = buffer.getNumSamples() - 1;
 
-        buffer.setSize(specs.numChannels, specs.maximumBlockSize + delayInSamples);
-        buffer.clear();
-        writePosition = 0;
+        updateDelayInSamples();
+        reset();
     }
 
+    // works in place, the delayed signal replaces the input
     void process (const ProcessContextReplacing<float>& context) override
     {
         ScopedNoDenormals noDenormals;
 
-        if (! bypassed)
-        {
-            auto abIn = context.getInputBlock();
-            auto abOut = context.getOutputBlock();
-            auto L = abIn.getNumSamples();
-            auto nCh = jmin((int) spec.numChannels, (int) abIn.getNumChannels());
-
-            int startIndex, blockSize1, blockSize2;
+        if (bypassed)
+            return;
 
+        auto abIn = context.getInputBlock();
+        auto abOut = context.getOutputBlock();
+        const int L = static_cast<int> (abIn.getNumSamples());
+        const int nCh = jmin ((int) spec.numChannels, (int) abIn.getNumChannels());
 
-            // write in delay line
-            getReadWritePositions(false, (int) L, startIndex, blockSize1, blockSize2);
+        for (int ch = 0; ch < nCh; ++ch)
+            writeToRing (ch, abIn.getChannelPointer (ch), L);
 
-            for (int ch = 0; ch < nCh; ch++)
-                buffer.copyFrom(ch, startIndex, abIn.getChannelPointer(ch), blockSize1);
-
-            if (blockSize2 > 0)
-                for (int ch = 0; ch < nCh; ch++)
-                    buffer.copyFrom(ch, 0, abIn.getChannelPointer(ch) + blockSize1, blockSize2);
-
-
-            // read from delay line
-            getReadWritePositions(true, (int) L, startIndex, blockSize1, blockSize2);
+        const int readPosition = (writePosition - delayInSamples) & mask;
+        for (int ch = 0; ch < nCh; ++ch)
+        {
+            float* dest = abOut.getChannelPointer (ch);
+            if (fraction == 0.0f)
+            {
+                readFromRing (ch, readPosition, dest, L, 1.0f, false);
+            }
+            else
+            {
+                readFromRing (ch, readPosition, dest, L, 1.0f - fraction, false);
+                readFromRing (ch, (readPosition - 1) & mask, dest, L, fraction, true);
+            }
+        }
 
-            for (int ch = 0; ch < nCh; ch++)
-                FloatVectorOperations::copy(abOut.getChannelPointer(ch), buffer.getReadPointer(ch) + startIndex, blockSize1);
+        writePosition = (writePosition + L) & mask;
+    }
 
-            if (blockSize2 > 0)
-                for (int ch = 0; ch < nCh; ch++)
-                    FloatVectorOperations::copy(abOut.getChannelPointer(ch) + blockSize1, buffer.getReadPointer(ch), blockSize2);
+    // feeds the delay line without reading from it, e.g. while the delayed signal is not needed yet
+    void write (const AudioBlock<const float>& block)
+    {
+        const int L = static_cast<int> (block.getNumSamples());
+        const int nCh = jmin ((int) spec.numChannels, (int) block.getNumChannels());
 
+        for (int ch = 0; ch < nCh; ++ch)
+            writeToRing (ch, block.getChannelPointer (ch), L);
 
-            writePosition += L;
-            writePosition = writePosition % buffer.getNumSamples();
-        }
+        writePosition = (writePosition + L) & mask;
     }
 
     void reset() override
     {
-
+        buffer.clear();
+        writePosition = 0;
     }
 
-    void getReadWritePositions (bool read, int numSamples, int& startIndex, int& blockSize1, int& blockSize2)
+private:
+    void updateDelayInSamples()
     {
-        const int L = buffer.getNumSamples();
-        int pos = writePosition;
-        if (read)
+        const float delaySamples = spec.sampleRate > 0 ? static_cast<float> (delay * spec.sampleRate) : 0.0f;
+        if (fractionalDelay)
         {
-            pos = writePosition - delayInSamples;
+            delayInSamples = static_cast<int> (delaySamples);
+            fraction = delaySamples - delayInSamples;
         }
-        if (pos < 0)
-            pos = pos + L;
-        pos = pos % L;
+        else
+        {
+            delayInSamples = roundToInt (delaySamples);
+            fraction = 0.0f;
+        }
+        bypassed = delayInSamples == 0 && fraction == 0.0f;
+    }
 
-        jassert(pos >= 0 && pos < L);
+    void writeToRing (int ch, const float* source, int numSamples)
+    {
+        const int blockSize1 = jmin (numSamples, mask + 1 - writePosition);
+        FloatVectorOperations::copy (buffer.getWritePointer (ch, writePosition), source, blockSize1);
+        if (numSamples > blockSize1)
+            FloatVectorOperations::copy (buffer.getWritePointer (ch), source + blockSize1, numSamples - blockSize1);
+    }
 
-        if (numSamples <= 0)
+    void readFromRing (int ch, int readPosition, float* dest, int numSamples, float gain, bool add)
+    {
+        const int blockSize1 = jmin (numSamples, mask + 1 - readPosition);
+        const float* ring = buffer.getReadPointer (ch);
+        if (add)
         {
-            startIndex = 0;
-            blockSize1 = 0;
-            blockSize2 = 0;
+            FloatVectorOperations::addWithMultiply (dest, ring + readPosition, gain, blockSize1);
+            if (numSamples > blockSize1)
+                FloatVectorOperations::addWithMultiply (dest + blockSize1, ring, gain, numSamples - blockSize1);
         }
         else
         {
-            startIndex = pos;
-            blockSize1 = jmin (L - pos, numSamples);
-            numSamples -= blockSize1;
-            blockSize2 = numSamples <= 0 ? 0 : numSamples;
+            FloatVectorOperations::copyWithMultiply (dest, ring + readPosition, gain, blockSize1);
+            if (numSamples > blockSize1)
+                FloatVectorOperations::copyWithMultiply (dest + blockSize1, ring, gain, numSamples - blockSize1);
         }
     }
 
-private:
     //==============================================================================
     ProcessSpec spec = {-1, 0, 0};
-    float delay;
+    float delay = 0.0f;
     int delayInSamples = 0;
-    bool bypassed = false;
+    float fraction = 0.0f;
+    bool fractionalDelay = false;
+    bool bypassed = true;
     int writePosition = 0;
+    int mask = 0;
     AudioBuffer<float> buffer;
 };
@@ -0,0 +1,489 @@
+/*
+ ==============================================================================
+ DirectivityAnalyzer.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AudioFifo.h"
+#include "PatternOptimization.h"
+
+/* Estimates the optimal directivity factor per frequency from the omni and fig-of-eight
+   signals recorded by the terminator. The audio thread only pushes samples into a fifo,
+   the short-time spectra and their covariances are computed on a background thread. The
+   thread polls the fifo once per hop while recording and ends once a recording is stopped. */
+class DirectivityAnalyzer : private Thread
+{
+public:
+    static constexpr int fftOrder = 11;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int hopSize = fftSize / 2;
+    static constexpr int nBins = fftSize / 2 + 1;
+    static constexpr int pointsPerOctave = 6; // resolution of the analysis curve
+    
+    struct Results
+    {
+        Array<float> frequencies; // centre frequencies of the analysis points
+        Array<float> alphas;      // optimal directivity factor per analysis point
+        Array<float> weights;     // relative energy per analysis point, 0 = no signal
+        Array<float> crossovers;  // suggested crossover frequencies
+    };
+    
+    DirectivityAnalyzer() : Thread ("DirectivityAnalyzer"), fft (fftOrder),
+                            window (fftSize, dsp::WindowingFunction<float>::hann, false)
+    {
+        omniSpectrum.resize (2 * fftSize);
+        eightSpectrum.resize (2 * fftSize);
+        pendingBins.resize (nBins);
+        disturberBins.resize (nBins);
+        signalBins.resize (nBins);
+    }
+    
+    ~DirectivityAnalyzer() override
+    {
+        stopThread (1000);
+    }
+    
+    void prepare (double sampleRate)
+    {
+        const bool wasRunning = isThreadRunning();
+        stopThread (1000);
+        
+        // a stopped run() has not reset threadActive, the thread is started again below if needed
+        bool restart;
+        {
+            const ScopedLock sl (requestLock);
+            restart = wasRunning || !requests.isEmpty();
+            threadActive = restart;
+        }
+        
+        fifo.setSize (2, jmax (4 * fftSize, roundToInt (sampleRate)));
+        pollInterval = jmax (1, roundToInt (1000.0 * hopSize / sampleRate));
+        frame.setSize (2, fftSize);
+        frame.clear();
+        samplesInFrame = 0;
+        
+        // recordings done at another sample rate do not map to the new bins
+        if (sampleRate != fs)
+        {
+            fs = sampleRate;
+            clearBins (pendingBins);
+            clearBins (disturberBins);
+            clearBins (signalBins);
+            pendingFrames = 0;
+            disturberRecorded = signalRecorded = false;
+            initAnalysisPoints();
+        }
+        
+        if (restart)
+            startThread();
+    }
+    
+    // audio thread, lock-free, the analysis thread polls the fifo
+    void pushSamples (const float* omni, const float* eight, int numSamples)
+    {
+        const float* data[2] = { omni, eight };
+        fifo.push (data, 2, numSamples);
+    }
+    
+    // message thread, xOverRanges holds the allowed range of each crossover frequency
+    void startTracking (bool trackDisturber, int nBands, const Array<Range<float>>& xOverRanges, float alphaMin)
+    {
+        Request request;
+        request.type = Request::start;
+        request.trackDisturber = trackDisturber;
+        request.nBands = nBands;
+        request.xOverRanges = xOverRanges;
+        request.alphaMin = alphaMin;
+        addRequest (request);
+    }
+    
+    // message thread, keep = false discards the current recording, the thread ends after handling it
+    void stopTracking (bool keep, bool maximizeRatio)
+    {
+        Request request;
+        request.type = keep ? Request::stopAndKeep : Request::stopAndDiscard;
+        request.maximizeRatio = maximizeRatio;
+        addRequest (request);
+    }
+    
+    bool hasNewResults() { return resultsChanged.get(); }
+    
+    // called on the analyzer thread once new results can be read, set before the thread starts
+    void setOnNewResultsCallback (std::function<void()> callback)
+    {
+        onNewResults = std::move (callback);
+    }
+    
+    void getResults (Results& dest)
+    {
+        const ScopedLock sl (resultsLock);
+        dest = results;
+        resultsChanged = false;
+    }
+    
+private:
+    struct Request
+    {
+        enum Type { start, stopAndKeep, stopAndDiscard };
+        Type type = start;
+        bool trackDisturber = true;
+        bool maximizeRatio = false;
+        int nBands = 1;
+        Array<Range<float>> xOverRanges;
+        float alphaMin = 0.0f;
+    };
+    
+    // message thread, starts the thread again if it has ended
+    void addRequest (const Request& request)
+    {
+        bool startNeeded;
+        {
+            const ScopedLock sl (requestLock);
+            requests.add (request);
+            startNeeded = !threadActive;
+            threadActive = true;
+        }
+        
+        if (startNeeded)
+        {
+            stopThread (1000); // joins a thread which has just returned from run()
+            startThread();
+        }
+        else
+        {
+            notify();
+        }
+    }
+    
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            handleRequests();
+            if (processFifo())
+                continue;
+            
+            {
+                const ScopedLock sl (requestLock);
+                if (!tracking && requests.isEmpty())
+                {
+                    threadActive = false; // the next request starts the thread again
+                    return;
+                }
+            }
+            // one poll per hop while recording, the thread has nothing to analyse in between
+            wait (tracking ? pollInterval : -1);
+        }
+    }
+    
+    void handleRequests()
+    {
+        Array<Request> newRequests;
+        {
+            const ScopedLock sl (requestLock);
+            newRequests.swapWith (requests);
+        }
+        
+        for (auto& request : newRequests)
+        {
+            if (request.type == Request::start)
+            {
+                trackingDisturber = request.trackDisturber;
+                nBands = request.nBands;
+                xOverRanges = request.xOverRanges;
+                alphaMin = request.alphaMin;
+                fifo.discard(); // left over from before the start
+                clearBins (pendingBins);
+                pendingFrames = 0;
+                samplesInFrame = 0;
+                tracking = true;
+            }
+            else if (request.type == Request::stopAndKeep)
+            {
+                // samples recorded before the stop are still in the fifo
+                processFifo();
+                tracking = false;
+                if (pendingFrames == 0)
+                    continue;
+                
+                auto& dest = trackingDisturber ? disturberBins : signalBins;
+                for (int k = 0; k < nBins; ++k)
+                {
+                    dest[k] = pendingBins[k];
+                    dest[k].scale (1.0f / pendingFrames);
+                }
+                if (trackingDisturber)
+                    disturberRecorded = true;
+                else
+                    signalRecorded = true;
+                
+                if (request.maximizeRatio && disturberRecorded && signalRecorded)
+                    computeResults (disturberBins.data(), signalBins.data(), 1.0f);
+                else
+                    computeResults (trackingDisturber ? disturberBins.data() : nullptr, trackingDisturber ? nullptr : signalBins.data(), 1.0f);
+            }
+            else
+            {
+                fifo.discard();
+                tracking = false;
+            }
+        }
+    }
+    
+    // returns true if at least one frame has been analysed
+    bool processFifo()
+    {
+        bool analysed = false;
+        while (fifo.getNumReady() > 0 && !threadShouldExit())
+        {
+            float* dest[2] = { frame.getWritePointer (0, samplesInFrame), frame.getWritePointer (1, samplesInFrame) };
+            samplesInFrame += fifo.pull (dest, 2, fftSize - samplesInFrame);
+            
+            if (samplesInFrame == fftSize)
+            {
+                analyseFrame();
+                for (int ch = 0; ch < 2; ++ch)
+                    FloatVectorOperations::copy (frame.getWritePointer (ch), frame.getReadPointer (ch, hopSize), fftSize - hopSize);
+                samplesInFrame = fftSize - hopSize;
+                analysed = true;
+            }
+        }
+        
+        // show the curve while recording
+        if (analysed && tracking && pendingFrames > 0 && Time::getMillisecondCounter() - lastUpdateTime > 100)
+        {
+            lastUpdateTime = Time::getMillisecondCounter();
+            computeResults (trackingDisturber ? pendingBins.data() : nullptr, trackingDisturber ? nullptr : pendingBins.data(), 1.0f / pendingFrames);
+        }
+        return analysed;
+    }
+    
+    void analyseFrame()
+    {
+        if (!tracking)
+            return;
+        
+        for (int ch = 0; ch < 2; ++ch)
+        {
+            float* data = ch == 0 ? omniSpectrum.data() : eightSpectrum.data();
+            FloatVectorOperations::copy (data, frame.getReadPointer (ch), fftSize);
+            FloatVectorOperations::clear (data + fftSize, fftSize);
+            window.multiplyWithWindowingTable (data, fftSize);
+            fft.performRealOnlyForwardTransform (data, true);
+        }
+        
+        // cross spectra are real for the pattern power, as alpha is real
+        for (int k = 0; k < nBins; ++k)
+        {
+            const float oRe = omniSpectrum[2 * k];
+            const float oIm = omniSpectrum[2 * k + 1];
+            const float eRe = eightSpectrum[2 * k];
+            const float eIm = eightSpectrum[2 * k + 1];
+            pendingBins[k].omniSq += oRe * oRe + oIm * oIm;
+            pendingBins[k].eightSq += eRe * eRe + eIm * eIm;
+            pendingBins[k].omniEight += oRe * eRe + oIm * eIm;
+        }
+        ++pendingFrames;
+    }
+    
+    void initAnalysisPoints()
+    {
+        pointFrequencies.clear();
+        pointBinStart.clear();
+        pointBinEnd.clear();
+        
+        const float binWidth = static_cast<float> (fs) / fftSize;
+        const float fMax = jmin (20000.0f, static_cast<float> (fs) / 2);
+        const float halfWidth = std::pow (2.0f, 0.5f / pointsPerOctave);
+        
+        for (float f = 20.0f; f <= fMax; f *= halfWidth * halfWidth)
+        {
+            int start = jmax (1, static_cast<int> (std::ceil (f / halfWidth / binWidth)));
+            int end = jmin (nBins - 1, static_cast<int> (std::floor (f * halfWidth / binWidth)));
+            if (end < start) // less than one bin per analysis point
+                start = end = jlimit (1, nBins - 1, roundToInt (f / binWidth));
+            
+            pointFrequencies.add (f);
+            pointBinStart.add (start);
+            pointBinEnd.add (end);
+        }
+    }
+    
+    // pass nullptr for a set that should not be used: disturber only minimizes, signal only maximizes
+    void computeResults (const BandCovariance* disturber, const BandCovariance* signal, float scale)
+    {
+        const int nPoints = pointFrequencies.size();
+        Array<float> alphas, weights;
+        float maxWeight = 0.0f;
+        
+        for (int p = 0; p < nPoints; ++p)
+        {
+            BandCovariance dist, sig;
+            for (int k = pointBinStart[p]; k <= pointBinEnd[p]; ++k)
+            {
+                if (disturber != nullptr)
+                    dist.add (disturber[k]);
+                if (signal != nullptr)
+                    sig.add (signal[k]);
+            }
+            dist.scale (scale);
+            sig.scale (scale);
+            
+            float alpha;
+            if (disturber != nullptr && signal != nullptr)
+                alpha = PatternOptimizer::findMaximumRatioAlpha (sig, dist, alphaMin, 1.0f);
+            else if (disturber != nullptr)
+                alpha = PatternOptimizer::findMinimumPowerAlpha (dist, alphaMin, 1.0f);
+            else
+                alpha = PatternOptimizer::findMaximumPowerAlpha (sig, alphaMin, 1.0f);
+            
+            const BandCovariance& ref = disturber != nullptr ? dist : sig;
+            const float weight = ref.omniSq + ref.eightSq;
+            maxWeight = jmax (maxWeight, weight);
+            alphas.add (alpha);
+            weights.add (weight);
+        }
+        
+        if (maxWeight > 0.0f)
+            FloatVectorOperations::multiply (weights.getRawDataPointer(), 1.0f / maxWeight, nPoints);
+        
+        Array<float> crossovers = suggestCrossovers (alphas, weights);
+        
+        {
+            const ScopedLock sl (resultsLock);
+            results.frequencies = pointFrequencies;
+            results.alphas = alphas;
+            results.weights = weights;
+            results.crossovers = crossovers;
+            resultsChanged = true;
+        }
+        
+        if (onNewResults != nullptr)
+            onNewResults();
+    }
+    
+    /* Splits the analysis points into nBands segments with the least energy weighted variance
+       of the optimal directivity factor, each crossover constrained to its allowed range. */
+    Array<float> suggestCrossovers (const Array<float>& alphas, const Array<float>& weights)
+    {
+        Array<float> crossovers;
+        const int nPoints = alphas.size();
+        if (nBands < 2 || xOverRanges.size() < nBands - 1 || nPoints < nBands)
+            return crossovers;
+        
+        std::vector<double> w (nPoints + 1, 0.0), wa (nPoints + 1, 0.0), waa (nPoints + 1, 0.0);
+        for (int p = 0; p < nPoints; ++p)
+        {
+            w[p + 1] = w[p] + weights[p];
+            wa[p + 1] = wa[p] + weights[p] * alphas[p];
+            waa[p + 1] = waa[p] + weights[p] * alphas[p] * alphas[p];
+        }
+        auto segmentCost = [&] (int start, int end)
+        {
+            const double sumW = w[end] - w[start];
+            if (sumW <= 0.0)
+                return 0.0;
+            const double sumWa = wa[end] - wa[start];
+            return (waa[end] - waa[start]) - sumWa * sumWa / sumW;
+        };
+        
+        // cost[b][e]: points [0, e) split into b + 1 bands, prev[b][e]: start of the last band
+        const double inf = std::numeric_limits<double>::max();
+        std::vector<std::vector<double>> cost (nBands, std::vector<double> (nPoints + 1, inf));
+        std::vector<std::vector<int>> prev (nBands, std::vector<int> (nPoints + 1, -1));
+        for (int e = 1; e <= nPoints; ++e)
+            cost[0][e] = segmentCost (0, e);
+        
+        for (int b = 1; b < nBands; ++b)
+        {
+            for (int e = b + 1; e <= nPoints; ++e)
+            {
+                for (int start = b; start < e; ++start)
+                {
+                    if (cost[b - 1][start] == inf || !xOverRanges[b - 1].contains (pointFrequencies[start]))
+                        continue;
+                    const double c = cost[b - 1][start] + segmentCost (start, e);
+                    if (c < cost[b][e])
+                    {
+                        cost[b][e] = c;
+                        prev[b][e] = start;
+                    }
+                }
+            }
+        }
+        
+        if (cost[nBands - 1][nPoints] == inf) // ranges too narrow for the analysis resolution
+            return crossovers;
+        
+        crossovers.resize (nBands - 1);
+        int end = nPoints;
+        for (int b = nBands - 1; b > 0; --b)
+        {
+            const int start = prev[b][end];
+            const float f = std::sqrt (pointFrequencies[start - 1] * pointFrequencies[start]);
+            crossovers.set (b - 1, xOverRanges[b - 1].clipValue (f));
+            end = start;
+        }
+        return crossovers;
+    }
+    
+    static void clearBins (std::vector<BandCovariance>& bins)
+    {
+        for (auto& bin : bins)
+            bin.clear();
+    }
+    
+    double fs = 0.0;
+    AudioFifo fifo;
+    int pollInterval = 20; // ms, one hop
+    AudioBuffer<float> frame;
+    int samplesInFrame = 0;
+    
+    dsp::FFT fft;
+    dsp::WindowingFunction<float> window;
+    std::vector<float> omniSpectrum, eightSpectrum;
+    
+    // owned by the analysis thread
+    std::vector<BandCovariance> pendingBins, disturberBins, signalBins;
+    int pendingFrames = 0;
+    bool tracking = false;
+    bool trackingDisturber = true;
+    bool disturberRecorded = false;
+    bool signalRecorded = false;
+    int nBands = 1;
+    Array<Range<float>> xOverRanges;
+    float alphaMin = 0.0f;
+    uint32 lastUpdateTime = 0;
+    
+    Array<float> pointFrequencies;
+    Array<int> pointBinStart, pointBinEnd;
+    
+    CriticalSection requestLock;
+    Array<Request> requests;
+    bool threadActive = false; // guarded by requestLock, false once run() has returned by itself
+    
+    CriticalSection resultsLock;
+    Results results;
+    Atomic<bool> resultsChanged = false;
+    std::function<void()> onNewResults;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DirectivityAnalyzer)
+};
@@ -0,0 +1,311 @@
+/*
+ ==============================================================================
+ DirectivityHeatmap.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "KernelCache.h"
+#include "SnapshotBuffer.h"
+#include <complex>
+
+/* Output level over frequency (x, logarithmic) and angle of incidence (y, 0 to 180 degrees), computed
+   from the designed band kernels, the equalizers, the proximity filter and the current patterns.
+   A background thread renders the image in passes of decreasing column spacing and publishes it
+   after every pass, new settings abort the rendering and start over with a coarse pass. */
+class DirectivityHeatmap : private Thread
+{
+public:
+    static constexpr float minFreq = 20.0f;
+    static constexpr float maxFreq = 20000.0f;
+    static constexpr float minDb = -30.0f;
+    static constexpr float maxDb = 6.0f;
+    static constexpr int coarseColumnStep = 16; // column spacing of the first pass, halved with every pass
+
+    // everything the response depends on, unchanged settings are not rendered again
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        int nBands = 1;
+        int firLen = 0;
+        float xOverHz[4] = {};
+        float alphas[5] = {};
+        float gains[5] = {}; // linear, 0 for muted bands
+        KernelCache::Kernel eqOmni, eqEight; // nullptr without equalization
+        double eqSampleRate = 48000.0;
+        Array<float> proxCoefficients; // normalized IIR coefficients, empty without proximity filter
+        bool proxOnEight = true;
+
+        bool operator== (const Settings& other) const
+        {
+            if (sampleRate != other.sampleRate || nBands != other.nBands || firLen != other.firLen
+                || eqOmni != other.eqOmni || eqEight != other.eqEight || eqSampleRate != other.eqSampleRate
+                || proxCoefficients != other.proxCoefficients || proxOnEight != other.proxOnEight)
+                return false;
+
+            for (int i = 0; i < 4; ++i)
+                if (xOverHz[i] != other.xOverHz[i])
+                    return false;
+
+            for (int i = 0; i < 5; ++i)
+                if (alphas[i] != other.alphas[i] || gains[i] != other.gains[i])
+                    return false;
+
+            return true;
+        }
+    };
+
+    DirectivityHeatmap() : Thread ("DirectivityHeatmap")
+    {
+        const Colour colours[4] = { Colour (0xFF191919), Colour (0xFF00CAFF), Colour (0xFFFF9F00), Colour (0xFFD0011B) };
+        ColourGradient gradient (colours[0], 0.0f, 0.0f, colours[3], 1.0f, 0.0f, false);
+        gradient.addColour (0.45, colours[1]);
+        gradient.addColour (0.75, colours[2]);
+        for (int i = 0; i < nColours; ++i)
+            colourMap[i] = gradient.getColourAtPosition (i / (nColours - 1.0));
+    }
+
+    ~DirectivityHeatmap() override
+    {
+        stopThread (1000);
+    }
+
+    // message thread, the thread only runs while the heatmap is shown
+    void setEnabled (bool shouldBeEnabled)
+    {
+        if (shouldBeEnabled)
+            startThread();
+        else
+            stopThread (500);
+    }
+
+    // message thread
+    void setSettings (const Settings& newSettings)
+    {
+        {
+            const ScopedLock sl (settingsLock);
+            if (hasSettings && newSettings == settings)
+                return;
+
+            settings = newSettings;
+            hasSettings = true;
+            settingsChanged = true;
+        }
+        notify();
+    }
+
+    // message thread, pixels of the rendered image
+    void setImageSize (int width, int height)
+    {
+        {
+            const ScopedLock sl (settingsLock);
+            if (width == imageWidth && height == imageHeight)
+                return;
+
+            imageWidth = width;
+            imageHeight = height;
+            settingsChanged = true;
+        }
+        notify();
+    }
+
+    // called on the heatmap thread after every pass, set before the thread starts
+    void setOnNewImageCallback (std::function<void()> callback)
+    {
+        onNewImage = std::move (callback);
+    }
+
+    // reader side is the message thread
+    SnapshotBuffer<Image>& getImage() { return images; }
+
+    static float getFrequencyAtPosition (float proportion)
+    {
+        return minFreq * std::pow (maxFreq / minFreq, proportion);
+    }
+
+    static float getPositionOfFrequency (float freq)
+    {
+        return std::log (freq / minFreq) / std::log (maxFreq / minFreq);
+    }
+
+    // colour of a level between minDb (0) and maxDb (1), for the legend
+    Colour getColourAtPosition (float proportion) const
+    {
+        return colourMap[jlimit (0, nColours - 1, roundToInt (proportion * (nColours - 1)))];
+    }
+
+private:
+    static constexpr int nColours = 256;
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            Settings current;
+            int width, height;
+            {
+                const ScopedLock sl (settingsLock);
+                if (!settingsChanged.get() || !hasSettings)
+                {
+                    const ScopedUnlock su (settingsLock);
+                    wait (-1);
+                    continue;
+                }
+
+                current = settings;
+                width = imageWidth;
+                height = imageHeight;
+                settingsChanged = false;
+            }
+
+            render (current, width, height);
+        }
+    }
+
+    void render (const Settings& current, int width, int height)
+    {
+        if (width < 1 || height < 1)
+            return;
+
+        // cache hits as long as the processor runs the same configuration
+        std::vector<KernelCache::Kernel> bandKernels;
+        if (current.nBands > 1)
+            for (int i = 0; i < current.nBands; ++i)
+                bandKernels.push_back (kernelCache->getBandKernel (i, current.nBands, current.xOverHz, current.sampleRate, current.firLen));
+
+        std::vector<float> cosines (static_cast<size_t> (height));
+        for (int y = 0; y < height; ++y)
+            cosines[static_cast<size_t> (y)] = std::cos (MathConstants<float>::pi * y / jmax (1, height - 1));
+
+        Image image (Image::RGB, width, height, true, SoftwareImageType());
+        for (int step = coarseColumnStep; step >= 1; step /= 2)
+        {
+            for (int x = 0; x < width; x += step)
+            {
+                if (step < coarseColumnStep && x % (2 * step) == 0) // done by a coarser pass
+                    continue;
+
+                if (threadShouldExit() || settingsChanged.get())
+                    return;
+
+                renderColumns (image, x, jmin (step, width - x), current, bandKernels, cosines);
+            }
+
+            Image& dest = images.getWriteBuffer();
+            dest = image.createCopy();
+            images.publish();
+            if (onNewImage != nullptr)
+                onNewImage();
+        }
+    }
+
+    // computes the column at x and fills numColumns columns with it
+    void renderColumns (Image& image, int x, int numColumns, const Settings& current,
+                        const std::vector<KernelCache::Kernel>& bandKernels, const std::vector<float>& cosines)
+    {
+        const float freq = getFrequencyAtPosition ((x + 0.5f) / image.getWidth());
+
+        // band sums of the omni and fig-of-eight paths, the band kernels share their latency
+        std::complex<double> omni = 0.0, eight = 0.0;
+        for (int i = 0; i < current.nBands; ++i)
+        {
+            if (current.gains[i] == 0.0f)
+                continue;
+
+            std::complex<double> band = 1.0;
+            if (!bandKernels.empty())
+                band = getFirResponse (bandKernels[static_cast<size_t> (i)]->getReadPointer (0), current.firLen, freq, current.sampleRate, true);
+
+            omni += static_cast<double> ((1.0f - std::abs (current.alphas[i])) * current.gains[i]) * band;
+            eight += static_cast<double> (current.alphas[i] * current.gains[i]) * band;
+        }
+
+        if (current.eqOmni != nullptr && current.eqEight != nullptr)
+        {
+            omni *= getFirResponse (current.eqOmni->getReadPointer (0), current.eqOmni->getNumSamples(), freq, current.eqSampleRate, false);
+            eight *= getFirResponse (current.eqEight->getReadPointer (0), current.eqEight->getNumSamples(), freq, current.eqSampleRate, false);
+        }
+
+        if (current.proxCoefficients.size() > 0)
+        {
+            const std::complex<double> prox = getIirResponse (current.proxCoefficients, freq, current.sampleRate);
+            if (current.proxOnEight)
+                eight *= prox;
+            else
+                omni *= prox;
+        }
+
+        Image::BitmapData data (image, x, 0, numColumns, image.getHeight(), Image::BitmapData::writeOnly);
+        for (int y = 0; y < image.getHeight(); ++y)
+        {
+            const float level = static_cast<float> (std::abs (omni + static_cast<double> (cosines[static_cast<size_t> (y)]) * eight));
+            const float db = Decibels::gainToDecibels (level, minDb);
+            const int colourIdx = jlimit (0, nColours - 1, roundToInt ((db - minDb) / (maxDb - minDb) * (nColours - 1)));
+            for (int i = 0; i < numColumns; ++i)
+                data.setPixelColour (i, y, colourMap[colourIdx]);
+        }
+    }
+
+    // DTFT at freq, relative to the centre of linear phase kernels
+    static std::complex<double> getFirResponse (const float* coefficients, int length, float freq, double sampleRate, bool centred)
+    {
+        const double omega = MathConstants<double>::twoPi * freq / sampleRate;
+        const std::complex<double> rotation = std::polar (1.0, -omega);
+        std::complex<double> phasor = centred ? std::polar (1.0, omega * (length - 1) / 2.0) : 1.0;
+        std::complex<double> sum = 0.0;
+        for (int n = 0; n < length; ++n)
+        {
+            sum += static_cast<double> (coefficients[n]) * phasor;
+            phasor *= rotation;
+        }
+        return sum;
+    }
+
+    // coefficients as in dsp::IIR::Coefficients: b0...bN, a1...aN, normalized to a0
+    static std::complex<double> getIirResponse (const Array<float>& coefficients, float freq, double sampleRate)
+    {
+        const int order = (coefficients.size() - 1) / 2;
+        const std::complex<double> zInv = std::polar (1.0, -MathConstants<double>::twoPi * freq / sampleRate);
+        std::complex<double> num = 0.0, den = 1.0, power = 1.0;
+        for (int k = 0; k <= order; ++k)
+        {
+            num += static_cast<double> (coefficients[k]) * power;
+            if (k > 0)
+                den += static_cast<double> (coefficients[order + k]) * power;
+            power *= zInv;
+        }
+        return num / den;
+    }
+
+    SharedResourcePointer<KernelCache> kernelCache;
+
+    CriticalSection settingsLock;
+    Settings settings;
+    bool hasSettings = false;
+    int imageWidth = 0;
+    int imageHeight = 0;
+    Atomic<bool> settingsChanged = false;
+
+    Colour colourMap[nColours];
+    SnapshotBuffer<Image> images;
+    std::function<void()> onNewImage;
+
+    JUCE_DECLARE_NON_COPYABLE (DirectivityHeatmap)
+};
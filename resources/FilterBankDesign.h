@@ -0,0 +1,84 @@
+/*
+ ==============================================================================
+ FilterBankDesign.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// linear phase FIR design of the crossover filter bank, shared by the processor and the offline optimizer
+struct FilterBankDesign
+{
+    static constexpr int nativeSampleRate = 48000;
+    
+    // quality tiers: filter length at the native sample rate, trades CPU and latency for steeper crossovers
+    static constexpr int nQualities = 4;
+    static constexpr int defaultQuality = 1;
+    static constexpr int irLengthsAtNativeSampleRate[nQualities] = {129, 401, 1025, 2049};
+    
+    // filter length scaled to the sample rate, always odd
+    static int getFirLength (double sampleRate, int quality = defaultQuality)
+    {
+        const int irLength = irLengthsAtNativeSampleRate[jlimit (0, nQualities - 1, quality)];
+        int firLen = static_cast<int> (std::ceil (static_cast<float> (irLength) / nativeSampleRate * sampleRate));
+        if (firLen % 2 == 0)
+            firLen++;
+        return firLen;
+    }
+    
+    // writes firLen coefficients of one band to dest, xOverFreqs in Hz
+    static void designBand (int band, int nBands, const float* xOverFreqs, double sampleRate, int firLen, float* dest)
+    {
+        jassert (nBands > 1 && band < nBands);
+        
+        if (band == 0)
+        {
+            // lowest band is simple lowpass
+            auto lowpass = dsp::FilterDesign<float>::designFIRLowpassWindowMethod (xOverFreqs[0], sampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
+            FloatVectorOperations::copy (dest, lowpass->getRawCoefficients(), firLen);
+        }
+        else if (band == nBands - 1)
+        {
+            // highest band is highpass (via frequency transform)
+            float hpBandwidth = sampleRate / 2 - xOverFreqs[nBands - 2];
+            auto lp2hp = dsp::FilterDesign<float>::designFIRLowpassWindowMethod (hpBandwidth, sampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
+            float* lp2hpCoeffs = lp2hp->getRawCoefficients();
+            for (int i = 0; i < firLen; ++i)
+                dest[i] = lp2hpCoeffs[i] * std::cos (MathConstants<float>::pi * (i - (firLen - 1) / 2));
+        }
+        else
+        {
+            // all the other bands are bandpass filters
+            float halfBandwidth = (xOverFreqs[band] - xOverFreqs[band - 1]) / 2;
+            float fCenter = halfBandwidth + xOverFreqs[band - 1];
+            auto lp2bp = dsp::FilterDesign<float>::designFIRLowpassWindowMethod (halfBandwidth, sampleRate, firLen - 1, dsp::WindowingFunction<float>::WindowingMethod::hamming);
+            float* lp2bpCoeffs = lp2bp->getRawCoefficients();
+            for (int j = 0; j < firLen; ++j)
+                dest[j] = 2 * lp2bpCoeffs[j] * std::cos (MathConstants<float>::twoPi * fCenter / sampleRate * (j - (firLen - 1) / 2));
+        }
+    }
+    
+    // designs all bands into the channels of dest, which must hold nBands channels of firLen samples
+    static void designAllBands (int nBands, const float* xOverFreqs, double sampleRate, int firLen, AudioBuffer<float>& dest)
+    {
+        for (int i = 0; i < nBands; ++i)
+            designBand (i, nBands, xOverFreqs, sampleRate, firLen, dest.getWritePointer (i));
+    }
+};
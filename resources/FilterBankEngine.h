@@ -0,0 +1,183 @@
+/*
+ ==============================================================================
+ FilterBankEngine.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "Delay.h"
+#include "KernelCache.h"
+#include "ConvolutionLoader.h"
+
+/* One configuration of the band split: number of bands, zero delay mode and band kernels.
+   The processor holds one per scene and four more: two take turns for parameter changes and
+   two hold the inactive layer while morphing. A new configuration is designed on the shared
+   EngineDesignPool and runs next to the current one until it can be crossfaded in. configure()
+   may only be called while the audio thread does not process the engine, loadBand() at any time. */
+class FilterBankEngine
+{
+public:
+    FilterBankEngine() {}
+    
+    ~FilterBankEngine()
+    {
+        for (auto& convolver : convolvers)
+            if (convolver != nullptr)
+                loader->cancelLoads (*convolver);
+    }
+    
+    void prepare (const dsp::ProcessSpec& spec)
+    {
+        processSpec = spec;
+        dsp::ProcessSpec delaySpec {spec.sampleRate, spec.maximumBlockSize, 2};
+        delay.prepare (delaySpec);
+    }
+    
+    // bandKernels holds the kernels of all bands (unused without convolution), latency is the delay of the kernels in samples
+    void configure (int numBands, bool zeroDelayMode, const KernelCache::Kernel* bandKernels, int filterLength, int latency)
+    {
+        nBands = zeroDelayMode ? 1 : numBands;
+        zeroDelay = zeroDelayMode;
+        firLen = filterLength;
+        latencySamples = zeroDelay ? 0 : latency;
+        samplesProcessed = 0;
+        
+        // fresh convolvers start with a unity impulse, so isReady() can tell when the kernels are in use
+        dsp::ProcessSpec convSpec {processSpec.sampleRate, processSpec.maximumBlockSize, 1};
+        for (int i = 0; i < 10; ++i)
+        {
+            if (convolvers[i] != nullptr)
+                loader->cancelLoads (*convolvers[i]);
+            convolvers[i].reset();
+            if (usesConvolution() && i < 2 * nBands)
+            {
+                convolvers[i] = loader->createConvolution();
+                convolvers[i]->prepare (convSpec); // must be called before loading IR
+            }
+        }
+        
+        for (auto& kernel : kernels)
+            kernel.reset();
+        if (usesConvolution())
+            for (int i = 0; i < nBands; ++i)
+                loadBand (i, bandKernels[i]);
+        
+        // 1 band without zero delay: delay the signals like the filter bank would
+        if (nBands == 1 && !zeroDelay)
+            delay.setDelayTime (static_cast<float> (latencySamples) / processSpec.sampleRate);
+        else
+            delay.setDelayTime (0.0f);
+    }
+    
+    // the convolvers swap in the new kernel on the shared loader thread
+    void loadBand (int band, KernelCache::Kernel kernel)
+    {
+        if (!usesConvolution() || band >= nBands)
+            return;
+        
+        jassert (kernel != nullptr && kernel->getNumSamples() == firLen);
+        kernels[band] = kernel; // keeps the shared kernel alive while in use
+        
+        for (int i = 2 * band; i < 2 * band + 2; ++i) // omni and eight
+        {
+            AudioBuffer<float> ir (*kernel);
+            loader->loadImpulseResponse (*convolvers[i], std::move (ir), processSpec.sampleRate);
+        }
+    }
+    
+    // posts the kernels of all bands again, in case a load got lost on its way to the convolvers
+    void reloadBands()
+    {
+        for (int i = 0; i < nBands; ++i)
+            if (kernels[i] != nullptr)
+                loadBand (i, kernels[i]);
+    }
+    
+    // audio thread: true as soon as all convolvers use their kernels or the delay line is filled
+    bool isReady() const
+    {
+        if (!usesConvolution())
+            return samplesProcessed >= latencySamples;
+        
+        for (int i = 0; i < 2 * nBands; ++i)
+            if (convolvers[i]->getCurrentIRSize() != firLen)
+                return false;
+        return true;
+    }
+    
+    // splits the omni and eight signals into the first 2 * nBands channels of bands
+    void process (const AudioBuffer<float>& omniEight, AudioBuffer<float>& bands, int numSamples)
+    {
+        for (int i = 0; i < nBands; ++i)
+        {
+            bands.copyFrom (2 * i, 0, omniEight, 0, 0, numSamples);
+            bands.copyFrom (2 * i + 1, 0, omniEight, 1, 0, numSamples);
+        }
+        
+        if (usesConvolution())
+        {
+            for (int i = 0; i < 2 * nBands; ++i)
+            {
+                float* writePointer = bands.getWritePointer (i);
+                dsp::AudioBlock<float> subBlk (&writePointer, 1, numSamples);
+                dsp::ProcessContextReplacing<float> filterCtx (subBlk);
+                convolvers[i]->process (filterCtx); // mono processing
+            }
+        }
+        else if (!zeroDelay)
+        {
+            dsp::AudioBlock<float> delayBlock = dsp::AudioBlock<float> (bands).getSubsetChannelBlock (0, 2).getSubBlock (0, numSamples);
+            dsp::ProcessContextReplacing<float> delayContext (delayBlock);
+            delay.process (delayContext);
+        }
+        
+        if (samplesProcessed < latencySamples)
+            samplesProcessed += numSamples;
+    }
+    
+    // a 1-band engine only has to fill its delay line, convolvers need time to swap in their kernels
+    bool usesConvolution() const { return nBands > 1 && !zeroDelay; }
+    
+    int getNumBands() const { return nBands; }
+    bool isZeroDelay() const { return zeroDelay; }
+    int getFirLength() const { return firLen; }
+    int getLatency() const { return latencySamples; }
+    
+private:
+    dsp::ProcessSpec processSpec {48000.0, 512, 1};
+    int nBands = 1;
+    bool zeroDelay = false;
+    int firLen = 0;
+    int latencySamples = 0;
+    int samplesProcessed = 0; // since configure(), up to the latency
+    
+    SharedResourcePointer<ConvolutionLoader> loader;
+    std::unique_ptr<dsp::Convolution> convolvers[10]; // 2*nBands mono convolvers
+    KernelCache::Kernel kernels[5];
+    Delay delay;
+};
+
+// threads shared by all plugin instances for designing engines, so a session restore designs them in parallel
+struct EngineDesignPool
+{
+    EngineDesignPool() : pool (jmax (1, SystemStats::getNumCpus() - 1)) {}
+    
+    ThreadPool pool;
+};
@@ -0,0 +1,109 @@
+/*
+ ==============================================================================
+ KernelCache.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "FilterBankDesign.h"
+#include <map>
+
+/* Process wide cache of filter kernels, shared by all plugin instances through a SharedResourcePointer.
+   Kernels are immutable and keyed by their design parameters, so instances with the same configuration
+   share one copy. An entry lives as long as an instance holds its Kernel. Only the time-domain kernels
+   are shared: every dsp::Convolution loads its own copy and computes its own partitions and spectra,
+   so those are still duplicated per instance. */
+class KernelCache
+{
+public:
+    using Kernel = std::shared_ptr<const AudioBuffer<float>>;
+    
+    KernelCache() {}
+    ~KernelCache() {}
+    
+    // kernel of one filter bank band, xOverFreqs in Hz
+    Kernel getBandKernel (int band, int nBands, const float* xOverFreqs, double sampleRate, int firLen)
+    {
+        String key = "band " + String (band) + "/" + String (nBands) + " " + String (sampleRate) + " " + String (firLen);
+        for (int i = 0; i < nBands - 1; ++i)
+            key << " " << String (xOverFreqs[i], 3);
+        
+        return getKernel (key, firLen, [&] (float* dest)
+        {
+            FilterBankDesign::designBand (band, nBands, xOverFreqs, sampleRate, firLen, dest);
+        });
+    }
+    
+    // constant impulse response, e.g. an equalizer, which only needs to be copied once
+    Kernel getImpulseResponse (const String& name, const float* coefficients, int length)
+    {
+        return getKernel ("ir " + name, length, [&] (float* dest)
+        {
+            FloatVectorOperations::copy (dest, coefficients, length);
+        });
+    }
+    
+    int getNumKernels()
+    {
+        const ScopedLock lock (cacheLock);
+        removeExpiredKernels();
+        return static_cast<int> (kernels.size());
+    }
+    
+private:
+    Kernel getKernel (const String& key, int length, std::function<void (float*)> design)
+    {
+        {
+            const ScopedLock lock (cacheLock);
+            auto it = kernels.find (key);
+            if (it != kernels.end())
+                if (auto kernel = it->second.lock())
+                    return kernel;
+        }
+        
+        // design outside of the lock, so several instances can design different kernels at the same time
+        auto buffer = std::make_shared<AudioBuffer<float>> (1, length);
+        design (buffer->getWritePointer (0));
+        Kernel kernel = buffer;
+        
+        const ScopedLock lock (cacheLock);
+        auto& entry = kernels[key];
+        if (auto existing = entry.lock()) // designed by another instance meanwhile
+            return existing;
+        
+        entry = kernel;
+        removeExpiredKernels();
+        return kernel;
+    }
+    
+    void removeExpiredKernels()
+    {
+        for (auto it = kernels.begin(); it != kernels.end();)
+        {
+            if (it->second.expired())
+                it = kernels.erase (it);
+            else
+                ++it;
+        }
+    }
+    
+    CriticalSection cacheLock;
+    std::map<String, std::weak_ptr<const AudioBuffer<float>>> kernels;
+};
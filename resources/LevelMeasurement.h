@@ -0,0 +1,112 @@
+/*
+ ==============================================================================
+ LevelMeasurement.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// vectorised block measurements for meters and signal statistics
+struct LevelMeasurement
+{
+    static float getDotProduct (const float* a, const float* b, int numSamples)
+    {
+        using Register = dsp::SIMDRegister<float>;
+        constexpr int regSize = static_cast<int> (Register::size());
+        
+        // SIMD loads need aligned data, the block start may not be
+        const int head = jmin (numSamples, static_cast<int> (Register::getNextSIMDAlignedPtr (const_cast<float*> (a)) - a));
+        float sum = 0.0f;
+        int i = 0;
+        for (; i < head; ++i)
+            sum += a[i] * b[i];
+        
+        if (Register::isSIMDAligned (b + i))
+        {
+            Register acc = Register::expand (0.0f);
+            for (; i + regSize <= numSamples; i += regSize)
+                acc += Register::fromRawArray (a + i) * Register::fromRawArray (b + i);
+            sum += acc.sum();
+        }
+        
+        for (; i < numSamples; ++i)
+            sum += a[i] * b[i];
+        return sum;
+    }
+    
+    static float getSumOfSquares (const float* data, int numSamples)
+    {
+        return getDotProduct (data, data, numSamples);
+    }
+    
+    static float getPeak (const float* data, int numSamples)
+    {
+        if (numSamples <= 0)
+            return 0.0f;
+        
+        auto range = FloatVectorOperations::findMinAndMax (data, numSamples);
+        return jmax (-range.getStart(), range.getEnd());
+    }
+    
+    static constexpr float meterMinDb = -60.0f;
+    
+    // falling ballistics for meter displays, called at the editor's refresh rate
+    static float applyMeterBallistics (float displayedDb, float gain, float fallDb = 1.5f)
+    {
+        return jmax (Decibels::gainToDecibels (gain, meterMinDb), displayedDb - fallDb);
+    }
+    
+    // 0 = meterMinDb, 1 = 0 dBFS
+    static float getMeterProportion (float db)
+    {
+        return jlimit (0.0f, 1.0f, (db - meterMinDb) / -meterMinDb);
+    }
+};
+
+struct BandLevels
+{
+    float omniRms = 0.0f;
+    float omniPeak = 0.0f;
+    float eightRms = 0.0f;
+    float eightPeak = 0.0f;
+    float outputRms = 0.0f; // band contribution to the output, before mute and solo
+    
+    // direction of arrival: cosine of the angle to the front and coherence between omni and eight
+    float arrivalCos = 1.0f;
+    float arrivalConfidence = 0.0f;
+};
+
+struct LevelSnapshot
+{
+    BandLevels bands[5];
+    float outputRms = 0.0f;
+    float outputPeak = 0.0f;
+    int nActiveBands = 0;
+    
+    // nothing a meter would show
+    bool isSilent() const
+    {
+        const float threshold = Decibels::decibelsToGain (LevelMeasurement::meterMinDb);
+        for (const auto& band : bands)
+            if (band.omniPeak > threshold || band.eightPeak > threshold)
+                return false;
+        return outputPeak <= threshold;
+    }
+};
@@ -0,0 +1,347 @@
+/*
+ ==============================================================================
+ OfflinePatternOptimizer.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "FilterBankDesign.h"
+#include "KernelCache.h"
+#include "PatternOptimization.h"
+
+/* Computes the terminator patterns from recorded capsule stems instead of live playback.
+   The stems are filtered with the plugin's proximity compensation and equalization, split into
+   bands with its filter bank and the band covariances are accumulated on a thread pool, one job
+   per stem and band. */
+class OfflinePatternOptimizer
+{
+public:
+    struct Stem
+    {
+        File front;                 // front capsule, or a stereo file holding front and back
+        File back;                  // back capsule, leave empty if front is a stereo file
+        bool isDisturber = true;    // disturber (spill) or signal (target) region
+    };
+    
+    // current plugin state, everything but the directivity factors is copied to the preset
+    struct Settings
+    {
+        int nBands = 5;
+        float xOverFreqs[4] = {150.0f, 600.0f, 2600.0f, 8000.0f}; // Hz
+        float alphaMin = 0.0f; // -0.5 if reverse patterns are allowed
+        int filterQuality = FilterBankDesign::defaultQuality;
+        float dirFactors[5] = {}; // kept for bands without recorded material
+        float bandGains[5] = {};
+        float solo[5] = {};
+        float mute[5] = {};
+        int ffDfEq = 0;
+        float proximity = 0.0f;
+        String description;
+        
+        // applied before the band split like in processBlock, so leave them empty in zero delay mode
+        KernelCache::Kernel eqOmni, eqEight; // nullptr without equalization
+        double eqSampleRate = 48000.0;
+        std::function<dsp::IIR::Coefficients<float> (double sampleRate)> proximityFilter; // empty without proximity compensation
+        bool proxOnEight = true;
+    };
+    
+    // blocking, on success preset holds the same properties savePreset writes
+    static Result process (const Array<Stem>& stems, const Settings& settings, var& preset,
+                           int numThreads = SystemStats::getNumCpus())
+    {
+        if (stems.isEmpty())
+            return Result::fail ("No stems to analyse!");
+        
+        // read all stems and create omni and eight signals
+        OwnedArray<StemData> stemData;
+        for (int i = 0; i < stems.size(); ++i)
+            stemData.add (new StemData());
+        
+        runInParallel (stems.size(), numThreads, [&] (int i)
+        {
+            loadStem (stems.getReference (i), *stemData[i]);
+            if (stemData[i]->error.isEmpty())
+                applyInputFilters (settings, *stemData[i]);
+        });
+        
+        for (auto* data : stemData)
+            if (data->error.isNotEmpty())
+                return Result::fail (data->error);
+        
+        // band split and covariances, one job per stem and band
+        const int nBands = jlimit (1, 5, settings.nBands);
+        std::vector<BandCovariance> covariances (stems.size() * nBands);
+        
+        runInParallel (stems.size() * nBands, numThreads, [&] (int job)
+        {
+            const int stem = job / nBands;
+            const int band = job % nBands;
+            covariances[job] = computeBandCovariance (*stemData[stem], band, nBands, settings.xOverFreqs, settings.filterQuality);
+        });
+        
+        // average over all stems of a kind, weighted by their length
+        BandCovariance disturberCov[5], signalCov[5];
+        int64 disturberSamples = 0, signalSamples = 0;
+        for (int stem = 0; stem < stems.size(); ++stem)
+        {
+            const bool isDisturber = stems.getReference (stem).isDisturber;
+            const int numSamples = stemData[stem]->omniEight.getNumSamples();
+            for (int band = 0; band < nBands; ++band)
+            {
+                BandCovariance cov = covariances[stem * nBands + band];
+                cov.scale (static_cast<float> (numSamples));
+                (isDisturber ? disturberCov[band] : signalCov[band]).add (cov);
+            }
+            (isDisturber ? disturberSamples : signalSamples) += numSamples;
+        }
+        
+        float dirFactors[5];
+        for (int band = 0; band < 5; ++band)
+        {
+            dirFactors[band] = settings.dirFactors[band];
+            if (band >= nBands)
+                continue;
+            
+            float power = 0.0f;
+            float alpha;
+            if (disturberSamples > 0 && signalSamples > 0)
+            {
+                disturberCov[band].scale (1.0f / disturberSamples);
+                signalCov[band].scale (1.0f / signalSamples);
+                alpha = PatternOptimizer::findMaximumRatioAlpha (signalCov[band], disturberCov[band], settings.alphaMin, 1.0f, &power);
+            }
+            else if (disturberSamples > 0)
+            {
+                disturberCov[band].scale (1.0f / disturberSamples);
+                alpha = PatternOptimizer::findMinimumPowerAlpha (disturberCov[band], settings.alphaMin, 1.0f, &power);
+            }
+            else
+            {
+                signalCov[band].scale (1.0f / signalSamples);
+                alpha = PatternOptimizer::findMaximumPowerAlpha (signalCov[band], settings.alphaMin, 1.0f, &power);
+            }
+            
+            if (power != 0.0f) // silent band, keep the current pattern
+                dirFactors[band] = alpha;
+        }
+        
+        preset = createPreset (settings, dirFactors);
+        return Result::ok();
+    }
+    
+private:
+    struct StemData
+    {
+        AudioBuffer<float> omniEight;
+        double sampleRate = 0.0;
+        String error;
+    };
+    
+    template <typename JobFunction>
+    static void runInParallel (int numJobs, int numThreads, JobFunction&& jobFunction)
+    {
+        if (numJobs <= 0)
+            return;
+        
+        ThreadPool pool (jlimit (1, numJobs, numThreads));
+        std::atomic<int> remainingJobs { numJobs };
+        WaitableEvent finished;
+        for (int i = 0; i < numJobs; ++i)
+        {
+            pool.addJob ([&, i]
+            {
+                jobFunction (i);
+                if (--remainingJobs == 0)
+                    finished.signal();
+            });
+        }
+        finished.wait();
+    }
+    
+    static void loadStem (const Stem& stem, StemData& data)
+    {
+        AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+        
+        std::unique_ptr<AudioFormatReader> frontReader (formatManager.createReaderFor (stem.front));
+        if (frontReader == nullptr)
+        {
+            data.error = "Could not read " + stem.front.getFullPathName() + ".";
+            return;
+        }
+        
+        const int numSamples = static_cast<int> (frontReader->lengthInSamples);
+        data.sampleRate = frontReader->sampleRate;
+        AudioBuffer<float> capsules (2, numSamples);
+        
+        if (stem.back == File())
+        {
+            if (frontReader->numChannels != 2)
+            {
+                data.error = stem.front.getFileName() + " needs to hold the front and back capsule signals.";
+                return;
+            }
+            frontReader->read (&capsules, 0, numSamples, 0, true, true);
+        }
+        else
+        {
+            std::unique_ptr<AudioFormatReader> backReader (formatManager.createReaderFor (stem.back));
+            if (backReader == nullptr)
+            {
+                data.error = "Could not read " + stem.back.getFullPathName() + ".";
+                return;
+            }
+            if (backReader->sampleRate != data.sampleRate || backReader->lengthInSamples != frontReader->lengthInSamples)
+            {
+                data.error = stem.front.getFileName() + " and " + stem.back.getFileName() + " need to have the same length and sample rate.";
+                return;
+            }
+            frontReader->read (capsules.getArrayOfWritePointers(), 1, 0, numSamples);
+            backReader->read (capsules.getArrayOfWritePointers() + 1, 1, 0, numSamples);
+        }
+        
+        // omni = front + back, eight = front - back
+        data.omniEight.setSize (2, numSamples);
+        FloatVectorOperations::add (data.omniEight.getWritePointer (0), capsules.getReadPointer (0), capsules.getReadPointer (1), numSamples);
+        FloatVectorOperations::subtract (data.omniEight.getWritePointer (1), capsules.getReadPointer (0), capsules.getReadPointer (1), numSamples);
+    }
+    
+    static void applyInputFilters (const Settings& settings, StemData& data)
+    {
+        const int numSamples = data.omniEight.getNumSamples();
+        
+        if (settings.proximityFilter)
+        {
+            dsp::IIR::Filter<float> filter (new dsp::IIR::Coefficients<float> (settings.proximityFilter (data.sampleRate)));
+            float* channel = data.omniEight.getWritePointer (settings.proxOnEight ? 1 : 0);
+            dsp::AudioBlock<float> block (&channel, 1, numSamples);
+            dsp::ProcessContextReplacing<float> context (block);
+            filter.process (context);
+        }
+        
+        if (settings.eqOmni != nullptr && settings.eqEight != nullptr)
+        {
+            equalize (*settings.eqOmni, settings.eqSampleRate, data.sampleRate, data.omniEight.getWritePointer (0), numSamples);
+            equalize (*settings.eqEight, settings.eqSampleRate, data.sampleRate, data.omniEight.getWritePointer (1), numSamples);
+        }
+    }
+    
+    // the impulse response is resampled to the stem's rate, as dsp::Convolution does when loading it
+    static void equalize (const AudioBuffer<float>& ir, double irSampleRate, double sampleRate, float* samples, int numSamples)
+    {
+        const double ratio = irSampleRate / sampleRate;
+        const int irLength = jmax (1, static_cast<int> (std::ceil (ir.getNumSamples() / ratio)));
+        std::vector<float> resampled (irLength);
+        if (ratio == 1.0)
+        {
+            std::copy (ir.getReadPointer (0), ir.getReadPointer (0) + irLength, resampled.begin());
+        }
+        else
+        {
+            std::vector<float> padded (ir.getNumSamples() + 8, 0.0f); // the interpolator reads ahead
+            std::copy (ir.getReadPointer (0), ir.getReadPointer (0) + ir.getNumSamples(), padded.begin());
+            LagrangeInterpolator interpolator;
+            interpolator.process (ratio, padded.data(), resampled.data(), irLength);
+        }
+        
+        std::vector<float> output (numSamples, 0.0f);
+        convolve (samples, numSamples, resampled.data(), irLength, output.data());
+        std::copy (output.begin(), output.end(), samples);
+    }
+    
+    static BandCovariance computeBandCovariance (const StemData& data, int band, int nBands, const float* xOverFreqs, int filterQuality)
+    {
+        const int numSamples = data.omniEight.getNumSamples();
+        BandCovariance cov;
+        
+        // only one band: no filtering
+        if (nBands == 1)
+        {
+            cov.setFromBlock (data.omniEight.getReadPointer (0), data.omniEight.getReadPointer (1), numSamples);
+            return cov;
+        }
+        
+        const int firLen = FilterBankDesign::getFirLength (data.sampleRate, filterQuality);
+        std::vector<float> fir (firLen);
+        FilterBankDesign::designBand (band, nBands, xOverFreqs, data.sampleRate, firLen, fir.data());
+        
+        AudioBuffer<float> filtered (2, numSamples);
+        filtered.clear();
+        for (int ch = 0; ch < 2; ++ch)
+            convolve (data.omniEight.getReadPointer (ch), numSamples, fir.data(), firLen, filtered.getWritePointer (ch));
+        
+        cov.setFromBlock (filtered.getReadPointer (0), filtered.getReadPointer (1), numSamples);
+        return cov;
+    }
+    
+    // fft overlap-add convolution, adds the first numSamples output samples to output
+    static void convolve (const float* input, int numSamples, const float* ir, int irLength, float* output)
+    {
+        const int fftOrder = jmax (1, static_cast<int> (std::ceil (std::log2 (irLength))) + 2);
+        const int fftSize = 1 << fftOrder;
+        const int blockSize = fftSize - irLength + 1;
+        dsp::FFT fft (fftOrder);
+        
+        std::vector<float> irSpectrum (2 * fftSize, 0.0f);
+        std::copy (ir, ir + irLength, irSpectrum.begin());
+        fft.performRealOnlyForwardTransform (irSpectrum.data());
+        
+        std::vector<float> block (2 * fftSize);
+        for (int pos = 0; pos < numSamples; pos += blockSize)
+        {
+            const int len = jmin (blockSize, numSamples - pos);
+            std::fill (block.begin(), block.end(), 0.0f);
+            std::copy (input + pos, input + pos + len, block.begin());
+            fft.performRealOnlyForwardTransform (block.data());
+            
+            for (int k = 0; k < fftSize; ++k)
+            {
+                const float re = block[2 * k] * irSpectrum[2 * k] - block[2 * k + 1] * irSpectrum[2 * k + 1];
+                const float im = block[2 * k] * irSpectrum[2 * k + 1] + block[2 * k + 1] * irSpectrum[2 * k];
+                block[2 * k] = re;
+                block[2 * k + 1] = im;
+            }
+            fft.performRealOnlyInverseTransform (block.data());
+            
+            const int outLen = jmin (fftSize, numSamples - pos);
+            FloatVectorOperations::add (output + pos, block.data(), outLen);
+        }
+    }
+    
+    static var createPreset (const Settings& settings, const float* dirFactors)
+    {
+        DynamicObject* jsonObj = new DynamicObject();
+        jsonObj->setProperty ("Description", settings.description);
+        jsonObj->setProperty ("nrActiveBands", settings.nBands);
+        for (int i = 0; i < 4; ++i)
+            jsonObj->setProperty ("xOverF" + String(i+1), static_cast<int> (settings.xOverFreqs[i]));
+        for (int i = 0; i < 5; ++i)
+            jsonObj->setProperty ("dirFactor" + String(i+1), dirFactors[i]);
+        for (int i = 0; i < 5; ++i)
+            jsonObj->setProperty ("gain" + String(i+1), settings.bandGains[i]);
+        for (int i = 0; i < 5; ++i)
+            jsonObj->setProperty ("solo" + String(i+1), settings.solo[i]);
+        for (int i = 0; i < 5; ++i)
+            jsonObj->setProperty ("mute" + String(i+1), settings.mute[i]);
+        jsonObj->setProperty ("ffDfEq", settings.ffDfEq);
+        jsonObj->setProperty ("proximity", settings.proximity);
+        return var (jsonObj);
+    }
+};
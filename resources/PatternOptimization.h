@@ -0,0 +1,161 @@
+/*
+ ==============================================================================
+ PatternOptimization.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LevelMeasurement.h"
+
+// second order statistics of the omni and fig-of-eight signals of one band
+struct BandCovariance
+{
+    float omniSq = 0.0f;
+    float eightSq = 0.0f;
+    float omniEight = 0.0f;
+
+    void clear()
+    {
+        omniSq = 0.0f;
+        eightSq = 0.0f;
+        omniEight = 0.0f;
+    }
+
+    // mean energy of one block
+    void setFromBlock (const float* omni, const float* eight, int numSamples)
+    {
+        clear();
+        if (numSamples <= 0)
+            return;
+
+        omniSq = LevelMeasurement::getSumOfSquares (omni, numSamples) / numSamples;
+        eightSq = LevelMeasurement::getSumOfSquares (eight, numSamples) / numSamples;
+        omniEight = LevelMeasurement::getDotProduct (omni, eight, numSamples) / numSamples;
+    }
+
+    void add (const BandCovariance& other)
+    {
+        omniSq += other.omniSq;
+        eightSq += other.eightSq;
+        omniEight += other.omniEight;
+    }
+
+    void scale (float factor)
+    {
+        omniSq *= factor;
+        eightSq *= factor;
+        omniEight *= factor;
+    }
+
+    // first order recursive averaging, coeff is the weight of the old estimate
+    void smooth (const BandCovariance& newEstimate, float coeff)
+    {
+        omniSq = coeff * omniSq + (1.0f - coeff) * newEstimate.omniSq;
+        eightSq = coeff * eightSq + (1.0f - coeff) * newEstimate.eightSq;
+        omniEight = coeff * omniEight + (1.0f - coeff) * newEstimate.omniEight;
+    }
+
+    // energy of the pattern (1-|alpha|) * omni + alpha * eight
+    float getPatternPower (float alpha) const
+    {
+        const float omniWeight = 1.0f - std::abs (alpha);
+        return omniWeight * omniWeight * omniSq + alpha * alpha * eightSq + 2.0f * omniWeight * alpha * omniEight;
+    }
+};
+
+// brute force search of the optimal directivity factor within [alphaMin, alphaMax]
+class PatternOptimizer
+{
+public:
+    static constexpr float alphaStep = 0.01f;
+
+    static float findMinimumPowerAlpha (const BandCovariance& cov, float alphaMin, float alphaMax, float* minPower = nullptr)
+    {
+        float bestAlpha = alphaMin;
+        float bestPower = cov.getPatternPower (alphaMin);
+        const int nSteps = getNumSteps (alphaMin, alphaMax);
+        for (int i = 1; i <= nSteps; ++i)
+        {
+            const float alpha = jmin (alphaMin + i * alphaStep, alphaMax);
+            const float power = cov.getPatternPower (alpha);
+            if (power < bestPower)
+            {
+                bestPower = power;
+                bestAlpha = alpha;
+            }
+        }
+        if (minPower != nullptr)
+            *minPower = bestPower;
+        return bestAlpha;
+    }
+
+    static float findMaximumPowerAlpha (const BandCovariance& cov, float alphaMin, float alphaMax, float* maxPower = nullptr)
+    {
+        float bestAlpha = alphaMin;
+        float bestPower = cov.getPatternPower (alphaMin);
+        const int nSteps = getNumSteps (alphaMin, alphaMax);
+        for (int i = 1; i <= nSteps; ++i)
+        {
+            const float alpha = jmin (alphaMin + i * alphaStep, alphaMax);
+            const float power = cov.getPatternPower (alpha);
+            if (power > bestPower)
+            {
+                bestPower = power;
+                bestAlpha = alpha;
+            }
+        }
+        if (maxPower != nullptr)
+            *maxPower = bestPower;
+        return bestAlpha;
+    }
+
+    // maximizes signal energy / disturber energy, ratio is 0 if the disturber is silent
+    static float findMaximumRatioAlpha (const BandCovariance& sig, const BandCovariance& dist, float alphaMin, float alphaMax, float* maxRatio = nullptr)
+    {
+        float bestAlpha = alphaMin;
+        float bestRatio = getRatio (sig, dist, alphaMin);
+        const int nSteps = getNumSteps (alphaMin, alphaMax);
+        for (int i = 1; i <= nSteps; ++i)
+        {
+            const float alpha = jmin (alphaMin + i * alphaStep, alphaMax);
+            const float ratio = getRatio (sig, dist, alpha);
+            if (ratio > bestRatio)
+            {
+                bestRatio = ratio;
+                bestAlpha = alpha;
+            }
+        }
+        if (maxRatio != nullptr)
+            *maxRatio = bestRatio;
+        return bestAlpha;
+    }
+
+private:
+    static int getNumSteps (float alphaMin, float alphaMax)
+    {
+        return jmax (0, static_cast<int> (std::ceil ((alphaMax - alphaMin) / alphaStep - 0.001f)));
+    }
+
+    static float getRatio (const BandCovariance& sig, const BandCovariance& dist, float alpha)
+    {
+        const float distPower = dist.getPatternPower (alpha);
+        return distPower == 0.0f ? 0.0f : sig.getPatternPower (alpha) / distPower;
+    }
+};
@@ -0,0 +1,174 @@
+/*
+ ==============================================================================
+ PluginStateFormat.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+
+/* Compact binary plugin state: magic, version, the A and B layers and (since version 2) the number of
+   scenes followed by the scene layers. Each layer stores its number of parameter values followed by the
+   values (in the processor's fixed parameter order, which may only be appended to), the eq selection and
+   the stored proximity distance. A layer or scene which has never been used has no values. Older sessions
+   are stored as XML, read() rejects them so the caller can fall back. */
+class PluginStateFormat
+{
+public:
+    static constexpr uint32 magic = 0x74534450; // "PDSt"
+    static constexpr uint32 version = 2;
+    static constexpr int maxValues = 64;
+    
+    struct Layer
+    {
+        int numValues = 0;
+        float values[maxValues];
+        int ffDfEq = 0;
+        float oldProxDistance = 0.0f;
+    };
+    
+    static size_t getSize (const Layer& a, const Layer& b, const Layer* scenes, int numScenes)
+    {
+        size_t size = 3 * sizeof (uint32) + getLayerSize (a) + getLayerSize (b);
+        for (int i = 0; i < numScenes; ++i)
+            size += getLayerSize (scenes[i]);
+        return size;
+    }
+    
+    // writes both layers and the scenes into dest, which is only resized if its size doesn't match
+    static void write (MemoryBlock& dest, const Layer& a, const Layer& b, const Layer* scenes, int numScenes)
+    {
+        const size_t size = getSize (a, b, scenes, numScenes);
+        if (dest.getSize() != size)
+            dest.setSize (size);
+        
+        char* pos = static_cast<char*> (dest.getData());
+        writeInt (pos, magic);
+        writeInt (pos, version);
+        writeLayer (pos, a);
+        writeLayer (pos, b);
+        writeInt (pos, static_cast<uint32> (numScenes));
+        for (int i = 0; i < numScenes; ++i)
+            writeLayer (pos, scenes[i]);
+    }
+    
+    // returns false if data is not a binary state of a supported version, scenes missing in data are left empty
+    static bool read (const void* data, int sizeInBytes, Layer& a, Layer& b, Layer* scenes, int numScenes)
+    {
+        const char* pos = static_cast<const char*> (data);
+        const char* end = pos + sizeInBytes;
+        
+        uint32 value;
+        if (!readInt (pos, end, value) || value != magic)
+            return false;
+        if (!readInt (pos, end, value) || value == 0 || value > version)
+            return false;
+        const uint32 stateVersion = value;
+        
+        if (!readLayer (pos, end, a) || !readLayer (pos, end, b))
+            return false;
+        
+        for (int i = 0; i < numScenes; ++i)
+            scenes[i].numValues = 0;
+        
+        if (stateVersion < 2)
+            return true;
+        
+        uint32 numStoredScenes;
+        if (!readInt (pos, end, numStoredScenes))
+            return false;
+        
+        Layer skipped;
+        for (uint32 i = 0; i < numStoredScenes; ++i)
+            if (!readLayer (pos, end, i < static_cast<uint32> (numScenes) ? scenes[i] : skipped))
+                return false;
+        return true;
+    }
+    
+private:
+    static size_t getLayerSize (const Layer& layer)
+    {
+        return (3 + static_cast<size_t> (layer.numValues)) * sizeof (uint32);
+    }
+    
+    static void writeInt (char*& pos, uint32 value)
+    {
+        value = ByteOrder::swapIfBigEndian (value);
+        std::memcpy (pos, &value, sizeof (value));
+        pos += sizeof (value);
+    }
+    
+    static void writeFloat (char*& pos, float value)
+    {
+        uint32 bits;
+        std::memcpy (&bits, &value, sizeof (bits));
+        writeInt (pos, bits);
+    }
+    
+    static void writeLayer (char*& pos, const Layer& layer)
+    {
+        writeInt (pos, static_cast<uint32> (layer.numValues));
+        for (int i = 0; i < layer.numValues; ++i)
+            writeFloat (pos, layer.values[i]);
+        writeInt (pos, static_cast<uint32> (layer.ffDfEq));
+        writeFloat (pos, layer.oldProxDistance);
+    }
+    
+    static bool readInt (const char*& pos, const char* end, uint32& value)
+    {
+        if (end - pos < static_cast<int> (sizeof (value)))
+            return false;
+        std::memcpy (&value, pos, sizeof (value));
+        value = ByteOrder::swapIfBigEndian (value);
+        pos += sizeof (value);
+        return true;
+    }
+    
+    static bool readFloat (const char*& pos, const char* end, float& value)
+    {
+        uint32 bits;
+        if (!readInt (pos, end, bits))
+            return false;
+        std::memcpy (&value, &bits, sizeof (value));
+        return true;
+    }
+    
+    static bool readLayer (const char*& pos, const char* end, Layer& layer)
+    {
+        uint32 numValues, ffDfEq;
+        if (!readInt (pos, end, numValues))
+            return false;
+        
+        // values of parameters appended by newer versions are skipped
+        layer.numValues = static_cast<int> (jmin (numValues, static_cast<uint32> (maxValues)));
+        for (uint32 i = 0; i < numValues; ++i)
+        {
+            float value;
+            if (!readFloat (pos, end, value))
+                return false;
+            if (i < static_cast<uint32> (maxValues))
+                layer.values[i] = value;
+        }
+        
+        if (!readInt (pos, end, ffDfEq) || !readFloat (pos, end, layer.oldProxDistance))
+            return false;
+        layer.ffDfEq = static_cast<int> (ffDfEq);
+        return true;
+    }
+};
@@ -0,0 +1,268 @@
+/*
+ ==============================================================================
+ PresetLibrary.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <map>
+
+/* Index of the preset files (*.json) in a folder and its subfolders, shared by all plugin instances through a
+   SharedResourcePointer. A background thread scans the folder incrementally: files with unchanged size and
+   modification time are taken from the index, others are read and hashed and only parsed if their content
+   changed. The index (parsed parameters and content hash per file) is persisted, so listing, filtering and
+   recalling presets never touches the preset files or the JSON parser on the message thread. */
+class PresetLibrary : public ChangeBroadcaster, private Thread
+{
+public:
+    // pattern class of the mean directivity factor of the active bands
+    enum Pattern { anyPattern, omniPattern, cardioidPattern, eightPattern };
+    
+    struct Entry
+    {
+        File file;
+        int64 modificationTime = 0;
+        int64 size = 0;
+        String hash; // md5 of the file content
+        var preset; // parsed preset, void if the file is no valid preset
+        int nBands = 0;
+        Pattern pattern = anyPattern;
+        
+        String getName() const { return file.getFileNameWithoutExtension(); }
+    };
+    
+    PresetLibrary() : Thread ("PolarDesigner preset scanner") {}
+    
+    ~PresetLibrary() override
+    {
+        stopThread (5000);
+    }
+    
+    // scans folder in the background, the index of an earlier scan is published first
+    void scan (const File& newFolder, const File& newIndexFile)
+    {
+        stopThread (5000);
+        folder = newFolder;
+        indexFile = newIndexFile;
+        startThread();
+    }
+    
+    File getFolder() const { return folder; }
+    bool isScanning() const { return isThreadRunning(); }
+    
+    // nBands 0 and anyPattern match all presets
+    Array<Entry> findPresets (const String& searchText, int nBands, Pattern pattern) const
+    {
+        Array<Entry> result;
+        const ScopedLock sl (lock);
+        for (const auto& entry : entries)
+        {
+            if (entry.preset.isObject()
+                && (nBands == 0 || entry.nBands == nBands)
+                && (pattern == anyPattern || entry.pattern == pattern)
+                && (searchText.isEmpty() || entry.getName().containsIgnoreCase (searchText)))
+                result.add (entry);
+        }
+        return result;
+    }
+    
+    int getNumPresets() const
+    {
+        const ScopedLock sl (lock);
+        return entries.size();
+    }
+    
+    static Pattern getPattern (float dirFactor)
+    {
+        const float a = std::abs (dirFactor);
+        return a < 0.25f ? omniPattern : a < 0.75f ? cardioidPattern : eightPattern;
+    }
+    
+private:
+    void run() override
+    {
+        const File scanFolder = folder;
+        const File scanIndexFile = indexFile;
+        
+        // entries of the last scan by path, read from the index file if this folder wasn't scanned before
+        std::map<String, Entry> known;
+        {
+            Array<Entry> previous;
+            {
+                const ScopedLock sl (lock);
+                if (indexedFolder == scanFolder)
+                    previous = entries;
+            }
+            if (previous.isEmpty() && readIndex (scanIndexFile, scanFolder, previous))
+                publish (previous, scanFolder);
+            
+            for (const auto& entry : previous)
+                known[entry.file.getFullPathName()] = entry;
+        }
+        
+        if (!scanFolder.isDirectory())
+            return;
+        
+        Array<Entry> scanned;
+        bool changed = false;
+        for (const auto& item : RangedDirectoryIterator (scanFolder, true, "*.json"))
+        {
+            if (threadShouldExit())
+                return;
+            
+            Entry entry;
+            entry.file = item.getFile();
+            entry.modificationTime = item.getModificationTime().toMilliseconds();
+            entry.size = item.getFileSize();
+            
+            const auto it = known.find (entry.file.getFullPathName());
+            if (it != known.end() && it->second.modificationTime == entry.modificationTime && it->second.size == entry.size)
+            {
+                scanned.add (it->second);
+                continue;
+            }
+            
+            const String content = entry.file.loadFileAsString();
+            entry.hash = MD5 (content.toUTF8()).toHexString();
+            if (it != known.end() && it->second.hash == entry.hash)
+            {
+                entry.preset = it->second.preset;
+                entry.nBands = it->second.nBands;
+                entry.pattern = it->second.pattern;
+            }
+            else
+            {
+                parse (content, entry);
+            }
+            scanned.add (entry);
+            changed = true;
+        }
+        
+        changed = changed || scanned.size() != static_cast<int> (known.size());
+        publish (scanned, scanFolder);
+        if (changed || !scanIndexFile.existsAsFile())
+            writeIndex (scanIndexFile, scanFolder, scanned);
+    }
+    
+    void publish (Array<Entry>& newEntries, const File& newFolder)
+    {
+        {
+            const ScopedLock sl (lock);
+            entries.swapWith (newEntries);
+            indexedFolder = newFolder;
+        }
+        sendChangeMessage();
+    }
+    
+    static void parse (const String& content, Entry& entry)
+    {
+        var preset;
+        if (JSON::parse (content, preset).failed() || !preset.hasProperty ("nrActiveBands"))
+            return;
+        
+        entry.preset = preset;
+        entry.nBands = jlimit (1, 5, static_cast<int> (preset.getProperty ("nrActiveBands", 1)));
+        
+        float dirFactorSum = 0.0f;
+        for (int i = 0; i < entry.nBands; ++i)
+            dirFactorSum += static_cast<float> (preset.getProperty ("dirFactor" + String (i + 1), 0.0f));
+        entry.pattern = getPattern (dirFactorSum / entry.nBands);
+    }
+    
+    //==============================================================================
+    // the index is a binary ValueTree, each preset's parameters are stored as properties of a child
+    static bool readIndex (const File& file, const File& expectedFolder, Array<Entry>& result)
+    {
+        FileInputStream stream (file);
+        if (!stream.openedOk())
+            return false;
+        
+        const ValueTree index = ValueTree::readFromStream (stream);
+        if (!index.hasType ("PresetIndex") || index.getProperty ("folder").toString() != expectedFolder.getFullPathName())
+            return false;
+        
+        for (const auto& node : index)
+        {
+            Entry entry;
+            entry.file = File (node.getProperty ("file").toString());
+            entry.modificationTime = node.getProperty ("modified");
+            entry.size = node.getProperty ("size");
+            entry.hash = node.getProperty ("hash").toString();
+            
+            const ValueTree params = node.getChildWithName ("Parameters");
+            if (params.isValid())
+            {
+                DynamicObject::Ptr preset = new DynamicObject();
+                for (int i = 0; i < params.getNumProperties(); ++i)
+                {
+                    const Identifier name = params.getPropertyName (i);
+                    preset->setProperty (name, params.getProperty (name));
+                }
+                entry.preset = var (preset.get());
+                entry.nBands = node.getProperty ("nBands");
+                entry.pattern = static_cast<Pattern> (static_cast<int> (node.getProperty ("pattern")));
+            }
+            result.add (entry);
+        }
+        return true;
+    }
+    
+    static void writeIndex (const File& file, const File& scannedFolder, const Array<Entry>& indexEntries)
+    {
+        if (file == File())
+            return;
+        
+        ValueTree index ("PresetIndex");
+        index.setProperty ("folder", scannedFolder.getFullPathName(), nullptr);
+        for (const auto& entry : indexEntries)
+        {
+            ValueTree node ("Preset");
+            node.setProperty ("file", entry.file.getFullPathName(), nullptr);
+            node.setProperty ("modified", entry.modificationTime, nullptr);
+            node.setProperty ("size", entry.size, nullptr);
+            node.setProperty ("hash", entry.hash, nullptr);
+            
+            if (auto* preset = entry.preset.getDynamicObject())
+            {
+                node.setProperty ("nBands", entry.nBands, nullptr);
+                node.setProperty ("pattern", static_cast<int> (entry.pattern), nullptr);
+                
+                ValueTree params ("Parameters");
+                for (const auto& property : preset->getProperties())
+                    params.setProperty (property.name, property.value, nullptr);
+                node.appendChild (params, nullptr);
+            }
+            index.appendChild (node, nullptr);
+        }
+        
+        MemoryOutputStream stream;
+        index.writeToStream (stream);
+        file.replaceWithData (stream.getData(), stream.getDataSize());
+    }
+    
+    File folder;
+    File indexFile;
+    
+    CriticalSection lock;
+    Array<Entry> entries; // guarded by lock
+    File indexedFolder; // guarded by lock
+    
+    JUCE_DECLARE_NON_COPYABLE (PresetLibrary)
+};
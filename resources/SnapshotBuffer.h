@@ -0,0 +1,65 @@
+/*
+ ==============================================================================
+ SnapshotBuffer.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+
+/* Wait-free triple buffer for handing data from one writer thread to one reader thread, e.g.
+   from the audio to the message thread or back. Neither side ever blocks or allocates; the
+   reader always sees the most recently published, complete snapshot. */
+template <typename Type>
+class SnapshotBuffer
+{
+public:
+    SnapshotBuffer() = default;
+    
+    // writer: fill the returned object, then call publish()
+    Type& getWriteBuffer() { return buffers[writeIndex]; }
+    
+    void publish()
+    {
+        writeIndex = state.exchange (writeIndex | newDataFlag) & indexMask;
+    }
+    
+    // reader: fetches the latest snapshot if there is one, returns true if it changed
+    bool update()
+    {
+        if ((state.load() & newDataFlag) == 0)
+            return false;
+        
+        readIndex = state.exchange (readIndex) & indexMask;
+        return true;
+    }
+    
+    const Type& getReadBuffer() const { return buffers[readIndex]; }
+    
+private:
+    static constexpr int newDataFlag = 4;
+    static constexpr int indexMask = 3;
+    
+    Type buffers[3];
+    int writeIndex = 0;
+    int readIndex = 2;
+    std::atomic<int> state { 1 }; // index of the buffer in the middle plus newDataFlag
+    
+    JUCE_DECLARE_NON_COPYABLE (SnapshotBuffer)
+};
@@ -0,0 +1,258 @@
+/*
+ ==============================================================================
+ SpectrumAnalyzer.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AudioFifo.h"
+#include "SnapshotBuffer.h"
+
+/* Input and output spectra for the DirectivityEQ background. The audio thread only pushes
+   samples into a fifo while the analyzer is enabled, the FFTs and the mapping to the display
+   frequencies run on a background thread which publishes at most refreshRate times per second.
+   The thread polls the fifo once per hop and wakes up early for new display frequencies. */
+class SpectrumAnalyzer : private Thread
+{
+public:
+    static constexpr int fftOrder = 12;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int hopSize = fftSize / 4;
+    static constexpr int nBins = fftSize / 2 + 1;
+    static constexpr int refreshRate = 30;
+    static constexpr float minDb = -90.0f;
+    
+    // one value per display frequency
+    struct Spectra
+    {
+        std::vector<float> inputDb;
+        std::vector<float> outputDb;
+    };
+    
+    SpectrumAnalyzer() : Thread ("SpectrumAnalyzer"), fft (fftOrder),
+                         window (fftSize, dsp::WindowingFunction<float>::hann, false)
+    {
+        fftData.resize (2 * fftSize);
+        for (auto& power : smoothedPower)
+            power.resize (nBins, 0.0f);
+    }
+    
+    ~SpectrumAnalyzer() override
+    {
+        stopThread (1000);
+    }
+    
+    void prepare (double sampleRate)
+    {
+        stopThread (1000);
+        fs = sampleRate;
+        fifo.setSize (2, jmax (2 * fftSize, roundToInt (sampleRate / 4)));
+        pollInterval = jmax (1, roundToInt (1000.0 * hopSize / sampleRate));
+        frame.setSize (2, fftSize);
+        frequenciesChanged = true; // bin mapping depends on the sample rate
+        if (enabled.get())
+            startThread();
+    }
+    
+    // message thread, the thread only runs while an editor is showing
+    void setEnabled (bool shouldBeEnabled)
+    {
+        if (shouldBeEnabled == enabled.get())
+            return;
+        
+        enabled = shouldBeEnabled;
+        if (shouldBeEnabled)
+            startThread();
+        else
+            stopThread (500);
+    }
+    
+    bool isEnabled() const { return enabled.get(); }
+    
+    // audio thread, lock-free, the analyzer thread polls the fifo
+    void pushSamples (const float* input, const float* output, int numSamples)
+    {
+        const float* data[2] = { input, output };
+        fifo.push (data, 2, numSamples);
+    }
+    
+    // message thread, frequencies of the display pixels
+    void setFrequencies (const Array<double>& newFrequencies)
+    {
+        const ScopedLock sl (frequencyLock);
+        frequencies = newFrequencies;
+        frequenciesChanged = true;
+        notify();
+    }
+    
+    // reader side is the message thread
+    SnapshotBuffer<Spectra>& getSpectra() { return spectra; }
+    
+private:
+    // bins of one display frequency: a range if it covers whole bins, otherwise interpolated
+    struct BinMapping
+    {
+        int start = 0;
+        int end = -1;
+        float position = 0.0f;
+    };
+    
+    void run() override
+    {
+        // samples from the last time the editor was open are outdated
+        fifo.discard();
+        samplesInFrame = 0;
+        for (auto& power : smoothedPower)
+            std::fill (power.begin(), power.end(), 0.0f);
+        
+        while (!threadShouldExit())
+        {
+            if (frequenciesChanged.get())
+                updateBinMapping();
+            
+            bool analysed = false;
+            while (fifo.getNumReady() > 0 && !threadShouldExit())
+            {
+                float* dest[2] = { frame.getWritePointer (0, samplesInFrame), frame.getWritePointer (1, samplesInFrame) };
+                samplesInFrame += fifo.pull (dest, 2, fftSize - samplesInFrame);
+                
+                if (samplesInFrame == fftSize)
+                {
+                    analyseFrame();
+                    for (int ch = 0; ch < 2; ++ch)
+                        std::memmove (frame.getWritePointer (ch), frame.getReadPointer (ch, hopSize), sizeof (float) * (fftSize - hopSize));
+                    samplesInFrame = fftSize - hopSize;
+                    analysed = true;
+                }
+            }
+            
+            // decimate to the display frame rate
+            if (analysed && Time::getMillisecondCounter() - lastPublishTime >= 1000 / refreshRate)
+            {
+                lastPublishTime = Time::getMillisecondCounter();
+                publish();
+            }
+            
+            wait (pollInterval);
+        }
+    }
+    
+    void analyseFrame()
+    {
+        // hann window: a full scale sine results in a magnitude of fftSize / 4
+        const float scale = 4.0f / fftSize;
+        for (int ch = 0; ch < 2; ++ch)
+        {
+            FloatVectorOperations::copy (fftData.data(), frame.getReadPointer (ch), fftSize);
+            window.multiplyWithWindowingTable (fftData.data(), fftSize);
+            fft.performFrequencyOnlyForwardTransform (fftData.data(), true);
+            
+            auto& power = smoothedPower[ch];
+            for (int k = 0; k < nBins; ++k)
+            {
+                const float magnitude = fftData[k] * scale;
+                power[k] = smoothingCoeff * power[k] + (1.0f - smoothingCoeff) * magnitude * magnitude;
+            }
+        }
+    }
+    
+    void updateBinMapping()
+    {
+        Array<double> newFrequencies;
+        {
+            const ScopedLock sl (frequencyLock);
+            newFrequencies = frequencies;
+            frequenciesChanged = false;
+        }
+        
+        const int nPixels = newFrequencies.size();
+        const double binWidth = fs / fftSize;
+        binMapping.resize (nPixels);
+        for (int i = 0; i < nPixels; ++i)
+        {
+            // pixel edges halfway between neighbouring pixels on the log axis
+            const double f = newFrequencies[i];
+            const double lower = i > 0 ? std::sqrt (f * newFrequencies[i - 1]) : f;
+            const double upper = i < nPixels - 1 ? std::sqrt (f * newFrequencies[i + 1]) : f;
+            
+            BinMapping& mapping = binMapping[i];
+            mapping.start = jmax (0, static_cast<int> (std::ceil (lower / binWidth)));
+            mapping.end = jmin (nBins - 1, static_cast<int> (std::floor (upper / binWidth)));
+            mapping.position = jlimit (0.0f, static_cast<float> (nBins - 2), static_cast<float> (f / binWidth));
+        }
+    }
+    
+    void publish()
+    {
+        Spectra& dest = spectra.getWriteBuffer();
+        const size_t nPixels = binMapping.size();
+        dest.inputDb.resize (nPixels);
+        dest.outputDb.resize (nPixels);
+        
+        for (int ch = 0; ch < 2; ++ch)
+        {
+            const auto& power = smoothedPower[ch];
+            auto& db = ch == 0 ? dest.inputDb : dest.outputDb;
+            for (size_t i = 0; i < nPixels; ++i)
+            {
+                const BinMapping& mapping = binMapping[i];
+                float value;
+                if (mapping.end >= mapping.start) // keep peaks visible where pixels cover several bins
+                {
+                    value = power[mapping.start];
+                    for (int k = mapping.start + 1; k <= mapping.end; ++k)
+                        value = jmax (value, power[k]);
+                }
+                else
+                {
+                    const int k = static_cast<int> (mapping.position);
+                    const float frac = mapping.position - k;
+                    value = (1.0f - frac) * power[k] + frac * power[k + 1];
+                }
+                db[i] = jmax (minDb, 10.0f * std::log10 (value + 1.0e-12f));
+            }
+        }
+        spectra.publish();
+    }
+    
+    static constexpr float smoothingCoeff = 0.7f;
+    
+    double fs = 48000.0;
+    Atomic<bool> enabled = false;
+    AudioFifo fifo;
+    int pollInterval = 21; // ms, one hop
+    AudioBuffer<float> frame;
+    int samplesInFrame = 0;
+    uint32 lastPublishTime = 0;
+    
+    dsp::FFT fft;
+    dsp::WindowingFunction<float> window;
+    std::vector<float> fftData;
+    std::vector<float> smoothedPower[2];
+    
+    CriticalSection frequencyLock;
+    Array<double> frequencies;
+    Atomic<bool> frequenciesChanged = false;
+    std::vector<BinMapping> binMapping;
+    
+    SnapshotBuffer<Spectra> spectra;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrumAnalyzer)
+};
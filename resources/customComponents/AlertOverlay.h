@@ -132,6 +132,7 @@ public:
     
     void paint (Graphics& g) override
     {
+        AA_PAINT_TIMER ("AlertOverlay");
         int height = getHeight();
         int width = getWidth();
         const int messageHeight = height - titleHeight - mT - mB - buttonHeight;
@@ -249,6 +250,12 @@ public:
     }
     
     void timerCallback() override
+    {
+        advanceAnimation();
+    }
+    
+    // one step of the pattern animation of the tracking overlays
+    void advanceAnimation()
     {
         if (ppVisualizer != nullptr)
         {
@@ -52,6 +52,8 @@
 
 #pragma once
 #include "ImgPaths.h"
+#include "../lookAndFeel/GraphicsCache.h"
+#include "PaintTimings.h"
 
 #define RS_FLT_EPSILON 1.19209290E-07F
 class DirSlider : public Slider
@@ -86,46 +88,37 @@ public:
         activePatternPath(-1.0f),
         slider(newSlider)
         {
-            cardPath.loadPathFromData (cardData, sizeof (cardData));
-            eightPath.loadPathFromData (eightData, sizeof (eightData));
-            omniPath.loadPathFromData (omniData, sizeof (omniData));
-            revCardPath.loadPathFromData (cardData, sizeof (cardData));
-            revCardPath.applyTransform (AffineTransform::rotation(M_PI));
         }
         
         ~DirPatternStrip() {}
         
         void paint (Graphics& g) override
         {
-            Rectangle<int> bounds = getLocalBounds();
-            int lrMargin = 7;
-            int topMargin = 1;
-            int boundsX = bounds.getX() + lrMargin;
-            int boundsY = bounds.getY() + topMargin;
-            int width = bounds.getWidth() - 2*lrMargin;
-            
-            revCardPath.applyTransform (revCardPath.getTransformToScaleToFit(boundsX,
-                                                                             boundsY, dirImgSize, dirImgSize,
-                                                                             true, Justification::centred));
+            AA_PAINT_TIMER ("DirPatternStrip");
             (slider->isEnabled()) ? g.setColour (Colours::white) : g.setColour (Colours::white.withMultipliedAlpha(0.5f));
             g.strokePath (revCardPath, PathStrokeType (activePatternPath == revCardFact ? 2.0f : 1.0f));
-            
-            omniPath.applyTransform (omniPath.getTransformToScaleToFit(boundsX + 0.33 * width - dirImgSize/2.0f + 2.0f ,
-                                                                       boundsY, dirImgSize, dirImgSize,
-                                                                       true, Justification::centred));
             g.strokePath (omniPath, PathStrokeType (activePatternPath == omniFact ? 2.0f : 1.0f));
-
-            cardPath.applyTransform (cardPath.getTransformToScaleToFit(boundsX + 0.66 * width - dirImgSize/2.0f - 1.0f,
-                                                                       boundsY, dirImgSize, dirImgSize,
-                                                                       true, Justification::centred));
             g.strokePath (cardPath, PathStrokeType (activePatternPath == cardFact ? 2.0f : 1.0f));
-
-            eightPath.applyTransform (eightPath.getTransformToScaleToFit(boundsX + width - dirImgSize,
-                                                                         boundsY, dirImgSize, dirImgSize,
-                                                                         true, Justification::centred));
             g.strokePath (eightPath, PathStrokeType (activePatternPath == eightFact ? 2.0f : 1.0f));
         }
         
+        // the icons only change with the size of the strip
+        void resized() override
+        {
+            Rectangle<int> bounds = getLocalBounds();
+            int lrMargin = 7;
+            int topMargin = 1;
+            float boundsX = bounds.getX() + lrMargin;
+            float boundsY = bounds.getY() + topMargin;
+            float width = bounds.getWidth() - 2*lrMargin;
+            float size = dirImgSize;
+            
+            revCardPath = graphicsCache->getScaledIcon (GraphicsCache::reverseCardioidIcon, {boundsX, boundsY, size, size});
+            omniPath = graphicsCache->getScaledIcon (GraphicsCache::omniIcon, {boundsX + 0.33f * width - size / 2.0f + 2.0f, boundsY, size, size});
+            cardPath = graphicsCache->getScaledIcon (GraphicsCache::cardioidIcon, {boundsX + 0.66f * width - size / 2.0f - 1.0f, boundsY, size, size});
+            eightPath = graphicsCache->getScaledIcon (GraphicsCache::eightIcon, {boundsX + width - size, boundsY, size, size});
+        }
+        
         void mouseMove(const MouseEvent &e) override
         {
             if (!slider->isEnabled())
@@ -174,12 +167,14 @@ public:
         Path eightPath;
         Path omniPath;
         Path revCardPath;
+        SharedResourcePointer<GraphicsCache> graphicsCache;
         
         DirSlider* slider;
     };
     
     void paint (Graphics& g) override
     {
+        AA_PAINT_TIMER ("DirSlider");
         auto& lf = getLookAndFeel();
         auto style = getSliderStyle();
 
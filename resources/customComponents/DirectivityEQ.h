@@ -50,6 +50,8 @@
 
 #pragma once
 #include "ImgPaths.h"
+#include "../lookAndFeel/GraphicsCache.h"
+#include "PaintTimings.h"
 
 // !J! On iOS we make the knobs fatter for touchscreen ease-of-use
 #ifdef JUCE_IOS
@@ -138,16 +140,6 @@ public:
                  dirFactArray{omniFact, cardFact, rCardFact, eightFact,
                              bCardFact, rbCardFact, sCardFact, hCardFact}
     {
-        cardPath.loadPathFromData (cardData, sizeof (cardData));
-        eightPath.loadPathFromData (eightData, sizeof (eightData));
-        omniPath.loadPathFromData (omniData, sizeof (omniData));
-        rCardPath.loadPathFromData (cardData, sizeof (cardData));
-        rCardPath.applyTransform (AffineTransform::rotation(M_PI));
-        sCardPath.loadPathFromData (sCardData, sizeof (sCardData));
-        hCardPath.loadPathFromData (hCardData, sizeof (hCardData));
-        bCardPath.loadPathFromData (bCardData, sizeof (bCardData));
-        rbCardPath.loadPathFromData (bCardData, sizeof (bCardData));
-        rbCardPath.applyTransform (AffineTransform::rotation(M_PI));
         init();
         
         for (int i = 0; i < 4; ++i)
@@ -175,6 +167,7 @@ public:
 
     void paint (Graphics& g) override
     {
+        AA_PAINT_TIMER ("DirectivityEQ");
         nrActiveBands = processor.getNBands();
         
         if (processor.zeroDelayModeActive())
@@ -199,90 +192,18 @@ public:
             }
         }
         
-        // directivity labels
-        int height = getHeight();
-        int dirImgSize = 20;
-        int smallImgSize = 15;
-        float strokeSizeThin = 0.5f;
-        float strokeSizeThick = 2.0f;
-        eightPath.applyTransform (eightPath.getTransformToScaleToFit (5.0f, mT - dirImgSize / 2, dirImgSize, dirImgSize, true, Justification::left));
-        g.setColour (Colours::white);
-        g.strokePath (eightPath, PathStrokeType (activePatternPath == eightFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (eightPath);
+        // static layers are rendered once per size, scale and highlighted pattern
+        const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+        if (backgroundImage.isNull() || scale != renderedScale || activePatternPath != renderedPatternPath)
+            renderStaticLayers (scale);
         
-        hCardPath.applyTransform (hCardPath.getTransformToScaleToFit (mL / 2 - 15.0f, static_cast<float>(height) / 6 + 3.0f, smallImgSize, smallImgSize, true, Justification::right));
-        g.strokePath (hCardPath, PathStrokeType (activePatternPath == hCardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (hCardPath);
+        g.drawImage (backgroundImage, getLocalBounds().toFloat());
         
-        sCardPath.applyTransform (sCardPath.getTransformToScaleToFit (mL / 2 - 14.0f, static_cast<float>(height) / 4, smallImgSize, smallImgSize, true, Justification::right));
-        g.strokePath (sCardPath, PathStrokeType (activePatternPath == sCardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (sCardPath);
+        paintSpectra (g);
         
-        cardPath.applyTransform (cardPath.getTransformToScaleToFit (1.0f, static_cast<float>(height) / 3 - dirImgSize / 2 + 4.0f, dirImgSize, dirImgSize, true, Justification::right));
-        g.strokePath (cardPath, PathStrokeType (activePatternPath == cardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (cardPath);
+        g.drawImage (gridImage, getLocalBounds().toFloat());
         
-        bCardPath.applyTransform (bCardPath.getTransformToScaleToFit (mL / 2 - 13.0f, static_cast<float>(height) / 2 - 27.0f, smallImgSize, smallImgSize, true, Justification::right));
-        g.strokePath (bCardPath, PathStrokeType (activePatternPath == bCardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (bCardPath);
-        
-        omniPath.applyTransform (omniPath.getTransformToScaleToFit (1.0f, static_cast<float>(height) * 2 / 3 - dirImgSize / 2 - 6.0f, dirImgSize, dirImgSize, true, Justification::right));
-        g.strokePath (omniPath, PathStrokeType (activePatternPath == omniFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (omniPath);
-        
-        rbCardPath.applyTransform (rbCardPath.getTransformToScaleToFit (mL / 2 - 13.0f, static_cast<float>(height) - mB - smallImgSize / 2 - 22.0f, smallImgSize, smallImgSize, true, Justification::right));
-        g.strokePath (rbCardPath, PathStrokeType (activePatternPath == rbCardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (rbCardPath);
-        
-        rCardPath.applyTransform (rCardPath.getTransformToScaleToFit (1.0f, static_cast<float>(height) - mB - dirImgSize / 2, dirImgSize, dirImgSize, true, Justification::right));
-        g.strokePath (rCardPath, PathStrokeType (activePatternPath == rCardFact ? strokeSizeThick : strokeSizeThin));
-        g.fillPath (rCardPath);
-        
-        // frequency labels
-        g.setFont (getLookAndFeel().getTypefaceForFont (Font(12.0f, 2)));
-        g.setFont (16.0f);
-        for (float f=s.fMin; f <= s.fMax; f += powf(10, floorf(log10(f))))
-        {
-            int xpos = hzToX(f);
-
-            String axislabel;
-            bool drawText = false;
-
-            if ((f == 20) || (f == 50) || (f == 100) || (f == 200) || (f == 500))
-            {
-                axislabel = String((int)f);
-                drawText = true;
-            }
-            else if ((f == 1000) || (f == 2000) || (f == 5000) || (f == 10000) || (f == 20000))
-            {
-                axislabel = String((int)f/1000);
-                axislabel << "k";
-                drawText = true;
-            }
-
-            if (drawText)
-            {
-                g.drawText (axislabel, xpos - 10, dirToY(s.yMin) + OH + 0.0f, 30, 12, Justification::centred, true);
-            }
-        }
-
-        g.setColour (Colours::whitesmoke.withMultipliedAlpha(0.1f));
-        g.fillRect (static_cast<float>(hzToX(s.fMin)), dirToY(0),
-                    static_cast<float>(hzToX(s.fMax) - hzToX(s.fMin)),
-                    dirToY(-0.5) - dirToY(0));
-        
-        // set path colours and stroke
-        g.setColour (Colours::white);
-        g.strokePath (dirGridPath, PathStrokeType (0.5f));
-        
-        g.setColour (Colours::white.withMultipliedAlpha(0.5f));
-        g.strokePath (smallDirGridPath, PathStrokeType (0.5f));
-
-        g.setColour (Colours::white);
-        g.strokePath (hzGridPathBold, PathStrokeType (0.5f));
-
-        g.setColour (Colours::white.withMultipliedAlpha(0.5f));
-        g.strokePath (hzGridPath, PathStrokeType (0.5f));
+        paintAnalysis (g);
         
         for (PathComponent& p : bandLimitPaths)
         {
@@ -417,6 +338,11 @@ public:
             float circX = (rightBound + leftBound) / 2;
             float circY = handle.dirSlider == nullptr ? dirToY (0.0f) : dirToY (handle.dirSlider->getValue());
             handle.handlePos.setXY(circX,circY);
+            
+            // band output level
+            g.setColour (handle.colour.withMultipliedAlpha (0.7f * calcAlphaOfDirPath(handle)));
+            g.fillRect (leftBound + 2.0f, dirToY (s.yMax) + 2.0f,
+                        (rightBound - leftBound - 4.0f) * LevelMeasurement::getMeterProportion (bandMeterDb[i]), 3.0f);
                         
             // paint band handles
             g.setColour (Colour (0xFF191919));
@@ -438,6 +364,17 @@ public:
                            circY - (POLAR_DESIGNER_KNOBS_SIZE / 2),
                            POLAR_DESIGNER_KNOBS_SIZE,
                            POLAR_DESIGNER_KNOBS_SIZE);
+            
+            // pattern currently applied by the adaptive terminator
+            if (processor.adaptiveModeActive())
+            {
+                float adaptiveY = dirToY (processor.getAdaptiveDirFactor (i));
+                g.setColour (handle.colour);
+                g.drawEllipse (circX - (POLAR_DESIGNER_KNOBS_SIZE / 4),
+                               adaptiveY - (POLAR_DESIGNER_KNOBS_SIZE / 4),
+                               POLAR_DESIGNER_KNOBS_SIZE / 2,
+                               POLAR_DESIGNER_KNOBS_SIZE / 2, 2.0f);
+            }
 
 
             // align elements
@@ -504,6 +441,19 @@ public:
 
     }
 
+    // repaints only the plot, the labels and pattern icons next to it don't change
+    void repaintPlot()
+    {
+        repaint (getPlotBounds());
+    }
+    
+    Rectangle<int> getPlotBounds()
+    {
+        const float margin = OH + POLAR_DESIGNER_KNOBS_SIZE;
+        return Rectangle<float>::leftTopRightBottom (hzToX (s.fMin) - margin, dirToY (s.yMax) - margin,
+                                                     hzToX (s.fMax) + margin, dirToY (s.yMin) + margin).getSmallestIntegerContainer();
+    }
+    
     float dirToY(const float dir)
     {
         float height = (float) getHeight() - mB - mT;
@@ -743,6 +693,7 @@ public:
         frequencies.resize(numPixels);
         for (int i = 0; i < numPixels; ++i)
             frequencies.set(i, xToHz(xMin + i));
+        processor.getSpectrumAnalyzer().setFrequencies (frequencies);
 
         // directivity grid lines
         const float width = getWidth() - mL - mR;
@@ -794,6 +745,8 @@ public:
         }
         
         initValueBox();
+        
+        renderStaticLayers (jmax (1.0f, renderedScale));
     }
 
     void addSliders(Colour newColour, Slider* dirSlider = nullptr, Slider* lowerFrequencySlider = nullptr, Slider* upperFrequencySlider = nullptr, MuteSoloButton* soloButton = nullptr, MuteSoloButton* muteButton = nullptr, Slider* gainSlider = nullptr, PolarPatternVisualizer* directivityVis = nullptr
@@ -934,6 +887,22 @@ public:
         }
     }
     
+    void setLevels (const LevelSnapshot& levels)
+    {
+        for (int i = 0; i < 5; ++i)
+            bandMeterDb[i] = LevelMeasurement::applyMeterBallistics (bandMeterDb[i], levels.bands[i].outputRms);
+        
+        // only the meter strip needs to be redrawn
+        repaint (0, static_cast<int> (dirToY (s.yMax)), getWidth(), 6);
+    }
+    
+    // fetch the latest per frequency analysis of the terminator recordings
+    void updateAnalysis()
+    {
+        processor.getDirectivityAnalyzer().getResults (analysisResults);
+        repaintPlot();
+    }
+    
     PathComponent& getBandlimitPathComponent (int idx)
     {
         return bandLimitPaths[idx];
@@ -945,6 +914,181 @@ public:
     }
 
 private:
+    // pattern icons, axis labels and the shaded reverse pattern range go below the spectra, the grid above them
+    void renderStaticLayers (float scale)
+    {
+        renderedScale = scale;
+        renderedPatternPath = activePatternPath;
+        
+        const int imageWidth = jmax (1, roundToInt (getWidth() * scale));
+        const int imageHeight = jmax (1, roundToInt (getHeight() * scale));
+        backgroundImage = Image (Image::ARGB, imageWidth, imageHeight, true);
+        gridImage = Image (Image::ARGB, imageWidth, imageHeight, true);
+        
+        {
+            Graphics g (backgroundImage);
+            g.addTransform (AffineTransform::scale (scale));
+            
+            // directivity labels
+            int height = getHeight();
+            int dirImgSize = 20;
+            int smallImgSize = 15;
+            float strokeSizeThin = 0.5f;
+            float strokeSizeThick = 2.0f;
+            eightPath = graphicsCache->getScaledIcon (GraphicsCache::eightIcon, Rectangle<float> (5.0f, mT - dirImgSize / 2, dirImgSize, dirImgSize), Justification::left);
+            g.setColour (Colours::white);
+            g.strokePath (eightPath, PathStrokeType (activePatternPath == eightFact ? strokeSizeThick : strokeSizeThin));
+            g.fillPath (eightPath);
+        
+            hCardPath = graphicsCache->getScaledIcon (GraphicsCache::hyperCardioidIcon, Rectangle<float> (mL / 2 - 15.0f, static_cast<float>(height) / 6 + 3.0f, smallImgSize, smallImgSize), Justification::right);
+            g.strokePath (hCardPath, PathStrokeType (activePatternPath == hCardFact ? strokeSizeThick : strokeSizeThin));
+            g.fillPath (hCardPath);
+        
+            sCardPath = graphicsCache->getScaledIcon (GraphicsCache::superCardioidIcon, Rectangle<float> (mL / 2 - 14.0f, static_cast<float>(height) / 4, smallImgSize, smallImgSize), Justification::right);
+            g.strokePath (sCardPath, PathStrokeType (activePatternPath == sCardFact ? strokeSizeThick : strokeSizeThin));
+            g.fillPath (sCardPath);
+        
+            cardPath = graphicsCache->getScaledIcon (GraphicsCache::cardioidIcon, Rectangle<float> (1.0f, static_cast<float>(height) / 3 - dirImgSize / 2 + 4.0f, dirImgSize, dirImgSize), Justification::right);
+            g.strokePath (cardPath, PathStrokeType (activePatternPath == cardFact ? strokeSizeThick : strokeSizeThin));
+            g.fillPath (cardPath);
+        
+            bCardPath = graphicsCache->getScaledIcon (GraphicsCache::broadCardioidIcon, Rectangle<float> (mL / 2 - 13.0f, static_cast<float>(height) / 2 - 27.0f, smallImgSize, smallImgSize), Justification::right);
+            g.strokePath (bCardPath, PathStrokeType (activePatternPath == bCardFact ? strokeSizeThick : strokeSizeThin));
+            g.fillPath (bCardPath);
+        
+            omniPath = graphicsCache->getScaledIcon (GraphicsCache::omniIcon, Rectangle<float> (1.0f, static_cast<float>(height) * 2 / 3 - dirImgSize / 2 - 6.0f, dirImgSize, dirImgSize), Justification::right);
+            g.strokePath (omniPath, PathStrokeType (activePatternPath == omniFact ? strokeSizeThick : strokeSizeThin));
+            g.fillPath (omniPath);
+        
+            rbCardPath = graphicsCache->getScaledIcon (GraphicsCache::reverseBroadCardioidIcon, Rectangle<float> (mL / 2 - 13.0f, static_cast<float>(height) - mB - smallImgSize / 2 - 22.0f, smallImgSize, smallImgSize), Justification::right);
+            g.strokePath (rbCardPath, PathStrokeType (activePatternPath == rbCardFact ? strokeSizeThick : strokeSizeThin));
+            g.fillPath (rbCardPath);
+        
+            rCardPath = graphicsCache->getScaledIcon (GraphicsCache::reverseCardioidIcon, Rectangle<float> (1.0f, static_cast<float>(height) - mB - dirImgSize / 2, dirImgSize, dirImgSize), Justification::right);
+            g.strokePath (rCardPath, PathStrokeType (activePatternPath == rCardFact ? strokeSizeThick : strokeSizeThin));
+            g.fillPath (rCardPath);
+        
+            // frequency labels
+            g.setFont (getLookAndFeel().getTypefaceForFont (Font(12.0f, 2)));
+            g.setFont (16.0f);
+            for (float f=s.fMin; f <= s.fMax; f += powf(10, floorf(log10(f))))
+            {
+                int xpos = hzToX(f);
+
+                String axislabel;
+                bool drawText = false;
+
+                if ((f == 20) || (f == 50) || (f == 100) || (f == 200) || (f == 500))
+                {
+                    axislabel = String((int)f);
+                    drawText = true;
+                }
+                else if ((f == 1000) || (f == 2000) || (f == 5000) || (f == 10000) || (f == 20000))
+                {
+                    axislabel = String((int)f/1000);
+                    axislabel << "k";
+                    drawText = true;
+                }
+
+                if (drawText)
+                {
+                    g.drawText (axislabel, xpos - 10, dirToY(s.yMin) + OH + 0.0f, 30, 12, Justification::centred, true);
+                }
+            }
+
+            g.setColour (Colours::whitesmoke.withMultipliedAlpha(0.1f));
+            g.fillRect (static_cast<float>(hzToX(s.fMin)), dirToY(0),
+                        static_cast<float>(hzToX(s.fMax) - hzToX(s.fMin)),
+                        dirToY(-0.5) - dirToY(0));
+        }
+        
+        {
+            Graphics g (gridImage);
+            g.addTransform (AffineTransform::scale (scale));
+            
+            // set path colours and stroke
+            g.setColour (Colours::white);
+            g.strokePath (dirGridPath, PathStrokeType (0.5f));
+        
+            g.setColour (Colours::white.withMultipliedAlpha(0.5f));
+            g.strokePath (smallDirGridPath, PathStrokeType (0.5f));
+
+            g.setColour (Colours::white);
+            g.strokePath (hzGridPathBold, PathStrokeType (0.5f));
+
+            g.setColour (Colours::white.withMultipliedAlpha(0.5f));
+            g.strokePath (hzGridPath, PathStrokeType (0.5f));
+        }
+    }
+    
+    // input and output spectrum behind the grid, full plot height covers SpectrumAnalyzer::minDb to 0 dB
+    void paintSpectra (Graphics& g)
+    {
+        const SpectrumAnalyzer::Spectra& spectra = processor.getSpectrumAnalyzer().getSpectra().getReadBuffer();
+        if (static_cast<int> (spectra.inputDb.size()) != numPixels || numPixels < 2)
+            return;
+        
+        const float yTop = dirToY (s.yMax);
+        const float yBottom = dirToY (s.yMin);
+        const float xMin = hzToX (s.fMin);
+        
+        for (int c = 0; c < 2; ++c)
+        {
+            const std::vector<float>& db = c == 0 ? spectra.inputDb : spectra.outputDb;
+            Path spectrumPath;
+            spectrumPath.startNewSubPath (xMin, yBottom);
+            for (int i = 0; i < numPixels; ++i)
+                spectrumPath.lineTo (xMin + i, jmap (db[i], SpectrumAnalyzer::minDb, 0.0f, yBottom, yTop));
+            spectrumPath.lineTo (xMin + numPixels - 1, yBottom);
+            spectrumPath.closeSubPath();
+            
+            g.setColour (c == 0 ? Colours::white.withMultipliedAlpha (0.06f) : Colours::skyblue.withMultipliedAlpha (0.15f));
+            g.fillPath (spectrumPath);
+        }
+    }
+    
+    void paintAnalysis (Graphics& g)
+    {
+        const int nPoints = analysisResults.frequencies.size();
+        if (nPoints == 0)
+            return;
+        
+        // optimal directivity factor per frequency, gaps where there was no signal
+        Path analysisPath;
+        bool startNewSubPath = true;
+        for (int p = 0; p < nPoints; ++p)
+        {
+            const float f = analysisResults.frequencies[p];
+            if (analysisResults.weights[p] < 0.001f || f < s.fMin || f > s.fMax)
+            {
+                startNewSubPath = true;
+                continue;
+            }
+            
+            const float x = hzToX (f);
+            const float y = dirToY (analysisResults.alphas[p]);
+            if (startNewSubPath)
+                analysisPath.startNewSubPath (x, y);
+            else
+                analysisPath.lineTo (x, y);
+            startNewSubPath = false;
+        }
+        g.setColour (Colours::white.withMultipliedAlpha (0.6f));
+        g.strokePath (analysisPath, PathStrokeType (1.5f));
+        
+        // suggested crossovers, only valid for the band count they were computed for
+        if (analysisResults.crossovers.size() == nrActiveBands - 1)
+        {
+            const float dashLengths[2] = {4.0f, 4.0f};
+            g.setColour (Colours::white.withMultipliedAlpha (0.5f));
+            for (float f : analysisResults.crossovers)
+            {
+                const float x = hzToX (f);
+                g.drawDashedLine (Line<float> (x, dirToY (s.yMax), x, dirToY (s.yMin)), dashLengths, 2, 1.0f);
+            }
+        }
+    }
+    
     PolarDesignerAudioProcessor& processor;
     
     bool active = true;
@@ -964,12 +1108,20 @@ private:
     Path dirPaths[5];
     Path smallDirGridPath;
     
+    Image backgroundImage, gridImage; // static layers, rendered at the physical pixel scale
+    float renderedScale = 0.0f;
+    float renderedPatternPath = -2.0f;
+    
     std::unique_ptr<Label> tooltipValueBox[4];
 
     Array<double> frequencies;
     int numPixels;
+    DirectivityAnalyzer::Results analysisResults;
+    float bandMeterDb[5] = {LevelMeasurement::meterMinDb, LevelMeasurement::meterMinDb, LevelMeasurement::meterMinDb,
+                            LevelMeasurement::meterMinDb, LevelMeasurement::meterMinDb};
     Array<BandElements> elements;
     
+    SharedResourcePointer<GraphicsCache> graphicsCache;
     Path cardPath;
     Path eightPath;
     Path omniPath;
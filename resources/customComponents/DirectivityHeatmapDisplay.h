@@ -0,0 +1,117 @@
+/*
+ ==============================================================================
+ DirectivityHeatmapDisplay.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "../DirectivityHeatmap.h"
+#include "PaintTimings.h"
+
+/* Overlay showing the DirectivityHeatmap of the current settings. Painting only draws the last
+   published image, the rendering thread runs while the overlay is visible. */
+class DirectivityHeatmapDisplay : public Component, private AsyncUpdater
+{
+public:
+    DirectivityHeatmapDisplay()
+    {
+        setAlwaysOnTop (true);
+        setInterceptsMouseClicks (false, false);
+        heatmap.setOnNewImageCallback ([this]() { triggerAsyncUpdate(); });
+    }
+
+    ~DirectivityHeatmapDisplay() override
+    {
+        heatmap.setEnabled (false);
+        cancelPendingUpdate();
+    }
+
+    // message thread, unchanged settings are ignored by the renderer
+    void setSettings (const DirectivityHeatmap::Settings& settings)
+    {
+        heatmap.setSettings (settings);
+    }
+
+    void visibilityChanged() override
+    {
+        heatmap.setEnabled (isVisible());
+    }
+
+    void paint (Graphics& g) override
+    {
+        AA_PAINT_TIMER ("DirectivityHeatmapDisplay");
+
+        g.setColour (Colour (0xF0191919));
+        g.fillRect (getLocalBounds());
+
+        const Image& image = heatmap.getImage().getReadBuffer();
+        if (image.isValid())
+            g.drawImage (image, plotArea.toFloat(), RectanglePlacement::stretchToFit);
+
+        g.setColour (Colours::white.withAlpha (0.8f));
+        g.setFont (12.0f);
+        g.drawRect (plotArea);
+
+        for (float freq : { 100.0f, 1000.0f, 10000.0f })
+        {
+            const int x = plotArea.getX() + roundToInt (DirectivityHeatmap::getPositionOfFrequency (freq) * plotArea.getWidth());
+            g.drawVerticalLine (x, static_cast<float> (plotArea.getBottom()), static_cast<float> (plotArea.getBottom() + 4));
+            g.drawText (freq < 1000.0f ? String (roundToInt (freq)) : String (roundToInt (freq / 1000.0f)) + "k",
+                        x - 20, plotArea.getBottom() + 4, 40, 14, Justification::centred);
+        }
+
+        for (int deg : { 0, 90, 180 })
+        {
+            const int y = plotArea.getY() + roundToInt (deg / 180.0f * plotArea.getHeight());
+            g.drawText (String (deg) + String (CharPointer_UTF8 ("\xc2\xb0")),
+                        0, y - 7, plotArea.getX() - 4, 14, Justification::centredRight);
+        }
+
+        // level legend
+        const Rectangle<int> legend (plotArea.getRight() + 10, plotArea.getY(), 10, plotArea.getHeight());
+        for (int y = 0; y < legend.getHeight(); ++y)
+        {
+            g.setColour (heatmap.getColourAtPosition (1.0f - y / static_cast<float> (legend.getHeight() - 1)));
+            g.fillRect (legend.getX(), legend.getY() + y, legend.getWidth(), 1);
+        }
+
+        g.setColour (Colours::white.withAlpha (0.8f));
+        g.drawText (String (roundToInt (DirectivityHeatmap::maxDb)) + " dB", legend.getRight() + 2, legend.getY() - 7, 40, 14, Justification::centredLeft);
+        g.drawText (String (roundToInt (DirectivityHeatmap::minDb)) + " dB", legend.getRight() + 2, legend.getBottom() - 7, 40, 14, Justification::centredLeft);
+    }
+
+    void resized() override
+    {
+        plotArea = getLocalBounds().withTrimmedLeft (40).withTrimmedRight (60).withTrimmedTop (10).withTrimmedBottom (24);
+        heatmap.setImageSize (jmax (1, plotArea.getWidth()), jmax (1, plotArea.getHeight()));
+    }
+
+private:
+    void handleAsyncUpdate() override
+    {
+        if (heatmap.getImage().update())
+            repaint (plotArea);
+    }
+
+    DirectivityHeatmap heatmap;
+    Rectangle<int> plotArea;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DirectivityHeatmapDisplay)
+};
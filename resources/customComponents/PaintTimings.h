@@ -0,0 +1,171 @@
+/*
+ ==============================================================================
+ PaintTimings.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+
+/* Paint time instrumentation, only compiled in with AA_DO_PAINT_TIMING defined (see PluginEditor.h).
+   AA_PAINT_TIMER (name) at the top of a paint() adds its duration to the distribution of that name,
+   the editor shows the live frame times in a FrameTimeOverlay. Message thread only. */
+#ifdef AA_DO_PAINT_TIMING
+#warning "AUSTRIANAUDIO: PAINT TIMING IS TURNED ON!"
+
+class PaintTimings
+{
+public:
+    static constexpr int maxSamples = 512; // per name, the oldest are overwritten
+    static constexpr const char* frameName = "frame interval";
+
+    struct Distribution
+    {
+        int count = 0;
+        double median = 0.0;
+        double p95 = 0.0;
+        double max = 0.0;
+    };
+
+    void add (const String& name, double milliseconds)
+    {
+        Samples& samples = timings[name];
+        if (samples.values.size() < static_cast<size_t> (maxSamples))
+            samples.values.push_back (milliseconds);
+        else
+            samples.values[samples.next] = milliseconds;
+        samples.next = (samples.next + 1) % maxSamples;
+    }
+
+    // time between two paints of the editor
+    void addFrame()
+    {
+        const double now = Time::getMillisecondCounterHiRes();
+        if (lastFrame > 0.0)
+            add (frameName, now - lastFrame);
+        lastFrame = now;
+    }
+
+    Distribution getDistribution (const String& name) const
+    {
+        Distribution result;
+        auto found = timings.find (name);
+        if (found == timings.end() || found->second.values.empty())
+            return result;
+
+        std::vector<double> sorted = found->second.values;
+        std::sort (sorted.begin(), sorted.end());
+        result.count = static_cast<int> (sorted.size());
+        result.median = sorted[sorted.size() / 2];
+        result.p95 = sorted[jmin (sorted.size() - 1, sorted.size() * 95 / 100)];
+        result.max = sorted.back();
+        return result;
+    }
+
+    // one line per name: count, median, 95th percentile and maximum in ms
+    String getReport() const
+    {
+        String report;
+        for (const auto& entry : timings)
+        {
+            const Distribution d = getDistribution (entry.first);
+            report << entry.first.paddedRight (' ', 24) << String (d.count).paddedLeft (' ', 5)
+                   << "  med " << String (d.median, 2) << "  p95 " << String (d.p95, 2)
+                   << "  max " << String (d.max, 2) << newLine;
+        }
+        return report;
+    }
+
+    void clear()
+    {
+        timings.clear();
+        lastFrame = 0.0;
+    }
+
+private:
+    struct Samples
+    {
+        std::vector<double> values;
+        int next = 0;
+    };
+
+    std::map<String, Samples> timings;
+    double lastFrame = 0.0;
+};
+
+class ScopedPaintTimer
+{
+public:
+    ScopedPaintTimer (const char* timerName) : name (timerName), start (Time::getMillisecondCounterHiRes()) {}
+
+    ~ScopedPaintTimer()
+    {
+        timings->add (name, Time::getMillisecondCounterHiRes() - start);
+    }
+
+private:
+    SharedResourcePointer<PaintTimings> timings;
+    const char* name;
+    double start;
+};
+
+#define AA_PAINT_TIMER(name) const ScopedPaintTimer paintTimer (name)
+
+// live frame interval, the paint time distributions are reported by the benchmarks' paint command
+class FrameTimeOverlay : public Component
+{
+public:
+    FrameTimeOverlay()
+    {
+        setAlwaysOnTop (true);
+        setInterceptsMouseClicks (false, false);
+    }
+
+    // called at the editor's display rate
+    void update()
+    {
+        const PaintTimings::Distribution frames = timings->getDistribution (PaintTimings::frameName);
+        const String newText = "frame " + String (frames.median, 1) + " ms (p95 " + String (frames.p95, 1)
+                               + ", max " + String (frames.max, 1) + ")";
+        if (newText != text)
+        {
+            text = newText;
+            repaint();
+        }
+    }
+
+    void paint (Graphics& g) override
+    {
+        g.setColour (Colours::black.withMultipliedAlpha (0.6f));
+        g.fillRect (getLocalBounds());
+        g.setColour (Colours::lightgreen);
+        g.setFont (12.0f);
+        g.drawText (text, getLocalBounds().reduced (4, 0), Justification::centredLeft, true);
+    }
+
+private:
+    SharedResourcePointer<PaintTimings> timings;
+    String text = "frame -";
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FrameTimeOverlay)
+};
+
+#else
+#define AA_PAINT_TIMER(name)
+#endif
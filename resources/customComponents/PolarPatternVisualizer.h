@@ -50,6 +50,8 @@
 #pragma once
 
 #include "../JuceLibraryCode/JuceHeader.h"
+#include "../LevelMeasurement.h"
+#include "PaintTimings.h"
 
 //==============================================================================
 /*
@@ -60,6 +62,12 @@ class PolarPatternVisualizer : public Component
     const float deg2rad = M_PI / 180.0f;
     const int degStep = 4;
     const int nLookUpSamples = 360;
+    
+    // range of the directivity factor covered by the radius table
+    static constexpr float minDirWeight = -0.5f;
+    static constexpr float maxDirWeight = 1.0f;
+    static constexpr int minWeightSteps = 32;
+    static constexpr int maxWeightSteps = 512;
 
 public:
     PolarPatternVisualizer()
@@ -93,6 +101,8 @@ public:
         subGrid.addPath(line, AffineTransform().rotation(0.25f * M_PI));
         subGrid.addPath(line, AffineTransform().rotation(0.5f * M_PI));
         subGrid.addPath(line, AffineTransform().rotation(0.75f * M_PI));
+        
+        patternPath.preallocateSpace (3 * pointsOnCircle.size() + 4);
     }
 
     ~PolarPatternVisualizer()
@@ -101,43 +111,76 @@ public:
 
     void paint (Graphics& g) override
     {
-        Path path;
-        path = grid;
-        path.applyTransform(transform);
-        g.setColour (Colours::skyblue.withMultipliedAlpha(0.1f));
-        g.fillPath(path);
+        AA_PAINT_TIMER ("PolarPatternVisualizer");
+        
+        // the grid is rendered once per size and scale, only its outline depends on the state
+        const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+        if (gridImage.isNull() || scale != renderedScale)
+            renderGrid (scale);
+        
+        g.drawImage (gridImage, getLocalBounds().toFloat());
         g.setColour (Colours::white.withMultipliedAlpha(!isActive ? 0.5f : calcAlpha()));
-        g.strokePath(path, PathStrokeType(1.0f));
-
-        path = subGrid;
-        path.applyTransform(transform);
-        g.setColour (Colours::skyblue.withMultipliedAlpha(0.3f));
-        g.strokePath(path, PathStrokeType(0.5f));
+        g.strokePath(gridOutline, PathStrokeType(1.0f));
+        
+        if (radiusTable.empty())
+            return;
 
-        // draw directivity
+        // draw directivity, interpolated between the two closest rows of the radius table
         g.setColour (colour.withMultipliedAlpha(!isActive ? 0.0f : calcAlpha()));
-        path.clear();
+        patternPath.clear();
         
-        int idx=0;
-        for (int phi = -180; phi <= 180; phi += degStep)
+        const int nAngles = pointsOnCircle.size();
+        const float weightPos = jlimit (0.0f, static_cast<float> (numWeightSteps),
+                                        (dirWeight - minDirWeight) / (maxDirWeight - minDirWeight) * numWeightSteps);
+        const int weightIdx = jmin (static_cast<int> (weightPos), numWeightSteps - 1);
+        const float frac = weightPos - weightIdx;
+        const float* lowerRow = radiusTable.data() + weightIdx * nAngles;
+        const float* upperRow = lowerRow + nAngles;
+        
+        for (int idx = 0; idx < nAngles; ++idx)
         {
-            float phiInRad = (float) phi * deg2rad;
-            float gainLin = std::abs((1 - std::abs (dirWeight)) + dirWeight * std::cos(phiInRad));
-            int dbMin = 25;
-            float gainDb = 20 * std::log10 (std::max (gainLin, static_cast<float> (std::pow (10, -dbMin / 20.0f))));
-            float effGain = std::max (std::abs ((gainDb + dbMin) / dbMin), 0.01f);
+            const float effGain = lowerRow[idx] + frac * (upperRow[idx] - lowerRow[idx]);
             Point<float> point = effGain * pointsOnCircle[idx];
             
-            if (phi == -180)
-                path.startNewSubPath(point);
+            if (idx == 0)
+                patternPath.startNewSubPath(point);
             else
-                path.lineTo(point);
-            ++idx;
+                patternPath.lineTo(point);
         }
 
-        path.closeSubPath();
-        path.applyTransform(transform);
-        g.strokePath(path, PathStrokeType(2.0f));
+        patternPath.closeSubPath();
+        patternPath.applyTransform(transform);
+        g.strokePath(patternPath, PathStrokeType(2.0f));
+        
+        // direction of arrival, the fig-of-eight cannot tell left from right so both sides are marked
+        if (isActive && arrivalConfidence > 0.05f)
+        {
+            const float arrivalSin = std::sqrt (1.0f - arrivalCos * arrivalCos);
+            const float markerSize = 6.0f;
+            g.setColour (Colours::white.withMultipliedAlpha (arrivalConfidence * calcAlpha()));
+            for (float side : {-1.0f, 1.0f})
+            {
+                Point<float> marker = Point<float> (arrivalCos, side * arrivalSin).transformedBy (transform);
+                g.fillEllipse (marker.x - markerSize / 2, marker.y - markerSize / 2, markerSize, markerSize);
+            }
+        }
+        
+        // band meters: omni, eight and band output
+        if (isActive)
+        {
+            const float meterDbs[3] = {omniMeterDb, eightMeterDb, outputMeterDb};
+            const Colour meterColours[3] = {Colours::skyblue, Colours::white, colour};
+            Rectangle<float> meterArea = getLocalBounds().toFloat().reduced (2.0f, 10.0f).removeFromRight (8.0f);
+            for (int m = 0; m < 3; ++m)
+            {
+                Rectangle<float> bar = meterArea.removeFromLeft (2.0f);
+                meterArea.removeFromLeft (1.0f);
+                g.setColour (meterColours[m].withMultipliedAlpha (0.15f));
+                g.fillRect (bar);
+                g.setColour (meterColours[m].withMultipliedAlpha (0.8f * calcAlpha()));
+                g.fillRect (bar.removeFromBottom (bar.getHeight() * LevelMeasurement::getMeterProportion (meterDbs[m])));
+            }
+        }
         
         //debug
 #ifdef AA_DO_DEBUG_PATH
@@ -167,14 +210,33 @@ public:
         transform = AffineTransform::fromTargetPoints((float) centre.x, (float) centre.y, (float)  centre.x, bounds.getY(), bounds.getX(), centre.y);
       
         plotArea = bounds;
+        
+        gridOutline = grid;
+        gridOutline.applyTransform(transform);
+        updateRadiusTable();
+        renderGrid (jmax (1.0f, renderedScale));
     }
 
     void setDirWeight(float weight)
     {
+        if (weight == dirWeight)
+            return;
+        
         dirWeight = weight;
         repaint();
     }
     
+    void setLevels (const BandLevels& levels)
+    {
+        omniMeterDb = LevelMeasurement::applyMeterBallistics (omniMeterDb, levels.omniRms);
+        eightMeterDb = LevelMeasurement::applyMeterBallistics (eightMeterDb, levels.eightRms);
+        outputMeterDb = LevelMeasurement::applyMeterBallistics (outputMeterDb, levels.outputRms);
+        arrivalCos = levels.arrivalCos;
+        arrivalConfidence = levels.arrivalConfidence;
+        if (isActive)
+            repaint();
+    }
+    
     void setActive(bool active)
     {
         if (isActive != active)
@@ -222,16 +284,71 @@ public:
     }
 
 private:
+    // dB warped radius of the pattern, as drawn on the plot
+    static float getEffectiveGain (float weight, float phiInRad)
+    {
+        float gainLin = std::abs((1 - std::abs (weight)) + weight * std::cos(phiInRad));
+        int dbMin = 25;
+        float gainDb = 20 * std::log10 (std::max (gainLin, static_cast<float> (std::pow (10, -dbMin / 20.0f))));
+        return std::max (std::abs ((gainDb + dbMin) / dbMin), 0.01f);
+    }
+    
+    // one row of radii per directivity factor step, about one step per pixel of the plot
+    void updateRadiusTable()
+    {
+        const int nWeightSteps = jlimit (minWeightSteps, maxWeightSteps, plotArea.getWidth());
+        if (nWeightSteps == numWeightSteps)
+            return;
+        
+        numWeightSteps = nWeightSteps;
+        const int nAngles = pointsOnCircle.size();
+        radiusTable.resize (static_cast<size_t> ((numWeightSteps + 1) * nAngles));
+        for (int w = 0; w <= numWeightSteps; ++w)
+        {
+            const float weight = jmap (static_cast<float> (w), 0.0f, static_cast<float> (numWeightSteps), minDirWeight, maxDirWeight);
+            for (int idx = 0; idx < nAngles; ++idx)
+                radiusTable[static_cast<size_t> (w * nAngles + idx)] = getEffectiveGain (weight, static_cast<float> (-180 + idx * degStep) * deg2rad);
+        }
+    }
+    
+    void renderGrid (float scale)
+    {
+        renderedScale = scale;
+        gridImage = Image (Image::ARGB, jmax (1, roundToInt (getWidth() * scale)), jmax (1, roundToInt (getHeight() * scale)), true);
+        
+        Graphics g (gridImage);
+        g.addTransform (AffineTransform::scale (scale));
+        
+        g.setColour (Colours::skyblue.withMultipliedAlpha(0.1f));
+        g.fillPath(gridOutline);
+        
+        Path path = subGrid;
+        path.applyTransform(transform);
+        g.setColour (Colours::skyblue.withMultipliedAlpha(0.3f));
+        g.strokePath(path, PathStrokeType(0.5f));
+    }
+    
     Path grid;
     Path subGrid;
+    Path gridOutline; // grid transformed to the plot area
+    Path patternPath;
+    Image gridImage;
+    float renderedScale = 0.0f;
+    std::vector<float> radiusTable;
+    int numWeightSteps = 0;
     AffineTransform transform;
     Rectangle<int> plotArea;
-    float dirWeight;
+    float dirWeight = 0.0f;
     bool isActive;
     MuteSoloButton* soloButton;
     MuteSoloButton* muteButton;
     bool soloActive;
     Colour colour;
+    float omniMeterDb = LevelMeasurement::meterMinDb;
+    float eightMeterDb = LevelMeasurement::meterMinDb;
+    float outputMeterDb = LevelMeasurement::meterMinDb;
+    float arrivalCos = 1.0f;
+    float arrivalConfidence = 0.0f;
 
     Array<Point<float>> pointsOnCircle;
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PolarPatternVisualizer)
@@ -0,0 +1,214 @@
+/*
+ ==============================================================================
+ PresetBrowser.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "../PresetLibrary.h"
+
+/* Overlay listing the presets of the PresetLibrary. Searching and filtering only query the index,
+   the list follows the background scan through the library's change messages. */
+class PresetBrowser : public Component, private ListBoxModel, private ChangeListener,
+                      private Button::Listener, private ComboBox::Listener, private TextEditor::Listener
+{
+public:
+    PresetBrowser (PresetLibrary& lib) : library (lib)
+    {
+        setAlwaysOnTop (true);
+        
+        addAndMakeVisible (teSearch);
+        teSearch.setTextToShowWhenEmpty ("search", Colours::grey);
+        teSearch.addListener (this);
+        
+        addAndMakeVisible (cbBands);
+        cbBands.addItem ("all bands", 1);
+        for (int i = 1; i <= 5; ++i)
+            cbBands.addItem (String (i) + (i == 1 ? " band" : " bands"), i + 1);
+        cbBands.setSelectedId (1, dontSendNotification);
+        cbBands.addListener (this);
+        
+        addAndMakeVisible (cbPattern);
+        cbPattern.addItem ("all patterns", PresetLibrary::anyPattern + 1);
+        cbPattern.addItem ("omni", PresetLibrary::omniPattern + 1);
+        cbPattern.addItem ("cardioid", PresetLibrary::cardioidPattern + 1);
+        cbPattern.addItem ("figure-of-eight", PresetLibrary::eightPattern + 1);
+        cbPattern.setSelectedId (PresetLibrary::anyPattern + 1, dontSendNotification);
+        cbPattern.addListener (this);
+        
+        addAndMakeVisible (lbPresets);
+        lbPresets.setModel (this);
+        lbPresets.setColour (ListBox::backgroundColourId, Colours::transparentBlack);
+        
+        for (auto* tb : { &tbLoad, &tbRescan, &tbClose })
+        {
+            addAndMakeVisible (tb);
+            tb->addListener (this);
+        }
+        tbLoad.setButtonText ("load");
+        tbRescan.setButtonText ("rescan");
+        tbClose.setButtonText ("close");
+        
+        library.addChangeListener (this);
+        updateList();
+    }
+    
+    ~PresetBrowser() override
+    {
+        library.removeChangeListener (this);
+    }
+    
+    void paint (Graphics& g) override
+    {
+        g.setColour ((findColour (AlertWindow::backgroundColourId)).withAlpha (0.95f));
+        g.fillRoundedRectangle (getLocalBounds().toFloat(), 5.0f);
+        
+        g.setColour (Colours::black);
+        g.setFont (getLookAndFeel().getAlertWindowMessageFont());
+        String status = String (presets.size()) + " of " + String (library.getNumPresets()) + " presets";
+        if (library.isScanning())
+            status += ", scanning...";
+        g.drawFittedText (status, statusArea, Justification::centredLeft, 1);
+    }
+    
+    void resized() override
+    {
+        auto area = getLocalBounds().reduced (margin);
+        
+        auto filterRow = area.removeFromTop (rowHeight);
+        cbPattern.setBounds (filterRow.removeFromRight (110));
+        filterRow.removeFromRight (margin);
+        cbBands.setBounds (filterRow.removeFromRight (90));
+        filterRow.removeFromRight (margin);
+        teSearch.setBounds (filterRow);
+        
+        auto buttonRow = area.removeFromBottom (rowHeight);
+        tbClose.setBounds (buttonRow.removeFromRight (buttonWidth));
+        buttonRow.removeFromRight (margin);
+        tbRescan.setBounds (buttonRow.removeFromRight (buttonWidth));
+        buttonRow.removeFromRight (margin);
+        tbLoad.setBounds (buttonRow.removeFromRight (buttonWidth));
+        statusArea = buttonRow;
+        
+        area.removeFromTop (margin);
+        area.removeFromBottom (margin);
+        lbPresets.setBounds (area);
+    }
+    
+    void colourChanged() override
+    {
+        const Colour buttonColour = findColour (TextButton::buttonColourId);
+        for (auto* tb : { &tbLoad, &tbRescan, &tbClose })
+            tb->setColour (TextButton::buttonColourId, buttonColour);
+    }
+    
+    void setOnLoadCallback (std::function<void (const var& preset)> cb) { onLoadCallback = cb; }
+    void setOnRescanCallback (std::function<void ()> cb) { onRescanCallback = cb; }
+    void setOnCloseCallback (std::function<void ()> cb) { onCloseCallback = cb; }
+    
+private:
+    // ListBoxModel
+    int getNumRows() override { return presets.size(); }
+    
+    void paintListBoxItem (int row, Graphics& g, int width, int height, bool rowIsSelected) override
+    {
+        if (!isPositiveAndBelow (row, presets.size()))
+            return;
+        
+        if (rowIsSelected)
+            g.fillAll (findColour (TextButton::buttonColourId).withAlpha (0.5f));
+        
+        const auto& entry = presets.getReference (row);
+        g.setColour (Colours::black);
+        g.setFont (getLookAndFeel().getAlertWindowMessageFont());
+        g.drawFittedText (entry.getName(), 4, 0, width - 60, height, Justification::centredLeft, 1);
+        g.drawFittedText (String (entry.nBands) + (entry.nBands == 1 ? " band" : " bands"), width - 56, 0, 52, height, Justification::centredRight, 1);
+    }
+    
+    void listBoxItemDoubleClicked (int row, const MouseEvent&) override
+    {
+        loadPreset (row);
+    }
+    
+    void returnKeyPressed (int row) override
+    {
+        loadPreset (row);
+    }
+    
+    void changeListenerCallback (ChangeBroadcaster*) override
+    {
+        updateList();
+    }
+    
+    void buttonClicked (Button* button) override
+    {
+        if (button == &tbLoad)
+            loadPreset (lbPresets.getSelectedRow());
+        else if (button == &tbRescan && onRescanCallback)
+            onRescanCallback();
+        else if (button == &tbClose && onCloseCallback)
+            onCloseCallback();
+        repaint();
+    }
+    
+    void comboBoxChanged (ComboBox*) override
+    {
+        updateList();
+    }
+    
+    void textEditorTextChanged (TextEditor&) override
+    {
+        updateList();
+    }
+    
+    void loadPreset (int row)
+    {
+        if (isPositiveAndBelow (row, presets.size()) && onLoadCallback)
+            onLoadCallback (presets.getReference (row).preset);
+    }
+    
+    void updateList()
+    {
+        const int nBands = cbBands.getSelectedId() - 1;
+        const auto pattern = static_cast<PresetLibrary::Pattern> (cbPattern.getSelectedId() - 1);
+        presets = library.findPresets (teSearch.getText(), nBands, pattern);
+        lbPresets.updateContent();
+        repaint();
+    }
+    
+    static constexpr int margin = 10;
+    static constexpr int rowHeight = 24;
+    static constexpr int buttonWidth = 80;
+    
+    PresetLibrary& library;
+    Array<PresetLibrary::Entry> presets;
+    
+    TextEditor teSearch;
+    ComboBox cbBands, cbPattern;
+    ListBox lbPresets;
+    TextButton tbLoad, tbRescan, tbClose;
+    Rectangle<int> statusArea;
+    
+    std::function<void (const var& preset)> onLoadCallback;
+    std::function<void ()> onRescanCallback;
+    std::function<void ()> onCloseCallback;
+    
+    JUCE_DECLARE_NON_COPYABLE (PresetBrowser)
+};
@@ -51,6 +51,7 @@
 
 #include "TitleBarPaths.h"
 #include "ImgPaths.h"
+#include "../lookAndFeel/GraphicsCache.h"
 
 #ifdef JUCE_OSC_H_INCLUDED
 #include "OSCStatus.h"
@@ -61,18 +62,16 @@ class  AlertSymbol :  public Component
 public:
     AlertSymbol() : Component()
     {
-        warningSign.loadPathFromData (WarningSignData, sizeof (WarningSignData));
         setBufferedToImage(true);
     };
     ~AlertSymbol() {};
     void paint (Graphics& g) override
     {
-        warningSign.applyTransform(warningSign.getTransformToScaleToFit(getLocalBounds().toFloat(), true, Justification::centred));
         g.setColour(Colours::yellow);
-        g.fillPath(warningSign);
+        g.fillPath(graphicsCache->getScaledIcon (GraphicsCache::warningSignIcon, getLocalBounds().toFloat()));
     };
 private:
-    Path warningSign;
+    SharedResourcePointer<GraphicsCache> graphicsCache;
 };
 
 class IOWidget : public Component
@@ -117,7 +116,6 @@ class  BinauralIOWidget :  public IOWidget
 {
 public:
     BinauralIOWidget() : IOWidget() {
-        BinauralPath.loadPathFromData (BinauralPathData, sizeof (BinauralPathData));
         setBufferedToImage(true);
     };
 
@@ -126,29 +124,26 @@ public:
     void setMaxSize (int maxSize) override {};
     void paint (Graphics& g) override
     {
-        BinauralPath.applyTransform(BinauralPath.getTransformToScaleToFit(0, 0, 30, 30, true,Justification::centred));
         g.setColour((Colours::white).withMultipliedAlpha(0.5));
-        g.fillPath(BinauralPath);
+        g.fillPath(graphicsCache->getScaledIcon (GraphicsCache::binauralIcon, Rectangle<float> (0, 0, 30, 30)));
 
     };
 
 private:
-    Path BinauralPath;
+    SharedResourcePointer<GraphicsCache> graphicsCache;
 };
 
 class  AALogo :  public IOWidget
 {
 public:
-    AALogo() : IOWidget() {
-        aaLogoPath.loadPathFromData (aaLogoData, sizeof (aaLogoData));
-    };
+    AALogo() : IOWidget() {};
     
     ~AALogo() {};
     const int getComponentSize() override { return 40; }
     void setMaxSize (int maxSize) override {};
     void paint (Graphics& g) override
     {
-        aaLogoPath.applyTransform (aaLogoPath.getTransformToScaleToFit (getLocalBounds().toFloat(), true, Justification::centred));
+        const Path& aaLogoPath = graphicsCache->getScaledIcon (GraphicsCache::aaLogoIcon, getLocalBounds().toFloat());
         // Colour AARed = Colour(155,35,35);
         g.setColour (Colours::white);
         g.strokePath (aaLogoPath, PathStrokeType (0.1f));
@@ -156,7 +151,7 @@ public:
     };
     
 private:
-    Path aaLogoPath;
+    SharedResourcePointer<GraphicsCache> graphicsCache;
 };
 
 
@@ -165,7 +160,6 @@ class  AudioChannelsIOWidget :  public IOWidget
 {
 public:
     AudioChannelsIOWidget() : IOWidget() {
-        WaveformPath.loadPathFromData (WaveformPathData, sizeof (WaveformPathData));
         setBufferedToImage(true);
 
         if (selectable) {
@@ -242,9 +236,8 @@ public:
 
     void paint (Graphics& g) override
     {
-        WaveformPath.applyTransform(WaveformPath.getTransformToScaleToFit(0, 0, 30, 30, true,Justification::centred));
         g.setColour((Colours::white).withMultipliedAlpha(0.5));
-        g.fillPath(WaveformPath);
+        g.fillPath(graphicsCache->getScaledIcon (GraphicsCache::waveformIcon, Rectangle<float> (0, 0, 30, 30)));
 
         if (!selectable)
         {
@@ -257,7 +250,7 @@ public:
 
 private:
     std::unique_ptr<ComboBox> cbChannels;
-    Path WaveformPath;
+    SharedResourcePointer<GraphicsCache> graphicsCache;
     int availableChannels {64};
     int channelSizeIfNotSelectable = maxChannels;
     String displayTextIfNotSelectable = String(maxChannels);
@@ -267,7 +260,6 @@ class  DirectivityIOWidget :  public IOWidget
 {
 public:
     DirectivityIOWidget() : IOWidget() {
-        DirectivityPath.loadPathFromData (DirectivityPathData, sizeof (DirectivityPathData));
         setBufferedToImage(true);
         orderStrings[0] = String("0th");
         orderStrings[1] = String("1st");
@@ -332,23 +324,20 @@ public:
 
     void paint (Graphics& g) override
     {
-        DirectivityPath.applyTransform(DirectivityPath.getTransformToScaleToFit(0, 0, 30, 30, true,Justification::centred));
         g.setColour((Colours::white).withMultipliedAlpha(0.5));
-        g.fillPath(DirectivityPath);
+        g.fillPath(graphicsCache->getScaledIcon (GraphicsCache::directivityIcon, Rectangle<float> (0, 0, 30, 30)));
     };
 
 private:
     String orderStrings[8];
     ComboBox cbNormalization, cbOrder;
-    Path DirectivityPath;
+    SharedResourcePointer<GraphicsCache> graphicsCache;
 };
 
 class  TitleBarAAText : public Component
 {
 public:
-    TitleBarAAText() {
-        titlePath.loadPathFromData(aaFontData, sizeof(aaFontData));
-    };
+    TitleBarAAText() {};
     ~TitleBarAAText() {};
 
     void resized() override
@@ -358,15 +347,14 @@ public:
 
     void paint(Graphics& g) override
     {
-        Rectangle<int> bounds = getLocalBounds();
+        const Path& titlePath = graphicsCache->getScaledIcon (GraphicsCache::aaTitleIcon, getLocalBounds().toFloat(), Justification::left);
         g.setColour(Colours::white);
-        titlePath.applyTransform(titlePath.getTransformToScaleToFit(getLocalBounds().toFloat(), true, Justification::left));
         g.strokePath(titlePath, PathStrokeType(0.1f));
         g.fillPath(titlePath);
     };
 
 private:
-    Path titlePath;
+    SharedResourcePointer<GraphicsCache> graphicsCache;
 };
 
 class  TitleBarPDText : public Component
@@ -430,7 +418,6 @@ class IEMLogo : public Component
 public:
     IEMLogo() : Component()
     {
-        IEMPath.loadPathFromData (IEMpathData, sizeof (IEMpathData));
 //        url = URL("https://plugins.iem.at/");
     }
     ~IEMLogo() {};
@@ -440,7 +427,7 @@ public:
         Rectangle<int> bounds = getLocalBounds();
         bounds.removeFromBottom (3);
         bounds.removeFromLeft (1);
-        IEMPath.applyTransform(IEMPath.getTransformToScaleToFit(bounds.reduced(2, 2).toFloat(), true, Justification::bottomLeft));
+        const Path& IEMPath = graphicsCache->getScaledIcon (GraphicsCache::iemLogoIcon, bounds.reduced(2, 2).toFloat(), Justification::bottomLeft);
 
 //        if (isMouseOver())
 //        {
@@ -471,7 +458,7 @@ public:
 //    }
 
 private:
-    Path IEMPath;
+    SharedResourcePointer<GraphicsCache> graphicsCache;
 //    URL url;
 };
 
@@ -51,7 +51,7 @@
 
 #pragma once
 
-#include "BinaryFonts.h"
+#include "GraphicsCache.h"
 
 class LaF : public LookAndFeel_V4
 {
@@ -73,6 +73,7 @@ public:
         Colour(0xFF00CAFF), Colour(0xFF4FFF00), Colour(0xFFFF9F00), Colour(0xFFD0011B)
     };
 
+    SharedResourcePointer<GraphicsCache> graphicsCache;
     Typeface::Ptr aaLight, aaRegular, aaMedium, terminator;
 
     //float sliderThumbDiameter = 14.0f;
@@ -80,10 +81,11 @@ public:
 
     LaF()
     {
-        aaLight = Typeface::createSystemTypefaceFor(BinaryFonts::NunitoSansLight_ttf, BinaryFonts::NunitoSansLight_ttfSize);
-        aaMedium = Typeface::createSystemTypefaceFor(BinaryFonts::NunitoSansRegular_ttf, BinaryFonts::NunitoSansRegular_ttfSize);
-        aaRegular = Typeface::createSystemTypefaceFor(BinaryFonts::NunitoSansSemiBold_ttf, BinaryFonts::NunitoSansSemiBold_ttfSize);
-        terminator = Typeface::createSystemTypefaceFor(BinaryFonts::terminator_ttf, BinaryFonts::terminator_ttfSize);
+        // decoded once per process, not per editor
+        aaLight = graphicsCache->aaLight;
+        aaMedium = graphicsCache->aaMedium;
+        aaRegular = graphicsCache->aaRegular;
+        terminator = graphicsCache->terminator;
 
         setColour (Slider::rotarySliderFillColourId, Colours::black);
         setColour (Slider::thumbColourId, Colour (0xCCFFFFFF));
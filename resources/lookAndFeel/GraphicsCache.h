@@ -0,0 +1,116 @@
+/*
+ ==============================================================================
+ GraphicsCache.h
+
+ Copyright (c) 2019 - Austrian Audio GmbH
+ www.austrian.audio
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ==============================================================================
+ */
+
+#pragma once
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "BinaryFonts.h"
+#include "../customComponents/ImgPaths.h"
+#include "../customComponents/TitleBarPaths.h"
+
+/* Typefaces and icon paths shared by all editors of the process through a SharedResourcePointer.
+   The embedded fonts are decoded and the path data is parsed once, icons fitted to an area are
+   kept until the cache fills up. Paths don't depend on the display scale, so the area is the key.
+   Message thread only. */
+class GraphicsCache
+{
+public:
+    enum Icon
+    {
+        omniIcon,
+        cardioidIcon,
+        reverseCardioidIcon,
+        eightIcon,
+        superCardioidIcon,
+        hyperCardioidIcon,
+        broadCardioidIcon,
+        reverseBroadCardioidIcon,
+        aaLogoIcon,
+        aaTitleIcon,
+        warningSignIcon,
+        binauralIcon,
+        waveformIcon,
+        directivityIcon,
+        iemLogoIcon,
+        numIcons
+    };
+    
+    Typeface::Ptr aaLight, aaRegular, aaMedium, terminator;
+    
+    GraphicsCache()
+    {
+        aaLight = Typeface::createSystemTypefaceFor(BinaryFonts::NunitoSansLight_ttf, BinaryFonts::NunitoSansLight_ttfSize);
+        aaMedium = Typeface::createSystemTypefaceFor(BinaryFonts::NunitoSansRegular_ttf, BinaryFonts::NunitoSansRegular_ttfSize);
+        aaRegular = Typeface::createSystemTypefaceFor(BinaryFonts::NunitoSansSemiBold_ttf, BinaryFonts::NunitoSansSemiBold_ttfSize);
+        terminator = Typeface::createSystemTypefaceFor(BinaryFonts::terminator_ttf, BinaryFonts::terminator_ttfSize);
+        
+        icons[omniIcon].loadPathFromData (omniData, sizeof (omniData));
+        icons[cardioidIcon].loadPathFromData (cardData, sizeof (cardData));
+        icons[reverseCardioidIcon] = icons[cardioidIcon];
+        icons[reverseCardioidIcon].applyTransform (AffineTransform::rotation (MathConstants<float>::pi));
+        icons[eightIcon].loadPathFromData (eightData, sizeof (eightData));
+        icons[superCardioidIcon].loadPathFromData (sCardData, sizeof (sCardData));
+        icons[hyperCardioidIcon].loadPathFromData (hCardData, sizeof (hCardData));
+        icons[broadCardioidIcon].loadPathFromData (bCardData, sizeof (bCardData));
+        icons[reverseBroadCardioidIcon] = icons[broadCardioidIcon];
+        icons[reverseBroadCardioidIcon].applyTransform (AffineTransform::rotation (MathConstants<float>::pi));
+        icons[aaLogoIcon].loadPathFromData (aaLogoData, sizeof (aaLogoData));
+        icons[aaTitleIcon].loadPathFromData (aaFontData, sizeof (aaFontData));
+        icons[warningSignIcon].loadPathFromData (WarningSignData, sizeof (WarningSignData));
+        icons[binauralIcon].loadPathFromData (BinauralPathData, sizeof (BinauralPathData));
+        icons[waveformIcon].loadPathFromData (WaveformPathData, sizeof (WaveformPathData));
+        icons[directivityIcon].loadPathFromData (DirectivityPathData, sizeof (DirectivityPathData));
+        icons[iemLogoIcon].loadPathFromData (IEMpathData, sizeof (IEMpathData));
+    }
+    
+    // as parsed from the path data
+    const Path& getIcon (Icon icon) const
+    {
+        return icons[icon];
+    }
+    
+    // icon scaled to fit the area, preserving its proportions
+    const Path& getScaledIcon (Icon icon, Rectangle<float> area, Justification justification = Justification::centred)
+    {
+        const ScaledIconKey key { icon, area.getX(), area.getY(), area.getWidth(), area.getHeight(), justification.getFlags() };
+        auto cached = scaledIcons.find (key);
+        if (cached != scaledIcons.end())
+            return cached->second;
+        
+        // sizes of closed editors pile up otherwise
+        if (scaledIcons.size() >= maxScaledIcons)
+            scaledIcons.clear();
+        
+        Path& path = scaledIcons[key];
+        path = icons[icon];
+        path.applyTransform (path.getTransformToScaleToFit (area, true, justification));
+        return path;
+    }
+    
+private:
+    using ScaledIconKey = std::tuple<int, float, float, float, float, int>;
+    static constexpr size_t maxScaledIcons = 256;
+    
+    Path icons[numIcons];
+    std::map<ScaledIconKey, Path> scaledIcons;
+    
+    JUCE_DECLARE_NON_COPYABLE (GraphicsCache)
+};